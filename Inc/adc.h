@@ -0,0 +1,26 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+
+// ADC1 scan of ADC_NUM_CH channels, triggered by TIM3 at ADC_SCAN_HZ and
+// streamed by DMA2 Stream0 into a circular buffer. Each half buffer holds
+// ADC_OVERSAMPLE scans and is decimated into one 14-bit value per channel.
+// Add a channel (e.g. soil moisture) by extending the list in adc.c.
+
+#define ADC_NUM_CH      1
+#define ADC_CH_LDR      0        // index into the scan list, PA5 / IN5
+#define ADC_SCAN_HZ     1000
+#define ADC_OVERSAMPLE  16       // 16x -> 2 extra bits
+#define ADC_BITS        14
+#define ADC_DECIM_SHIFT 2        // log2(ADC_OVERSAMPLE) - (ADC_BITS - 12)
+
+void adc_init(void);
+uint16_t adc_value(uint8_t ch); // latest decimated value, 0..(1 << ADC_BITS) - 1
+uint32_t adc_seq(void);         // increments once per decimated block
+
+// The kernel the DMA ISR runs on each half buffer: ADC_OVERSAMPLE scans in,
+// one value per channel out
+void adc_decimate(volatile uint16_t (*blk)[ADC_NUM_CH], volatile uint16_t *out);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef APP_H
+#define APP_H
+
+#include <stdint.h>
+
+// Application modules scheduled from main.c. The Makefile selects them
+// with CONFIG_<MODULE>=0/1; a build without it gets every module.
+
+#ifndef CONFIG_RELAY
+#define CONFIG_RELAY 1
+#endif
+#ifndef CONFIG_MOTOR
+#define CONFIG_MOTOR 1
+#endif
+#ifndef CONFIG_LIGHT
+#define CONFIG_LIGHT 1
+#endif
+#ifndef CONFIG_CLIMATE
+#define CONFIG_CLIMATE 1
+#endif
+#ifndef CONFIG_ACCESS
+#define CONFIG_ACCESS 1
+#endif
+
+void relay_init(void);     // main.c: PB7 push button toggles the PA8 relay
+void relay_task(void);
+
+void motor_app_init(void); // tb6612fng.c: pump (and fan) soft-started to 80%
+
+void light_init(void);     // LDR.C: LDR on PA5 drives the LED bar
+void light_task(void);
+
+void climate_init(int task); // dth11.c: DHT11 readout, PID fan speed
+void climate_task(void);
+
+void access_init(void);    // keypad.c: keypad + TM1637 access control
+void access_task(void);
+uint8_t access_busy(void); // access control currently owns the LCD
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+// Board pin map. Every pin the firmware uses is listed once, per port, as
+//   X(name, pin, mode, otype, pull, speed, af, init)
+// board_init() folds each list at compile time into one masked write per
+// MODER/OTYPER/OSPEEDR/PUPDR/AFR register and one BSRR write per port.
+// A pin listed twice on a port fails the build.
+
+#define BOARD_IN  0
+#define BOARD_OUT 1
+#define BOARD_AF  2
+#define BOARD_AN  3
+
+#define BOARD_PP 0    // push-pull
+#define BOARD_OD 1    // open-drain
+
+#define BOARD_NOPULL 0
+#define BOARD_PU     1
+#define BOARD_PD     2
+
+#define BOARD_SPEED_SLOW 0
+#define BOARD_SPEED_MED  1
+#define BOARD_SPEED_FAST 2
+#define BOARD_SPEED_HIGH 3
+
+#define BOARD_PINS_A(X) \
+	X(LCD_RS,    0,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_EN,    1,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_C1,    2,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_C3,    3,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(DHT11,     4,  BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 1) \
+	X(LDR,       5,  BOARD_AN,  BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_C5,    6,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_C7,    7,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(RELAY,     8,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0) \
+	X(KEY_COL0,  9,  BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_COL1,  10, BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_COL2,  11, BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_COL3,  12, BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 0)
+
+// PB3 is also TRACESWO; as KEY_ROW1 it carries no SWO output (probe.h)
+#define BOARD_PINS_B(X) \
+	X(LCD_D2,    0,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D3,    1,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_ROW0,  2,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_ROW1,  3,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_ROW2,  4,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(KEY_ROW3,  5,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(PWMA,      6,  BOARD_AF,  BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 2, 0) \
+	X(BUTTON,    7,  BOARD_IN,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_C9,    8,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(PWMB,      9,  BOARD_AF,  BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 2, 0) \
+	X(LED_RED,   10, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D4,    12, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D5,    13, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D6,    14, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D7,    15, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0)
+
+#define BOARD_PINS_C(X) \
+	X(SEG_CLK,   0,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 1) \
+	X(SEG_DIO,   1,  BOARD_OUT, BOARD_OD, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 1) \
+	X(FAN,       2,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LED_GREEN, 3,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D0,    4,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(LCD_D1,    5,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_SLOW, 0, 0) \
+	X(AIN1,      6,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0) \
+	X(AIN2,      7,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0) \
+	X(BIN1,      8,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0) \
+	X(BIN2,      9,  BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0) \
+	X(UART_TX,   10, BOARD_AF,  BOARD_PP, BOARD_NOPULL, BOARD_SPEED_MED,  7, 1) \
+	X(UART_RX,   11, BOARD_AF,  BOARD_PP, BOARD_PU,     BOARD_SPEED_SLOW, 7, 0) \
+	X(STBY,      13, BOARD_OUT, BOARD_PP, BOARD_NOPULL, BOARD_SPEED_HIGH, 0, 0)
+
+// name_N = pin number, name_P = port index (0 = A)
+#define BOARD_ENUM_A(name, pin, ...) name##_N = pin, name##_P = 0,
+#define BOARD_ENUM_B(name, pin, ...) name##_N = pin, name##_P = 1,
+#define BOARD_ENUM_C(name, pin, ...) name##_N = pin, name##_P = 2,
+enum {
+	BOARD_PINS_A(BOARD_ENUM_A)
+	BOARD_PINS_B(BOARD_ENUM_B)
+	BOARD_PINS_C(BOARD_ENUM_C)
+};
+
+#define PIN_PORT(name)  (name##_P == 0 ? GPIOA : name##_P == 1 ? GPIOB : GPIOC)
+#define PIN_BIT(name)   (1UL << name##_N)
+#define PIN_SET(name)   (PIN_PORT(name)->BSRR = PIN_BIT(name))
+#define PIN_CLR(name)   (PIN_PORT(name)->BSRR = PIN_BIT(name) << 16)
+#define PIN_READ(name)  ((PIN_PORT(name)->IDR >> name##_N) & 1)
+
+// Per-field folds over one port list
+#define B_BIT(n, pin, m, ot, pu, sp, af, in)     | (1UL << (pin))
+#define B_SUM(n, pin, m, ot, pu, sp, af, in)     + (1UL << (pin))
+#define B_MODE_M(n, pin, m, ot, pu, sp, af, in)  | (3UL << ((pin) * 2))
+#define B_MODE_V(n, pin, m, ot, pu, sp, af, in)  | ((uint32_t)(m) << ((pin) * 2))
+#define B_OT_V(n, pin, m, ot, pu, sp, af, in)    | ((uint32_t)(ot) << (pin))
+#define B_PU_V(n, pin, m, ot, pu, sp, af, in)    | ((uint32_t)(pu) << ((pin) * 2))
+#define B_SP_V(n, pin, m, ot, pu, sp, af, in)    | ((uint32_t)(sp) << ((pin) * 2))
+#define B_AFL_M(n, pin, m, ot, pu, sp, af, in)   | ((pin) < 8 && (m) == BOARD_AF ? 0xFUL << ((pin) * 4) : 0)
+#define B_AFL_V(n, pin, m, ot, pu, sp, af, in)   | ((pin) < 8 && (m) == BOARD_AF ? (uint32_t)(af) << ((pin) * 4) : 0)
+#define B_AFH_M(n, pin, m, ot, pu, sp, af, in)   | ((pin) >= 8 && (m) == BOARD_AF ? 0xFUL << (((pin) - 8) * 4) : 0)
+#define B_AFH_V(n, pin, m, ot, pu, sp, af, in)   | ((pin) >= 8 && (m) == BOARD_AF ? (uint32_t)(af) << (((pin) - 8) * 4) : 0)
+#define B_BSRR(n, pin, m, ot, pu, sp, af, in)    | ((in) ? 1UL << (pin) : 1UL << ((pin) + 16))
+
+#define BOARD_FOLD(LIST, F) (0 LIST(F))
+
+// Duplicate pins make the sum carry into a different value than the OR
+#define BOARD_CHECK(LIST, port) \
+	_Static_assert(BOARD_FOLD(LIST, B_SUM) == BOARD_FOLD(LIST, B_BIT), \
+	               "pin assigned twice on port " port)
+BOARD_CHECK(BOARD_PINS_A, "A");
+BOARD_CHECK(BOARD_PINS_B, "B");
+BOARD_CHECK(BOARD_PINS_C, "C");
+
+#define BOARD_PORT_INIT(gpio, LIST) do { \
+	const uint32_t bits = BOARD_FOLD(LIST, B_BIT); \
+	const uint32_t dbl = BOARD_FOLD(LIST, B_MODE_M); \
+	(gpio)->BSRR    = BOARD_FOLD(LIST, B_BSRR); \
+	(gpio)->OTYPER  = ((gpio)->OTYPER & ~bits) | BOARD_FOLD(LIST, B_OT_V); \
+	(gpio)->OSPEEDR = ((gpio)->OSPEEDR & ~dbl) | BOARD_FOLD(LIST, B_SP_V); \
+	(gpio)->PUPDR   = ((gpio)->PUPDR & ~dbl) | BOARD_FOLD(LIST, B_PU_V); \
+	if (BOARD_FOLD(LIST, B_AFL_M)) \
+		(gpio)->AFR[0] = ((gpio)->AFR[0] & ~BOARD_FOLD(LIST, B_AFL_M)) | BOARD_FOLD(LIST, B_AFL_V); \
+	if (BOARD_FOLD(LIST, B_AFH_M)) \
+		(gpio)->AFR[1] = ((gpio)->AFR[1] & ~BOARD_FOLD(LIST, B_AFH_M)) | BOARD_FOLD(LIST, B_AFH_V); \
+	(gpio)->MODER   = ((gpio)->MODER & ~dbl) | BOARD_FOLD(LIST, B_MODE_V); \
+} while (0)
+
+// Clocks and every pin on the board, outputs at their init level first
+static inline void board_init(void) {
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN;
+	BOARD_PORT_INIT(GPIOA, BOARD_PINS_A);
+	BOARD_PORT_INIT(GPIOB, BOARD_PINS_B);
+	BOARD_PORT_INIT(GPIOC, BOARD_PINS_C);
+}
+
+#endif
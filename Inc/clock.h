@@ -0,0 +1,30 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+#ifndef HSE_VALUE
+#define HSE_VALUE 8000000UL  // board crystal
+#endif
+#define HSI_VALUE 16000000UL
+
+typedef enum {
+	CLOCK_FULL,      // HSE+PLL 168 MHz, APB1 42 MHz, APB2 84 MHz, 5 WS
+	CLOCK_BALANCED,  // HSE+PLL  84 MHz, APB1 42 MHz, APB2 84 MHz, 2 WS
+	CLOCK_LOW_POWER, // HSI      16 MHz, PLL off, 0 WS
+	CLOCK_PROFILES
+} clock_profile_t;
+
+typedef void (*clock_hook_t)(void);
+
+void clock_setup(clock_profile_t p);        // registers only, safe from SystemInit
+void clock_set_profile(clock_profile_t p);  // setup + SystemCoreClock + hooks
+clock_profile_t clock_profile(void);
+int  clock_on_change(clock_hook_t fn);      // peripherals recompute prescalers here
+
+uint32_t clock_apb1_hz(void);
+uint32_t clock_apb2_hz(void);
+uint32_t clock_apb1_timer_hz(void);  // TIM2..7, TIM12..14
+uint32_t clock_apb2_timer_hz(void);  // TIM1, TIM8..11
+
+#endif
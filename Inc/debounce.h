@@ -0,0 +1,38 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+// Parallel debouncer: once per SysTick every watched GPIO port is sampled
+// and all 16 pins are filtered together with a 3-bit vertical counter, so a
+// pin changes state after 8 consecutive agreeing samples (8 ms).
+// Each watch gets its own event queue.
+//
+// Tickless idle keeps ticking every 1 ms while debounce_busy(); a change
+// on a settled pin is first sampled at the next wake.
+
+#define DB_PORT_A 0
+#define DB_PORT_B 1
+#define DB_PORT_C 2
+#define DB_PORTS  3
+
+#define DEBOUNCE_MAX_WATCH 4
+#define DEBOUNCE_QUEUE     8   // events per watch, power of two
+#define DEBOUNCE_LONG_MS   1000
+
+enum { DB_PRESS, DB_RELEASE, DB_LONG };
+
+typedef struct {
+	uint8_t port;
+	uint8_t pin;
+	uint8_t type;
+	uint32_t stamp;  // DWT->CYCCNT when the tick confirmed it
+} db_event_t;
+
+int  debounce_watch(uint8_t port, uint16_t mask, uint16_t active_low);
+int  debounce_get(int id, db_event_t *ev);  // 1 if an event was returned
+uint16_t debounce_level(uint8_t port);      // debounced IDR
+void debounce_tick(void);                   // real SysTick only, one IDR sample
+uint8_t debounce_busy(void);                // 1 while a pin is counting or held
+
+#endif
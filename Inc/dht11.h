@@ -0,0 +1,39 @@
+#ifndef DHT11_H
+#define DHT11_H
+
+#include <stdint.h>
+
+// DHT11 on PA4: start pulse timed by TIM2 compare, falling edges captured
+// by EXTI4 against the free-running TIM2 counter (1 tick = 1 us)
+
+#define DHT11_OK       0
+#define DHT11_BUSY     1
+#define DHT11_ERR     -1  // no response or bad pulse width
+#define DHT11_ERR_SUM -2  // checksum mismatch
+
+#define DHT11_QUEUE    4  // finished reads not yet collected, power of two
+
+typedef void (*dht11_cb_t)(int status, uint8_t t, uint8_t h);
+
+typedef struct {
+	int8_t  status;
+	uint8_t t;
+	uint8_t h;
+} dht11_sample_t;
+
+typedef struct {
+	uint32_t last;   // timestamp of the previous falling edge
+	uint8_t  edges;  // falling edges seen so far
+	uint8_t  d[5];
+} dht11_dec_t;
+
+void dht11_init(dht11_cb_t cb);
+int  dht11_start(void);
+int  dht11_get(dht11_sample_t *smp);       // 1 if a finished read was returned, oldest first
+int  dht11_result(uint8_t *t, uint8_t *h);  // latest read; drains the same queue as dht11_get
+
+// Edge decoder, independent of the hardware so it can be fed recorded traces
+void dht11_dec_reset(dht11_dec_t *dec);
+int  dht11_dec_edge(dht11_dec_t *dec, uint32_t ts);
+
+#endif
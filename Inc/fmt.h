@@ -0,0 +1,35 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdint.h>
+
+// Integer, fixed-point and hex formatting into caller buffers, no stdio.
+// Digits come two at a time from a "00".."99" table; /100 is a multiply
+// by its reciprocal and a shift, so nothing divides.
+//
+// Each call writes at least width characters and returns how many it
+// wrote. Values are never cut to fit the width. No terminator is written,
+// so a field can be formatted in place inside a line; the longest output
+// is FMT_MAX plus the width.
+
+#define FMT_MAX   13    // "-2147483648", or a sign, 10 digits and a point
+
+#define FMT_ZERO  0x01  // pad with zeros after the sign, not spaces before it
+#define FMT_LEFT  0x02  // pad on the right with spaces
+#define FMT_PLUS  0x04  // '+' on values >= 0
+#define FMT_UPPER 0x08  // hex A-F
+
+uint32_t fmt_u32(char *d, uint32_t v, uint8_t width, uint8_t flags);
+uint32_t fmt_i32(char *d, int32_t v, uint8_t width, uint8_t flags);
+
+// v in units of 10^-decimals: fmt_fixed(d, 234, 1, ...) gives "23.4",
+// fmt_fixed(d, -5, 2, ...) gives "-0.05"; decimals up to 9
+uint32_t fmt_fixed(char *d, int32_t v, uint8_t decimals, uint8_t width, uint8_t flags);
+
+// Binary fixed point with frac_bits fraction bits (PID_Q is 16), rounded
+// to decimals places: fmt_q(d, 0x00178000, 16, 1, ...) gives "23.5"
+uint32_t fmt_q(char *d, int32_t v, uint8_t frac_bits, uint8_t decimals, uint8_t width, uint8_t flags);
+
+uint32_t fmt_hex(char *d, uint32_t v, uint8_t width, uint8_t flags);
+
+#endif
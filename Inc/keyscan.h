@@ -0,0 +1,25 @@
+#ifndef KEYSCAN_H
+#define KEYSCAN_H
+
+#include <stdint.h>
+
+// 4x4 matrix, rows PB2-PB5 (outputs), columns PA9-PA12 (inputs, pull-up).
+// Idle: all rows low, EXTI armed on the columns, no CPU cost. A column edge
+// starts a scan that drives one row per 1 ms tick; a 4-row frame must repeat
+// before it is accepted. Scanning stops once every key is released.
+
+#define KEYSCAN_QUEUE 16  // power of two
+
+enum { KEY_PRESS, KEY_RELEASE };
+
+typedef struct {
+	uint8_t code;  // row * 4 + col
+	uint8_t type;
+} key_event_t;
+
+void keyscan_init(void);
+int  keyscan_get(key_event_t *ev);  // 1 if an event was returned
+uint16_t keyscan_state(void);       // bit row * 4 + col set while held
+void keyscan_stats(uint32_t *ghosts, uint32_t *latency_max_cycles);
+
+#endif
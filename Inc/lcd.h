@@ -1,5 +1,21 @@
+#ifndef LCD_H
+#define LCD_H
+
+#include <stdint.h>
+
+#define LCD_ROWS 2
+#define LCD_COLS 16
+
 void lcd_init(void);
-void lcd(uint8_t val, uint8_t cmd);
+void lcd(uint8_t val, uint8_t cmd); // queued, sent by the TIM6 ISR
+void lcd_flush_wait(void);
 void lcd_string(char *str);
-void singl_print(uint32_t val);
+void single_print(uint32_t val); // 4 digits, zero-padded; more if it needs them
+
+// Shadow framebuffer, only changed cells are sent on flush
+void lcd_fb_puts(uint8_t row, uint8_t col, const char *str);
+void lcd_fb_flush(void);
+void lcd_print(uint8_t addr, const char *str);
+void lcd_fb_invalidate(void); // after writing the panel with lcd() directly, the next flush redraws it all
 
+#endif
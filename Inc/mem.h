@@ -0,0 +1,30 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdint.h>
+
+// Heap and stack accounting, in sysmem.c next to _sbrk().
+//
+// mem_init() paints the free RAM between the heap and the stack pointer
+// with MEM_PAINT; the stack high-water is where the paint stops. After
+// mem_heap_lock() any _sbrk() is a bug: it is counted, logged on the
+// fatal UART path, stops at a breakpoint when a debugger is attached and
+// fails with ENOMEM. With POOL_MALLOC (pool.h) malloc never reaches it.
+
+#define MEM_PAINT 0xC5C5C5C5UL
+
+typedef struct {
+	uint32_t heap_used;    // _sbrk() bytes handed out
+	uint32_t heap_max;     // high-water of heap_used
+	uint32_t stack_used;   // deepest MSP use seen in the paint, bytes
+	uint32_t stack_size;   // _Min_Stack_Size the link reserved
+	uint32_t free;         // RAM between heap end and stack high-water
+	uint32_t sbrk_locked;  // _sbrk() calls after mem_heap_lock()
+	uint32_t sbrk_caller;  // return address of the first of those
+} mem_stats_t;
+
+void mem_init(void);       // first thing in main()
+void mem_heap_lock(void);  // end of init
+void mem_stats(mem_stats_t *s);  // walks the paint, not for ISRs
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PID_H
+#define PID_H
+
+#include <stdint.h>
+
+// Fixed-point PID, Q16.16 throughout. A step is a handful of 32x32->64
+// multiplies and compares: no floats, no divides, no loops, so it costs
+// the same every call. The loop period is folded into the gains, so ki and
+// kd are per step.
+//
+// - derivative on the measurement (no kick on setpoint changes), through a
+//   first-order low-pass with coefficient d_alpha (PID_ONE = unfiltered)
+// - anti-windup: the integrator is clamped to the output range and frozen
+//   while the output is saturated in the direction the error pushes
+// - output moves at most rate per step (0 = unlimited)
+// - PID_HYST runs the same object as an on/off controller with a +-hyst
+//   band, for outputs that can only switch or a loop that is not tuned yet;
+//   switching back to PID_AUTO is bumpless
+
+#define PID_Q      16
+#define PID_ONE    (1L << PID_Q)
+#define PID_Q16(x) ((int32_t)((x) * (double)PID_ONE))  // constants only
+
+enum { PID_AUTO, PID_HYST };
+
+typedef struct {
+	// Config
+	int32_t kp, ki, kd;        // Q16, ki and kd per step
+	int32_t d_alpha;           // Q16, derivative filter, 0 < d_alpha <= PID_ONE
+	int32_t out_min, out_max;  // Q16
+	int32_t rate;              // Q16 per step, 0 = unlimited
+	int32_t hyst;              // Q16, half band for PID_HYST
+	uint8_t reverse;           // output rises when the measurement is above setpoint
+	uint8_t mode;
+
+	// State
+	int32_t integ;
+	int32_t d;
+	int32_t prev;              // last measurement
+	int32_t out;
+	uint8_t primed;            // prev is valid
+} pid_ctrl_t;
+
+void    pid_reset(pid_ctrl_t *p, int32_t out);   // clear state, start from out
+void    pid_set_mode(pid_ctrl_t *p, uint8_t mode);
+int32_t pid_step(pid_ctrl_t *p, int32_t sp, int32_t meas);  // Q16 in, Q16 out
+
+#endif
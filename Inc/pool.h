@@ -0,0 +1,50 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+// Fixed-block pools in place of the newlib heap. Each size class is a
+// static array of equal blocks threaded on a free list, so alloc and free
+// are a list pop and push with no search, split or merge. A request takes
+// the smallest class that fits and spills to the next larger one when
+// that class is empty. Nothing fragments; the worst case is a full pool.
+//
+// pool_alloc()/pool_free() are for the main loop only. The _isr variants
+// mask interrupts around the list update and may be used from ISRs and
+// from code they interrupt; mixing the plain ones into that is a race.
+//
+// With POOL_MALLOC (target builds) malloc, free, calloc and realloc and
+// their newlib _r forms come from the pools, so a C library path that
+// allocates is bounded too and _sbrk is left for mem.h to guard.
+
+#ifndef POOL_MALLOC
+#define POOL_MALLOC 1
+#endif
+
+//      block bytes (multiple of 8, ascending), blocks
+#define POOL_CLASSES(X) \
+	X(16,  16) \
+	X(32,  8)  \
+	X(64,  4)  \
+	X(128, 2)
+
+#define POOL_CLASS_COUNT(size, n) +1
+#define POOL_NUM_CLASSES (0 POOL_CLASSES(POOL_CLASS_COUNT))
+
+typedef struct {
+	uint16_t size;    // block bytes
+	uint16_t blocks;
+	uint16_t used;
+	uint16_t max;     // high-water of used
+	uint32_t fails;   // requests for this class that found the pools empty
+} pool_stats_t;
+
+void pool_init(void);  // optional, the first alloc does it
+void *pool_alloc(uint32_t size);
+void pool_free(void *p);
+void *pool_alloc_isr(uint32_t size);
+void pool_free_isr(void *p);
+uint32_t pool_block_size(const void *p);  // 0 if p is not a pool block
+int  pool_stats(int cls, pool_stats_t *s); // 0 past the last class
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+// Named probe points on the DWT cycle counter. Each probe keeps count,
+// min, max and a log2 histogram of the intervals it records, in fixed
+// memory; p99 is read off the histogram as a bucket's upper bound. A
+// record is a CYCCNT load, a CLZ and a few stores.
+//
+// Three ways to feed a probe:
+//   probe_begin/probe_end   an interval; end records only after a begin,
+//                           so begin can sit in an ISR and end in a task
+//   probe_mark              the time since the previous mark (period, jitter)
+//   probe_since             the time since a CYCCNT stamp taken elsewhere
+//
+// Every probe has one writer context, except the begin/end pairs split
+// between an ISR and a task: there a begin landing mid-end loses one
+// sample. Intervals over one CYCCNT wrap (25 s at 168 MHz) alias.
+//
+// Send "probe" on the UART console for a snapshot, "probe reset" to take
+// it and start over, "mem" for heap, stack and pool use (mem.h, pool.h).
+// Lines go to SWO (ITM port PROBE_ITM_PORT) while a debugger has it
+// enabled and PB3 is still TRACESWO, else to the UART, each one
+// NUL-terminated so telemdec can tell it from the telemetry frames. This
+// board uses PB3 as KEY_ROW1, so the report comes out on the UART.
+
+#ifndef PROBE_ENABLE
+#define PROBE_ENABLE 1
+#endif
+
+#define PROBE_BUCKETS  32  // bucket b: 2^b .. 2^(b+1)-1 cycles, 0 and 1 in bucket 0
+#define PROBE_ITM_PORT 1
+#define PROBE_LINE     480 // longest report line
+
+//      id                 name
+#define PROBE_LIST(X) \
+	X(PROBE_SYSTICK,     "systick")     /* SysTick handler */ \
+	X(PROBE_DHT_EDGE,    "dht_edge")    /* EXTI4, one DHT11 edge */ \
+	X(PROBE_ADC_DMA,     "adc_dma")     /* ADC half-buffer decimation */ \
+	X(PROBE_UART_IRQ,    "uart_irq")    /* USART3 idle/overrun */ \
+	X(PROBE_RELAY_PER,   "relay_per")   /* relay_task period */ \
+	X(PROBE_LIGHT_PER,   "light_per")   /* light_task period */ \
+	X(PROBE_CLIMATE_PER, "climate_per") /* climate_task period */ \
+	X(PROBE_RELAY_LAT,   "relay_lat")   /* debounced press -> relay pin */ \
+	X(PROBE_FAN_LAT,     "fan_lat")     /* DHT11 frame done -> fan set */
+
+#define PROBE_ENUM(id, name) id,
+enum { PROBE_LIST(PROBE_ENUM) PROBE_COUNT };
+
+typedef struct {
+	uint32_t start;  // CYCCNT at begin or at the last mark
+	uint8_t  open;   // start is valid
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t hist[PROBE_BUCKETS];
+} probe_t;
+
+extern probe_t probes[PROBE_COUNT];
+
+void probe_init(void);
+void probe_snapshot(int id, probe_t *out, uint8_t reset);
+uint32_t probe_p99(const probe_t *p);  // upper bound of the p99 bucket, at most max
+const char *probe_name(int id);
+void probe_task(void);                 // console commands and report, main loop
+
+#if PROBE_ENABLE
+
+static inline void probe_record(int id, uint32_t cycles) {
+	probe_t *p = &probes[id];
+
+	p->hist[31 - __builtin_clz(cycles | 1)]++;
+	if (cycles < p->min)
+		p->min = cycles;
+	if (cycles > p->max)
+		p->max = cycles;
+	p->count++;
+}
+
+static inline void probe_begin(int id) {
+	probes[id].start = DWT->CYCCNT;
+	probes[id].open = 1;
+}
+
+static inline void probe_end(int id) {
+	if (probes[id].open) {
+		probes[id].open = 0;
+		probe_record(id, DWT->CYCCNT - probes[id].start);
+	}
+}
+
+static inline void probe_mark(int id) {
+	uint32_t now = DWT->CYCCNT;
+
+	if (probes[id].open)
+		probe_record(id, now - probes[id].start);
+	probes[id].start = now;
+	probes[id].open = 1;
+}
+
+static inline void probe_since(int id, uint32_t stamp) {
+	probe_record(id, DWT->CYCCNT - stamp);
+}
+
+#else
+
+static inline void probe_record(int id, uint32_t cycles) { (void)id; (void)cycles; }
+static inline void probe_begin(int id) { (void)id; }
+static inline void probe_end(int id) { (void)id; }
+static inline void probe_mark(int id) { (void)id; }
+static inline void probe_since(int id, uint32_t stamp) { (void)id; (void)stamp; }
+
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+// Single-producer/single-consumer ring for handing data from an ISR to the
+// main loop or back. RING_DEFINE(name, type, size) declares name_t and its
+// inline functions; size must be a power of two.
+//
+// head and tail run free and are masked on access, so head - tail is the
+// fill level and every slot is usable. Each side only stores its own index.
+// The index store is a release and the other side's index load an acquire,
+// which on Cortex-M4 puts a DMB between the slot access and the index update.
+// Batch push/pop move up to n items and publish the index once.
+//
+// Never share one ring between two producers or two consumers.
+
+#define RING_LOAD_OWN(p)    __atomic_load_n(p, __ATOMIC_RELAXED)
+#define RING_LOAD_OTHER(p)  __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RING_PUBLISH(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#define RING_DEFINE(name, type, size) \
+_Static_assert((size) > 0 && ((size) & ((size) - 1)) == 0, #name ": size must be a power of two"); \
+typedef struct { \
+	uint32_t head; \
+	uint32_t tail; \
+	type buf[size]; \
+} name##_t; \
+\
+static inline uint32_t name##_count(name##_t *r) { \
+	return RING_LOAD_OTHER(&r->head) - RING_LOAD_OTHER(&r->tail); \
+} \
+\
+static inline uint32_t name##_space(name##_t *r) { \
+	return (size) - name##_count(r); \
+} \
+\
+/* Producer: 0 if the ring is full */ \
+static inline int name##_push(name##_t *r, const type *v) { \
+	uint32_t h = RING_LOAD_OWN(&r->head); \
+	if (h - RING_LOAD_OTHER(&r->tail) == (size)) \
+		return 0; \
+	r->buf[h & ((size) - 1)] = *v; \
+	RING_PUBLISH(&r->head, h + 1); \
+	return 1; \
+} \
+\
+/* Producer: pushes as many of n items as fit, returns how many */ \
+static inline uint32_t name##_push_n(name##_t *r, const type *v, uint32_t n) { \
+	uint32_t h = RING_LOAD_OWN(&r->head); \
+	uint32_t room = (size) - (h - RING_LOAD_OTHER(&r->tail)); \
+	if (n > room) \
+		n = room; \
+	for (uint32_t i = 0; i < n; i++) \
+		r->buf[(h + i) & ((size) - 1)] = v[i]; \
+	RING_PUBLISH(&r->head, h + n); \
+	return n; \
+} \
+\
+/* Consumer: 0 if the ring is empty */ \
+static inline int name##_pop(name##_t *r, type *v) { \
+	uint32_t t = RING_LOAD_OWN(&r->tail); \
+	if (RING_LOAD_OTHER(&r->head) == t) \
+		return 0; \
+	*v = r->buf[t & ((size) - 1)]; \
+	RING_PUBLISH(&r->tail, t + 1); \
+	return 1; \
+} \
+\
+/* Consumer: pops up to n items, returns how many */ \
+static inline uint32_t name##_pop_n(name##_t *r, type *v, uint32_t n) { \
+	uint32_t t = RING_LOAD_OWN(&r->tail); \
+	uint32_t used = RING_LOAD_OTHER(&r->head) - t; \
+	if (n > used) \
+		n = used; \
+	for (uint32_t i = 0; i < n; i++) \
+		v[i] = r->buf[(t + i) & ((size) - 1)]; \
+	RING_PUBLISH(&r->tail, t + n); \
+	return n; \
+} \
+\
+/* Consumer: look at the oldest item without removing it */ \
+static inline int name##_peek(name##_t *r, type *v) { \
+	uint32_t t = RING_LOAD_OWN(&r->tail); \
+	if (RING_LOAD_OTHER(&r->head) == t) \
+		return 0; \
+	*v = r->buf[t & ((size) - 1)]; \
+	return 1; \
+} \
+\
+/* Consumer: drop the item last returned by peek */ \
+static inline void name##_drop(name##_t *r) { \
+	RING_PUBLISH(&r->tail, RING_LOAD_OWN(&r->tail) + 1); \
+}
+
+#endif
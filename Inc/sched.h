@@ -0,0 +1,39 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+// Run-to-completion cooperative scheduler on a 1 ms SysTick.
+// Tasks never preempt each other; the ready task with the lowest prio
+// value runs first. A task is late when it finishes after release + deadline.
+
+#define SCHED_MAX_TASKS 8
+
+typedef void (*task_fn_t)(void);
+
+typedef struct {
+	const char *name;
+	task_fn_t fn;
+	uint32_t period;    // ms, 0 = one-shot
+	uint32_t deadline;  // ms after release, defaults to the period
+	uint32_t release;   // tick of the next release
+	uint8_t prio;       // 0 = most urgent
+	uint8_t active;
+
+	uint32_t runs;
+	uint32_t wcet;      // worst-case execution time in CPU cycles
+	uint32_t overruns;  // runs that completed past their deadline
+	uint32_t late_max;  // worst completion past the deadline, ms
+} sched_task_t;
+
+extern volatile uint32_t system_ticks;  // SysTick only writes it, word loads are atomic
+
+void sched_init(void);
+int  sched_add(const char *name, task_fn_t fn, uint32_t period, uint32_t delay, uint8_t prio);
+void sched_once(int id, uint32_t delay);
+void sched_stop(int id);
+__attribute__((noreturn)) void sched_run(void);  // sleeps in WFI when nothing is due
+void sched_sleep_stats(uint32_t *asleep_ms, uint32_t *total_ms);
+const sched_task_t *sched_get(int id);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SWTIMER_H
+#define SWTIMER_H
+
+#include <stdint.h>
+
+// Software timers on a 4-level hierarchical timing wheel (64 slots per
+// level) advanced by SysTick. Start/stop/expire are O(1); the tick only
+// touches the slot that is due. Nodes come from a fixed pool.
+// Callbacks run in the SysTick ISR and must be short. The tick relinks
+// slots with interrupts on, so an ISR that starts or stops timers has to
+// run at SWTIMER_IRQ_PRIO, where it cannot preempt the tick.
+
+#ifndef SWTIMER_MAX
+#define SWTIMER_MAX 16
+#endif
+
+#define SWTIMER_MAX_MS ((1UL << 24) - 1)  // ~4.6 h, longer timeouts and periods are clamped
+#define SWTIMER_IRQ_PRIO ((1UL << __NVIC_PRIO_BITS) - 1)  // SysTick's, from SysTick_Config()
+
+typedef void (*swtimer_cb_t)(void *arg);
+
+int  swtimer_create(swtimer_cb_t cb, void *arg);
+void swtimer_start(int id, uint32_t ms, uint32_t period);  // period 0 = one-shot
+void swtimer_stop(int id);
+uint8_t swtimer_active(int id);
+void swtimer_tick(void);
+uint32_t swtimer_next(void);  // ticks until the wheel needs servicing
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TB6612_H
+#define TB6612_H
+
+#include <stdint.h>
+
+// TB6612FNG dual motor driver. Channel A: PWMA on PB6 (TIM4_CH1), AIN1/2
+// on PC6/PC7. Channel B: PWMB on PB9 (TIM4_CH4), BIN1/2 on PC8/PC9.
+// STBY on PC13.
+//
+// Speed changes are ramps. motor_set() builds a table with one CCR1..CCR4
+// row per PWM period, and TIM4 update DMA (DMA1 Stream6, burst through
+// DMAR) loads the next row every period, so a running ramp takes no CPU.
+// A direction change ramps to zero first, and the transfer-complete
+// interrupt then flips the pins and ramps up again.
+
+#define MOTOR_PWM_HZ   1000
+#define MOTOR_PWM_TOP  1000   // duty steps, ARR + 1
+#define MOTOR_RAMP_MAX 256    // rows, the longest ramp is MOTOR_RAMP_MAX periods
+#define MOTOR_RAMP_CCR 4      // CCR1..CCR4 per row; CH2/CH3 are unused and stay 0
+
+enum { MOTOR_A, MOTOR_B, MOTOR_CHANNELS };
+
+// Bridge state per channel
+enum { MOTOR_COAST, MOTOR_FWD, MOTOR_REV, MOTOR_BRAKE };
+
+typedef void (*motor_fault_fn)(uint8_t ch);
+
+void    motor_init(void);                 // standby, both channels coasting
+void    motor_set(uint8_t ch, int16_t speed, uint16_t ramp_ms);  // +-MOTOR_PWM_TOP
+void    motor_brake(uint8_t ch);          // short brake now, ramp cancelled
+void    motor_coast(uint8_t ch);          // outputs off now, ramp cancelled
+void    motor_standby(uint8_t on);        // driver off, both channels coast
+int16_t motor_speed(uint8_t ch);          // signed duty being output now
+uint8_t motor_ramping(void);
+
+// Current limit: commands and ramps are clamped to max. motor_overcurrent()
+// is for a comparator or ADC watchdog ISR; it coasts the channel at once
+// and calls the fault hook.
+void motor_set_limit(uint8_t ch, uint16_t max);
+void motor_fault_hook(motor_fault_fn fn);
+void motor_overcurrent(uint8_t ch);
+
+// Exposed for checking the generated tables. Each channel goes linearly
+// from from[ch] to to[ch] over len[ch] rows and then holds; returns the rows.
+uint16_t motor_ramp_build(uint16_t (*tab)[MOTOR_RAMP_CCR], const uint16_t *from,
+                          const uint16_t *to, const uint16_t *len);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+// Binary telemetry frames for the serial link.
+//
+// Frame before framing:
+//   u8      version << 4 | TM_F_KEY
+//   u8      sequence, +1 per frame; a gap means delta frames can't be decoded
+//           until the next keyframe
+//   varint  time: absolute ms in a keyframe, ms since the previous frame otherwise
+//   varint  mask of the channels present
+//   zigzag varint per present channel, lowest first: the value in a keyframe
+//           or for an event channel, the change since the last frame otherwise
+//   u16     CRC16-CCITT (0x1021, init 0xFFFF) of the bytes above, big-endian
+// Then COBS-encoded and terminated with 0x00.
+//
+// A keyframe carries every level channel set so far; one goes out at start
+// and every TELEM_KEY_EVERY frames. tools/telemdec.c turns a capture into CSV.
+
+#define TELEM_VERSION   1
+#define TELEM_KEY_EVERY 16
+#define TELEM_QUEUE     32       // pending samples, power of two
+#define TELEM_RAW_MAX   64
+#define TELEM_FRAME_MAX (TELEM_RAW_MAX + TELEM_RAW_MAX / 254 + 2)
+
+#define TM_F_KEY        0x01
+
+enum {
+	TM_TEMP,    // deg C
+	TM_HUM,     // %RH
+	TM_LIGHT,   // ADC, 14 bit
+	TM_RELAY,   // 0/1
+	TM_FAN,     // 0/1, running
+	TM_KEY,     // event: key character
+	TM_DUTY,    // fan speed, 0..1000
+	TM_CHANNELS
+};
+
+#define TM_EVENTS (1 << TM_KEY)  // channels sent as values, never as deltas
+
+typedef int (*telem_sink_t)(const char *p, int len);
+
+typedef struct {
+	int32_t  val[TM_CHANNELS];
+	uint32_t known;     // channels that have had a value
+	uint32_t time;      // ms of the previous frame
+	uint8_t  seq;
+	uint8_t  since_key;
+	uint8_t  synced;    // decoder: delta frames can be applied
+} telem_state_t;
+
+// Device side. Producers queue samples from the main loop; telem_poll()
+// packs them into frames. Level channels send their latest value if it
+// changed, a second event on an event channel starts a new frame.
+void telem_set(uint8_t ch, int32_t v);
+int  telem_poll(uint32_t now_ms, telem_sink_t sink);  // frames sent
+
+// Codec, shared with the host decoder
+uint16_t telem_crc16(const uint8_t *p, uint32_t len);
+uint32_t telem_cobs_encode(const uint8_t *in, uint32_t len, uint8_t *out);
+int32_t  telem_cobs_decode(const uint8_t *in, uint32_t len, uint8_t *out);  // -1 if malformed
+uint32_t telem_encode(telem_state_t *st, uint32_t now_ms, uint32_t mask,
+                      const int32_t *val, uint8_t *frame);  // framed length
+int telem_decode(telem_state_t *st, const uint8_t *raw, uint32_t len, uint32_t *mask);
+
+enum { TELEM_OK, TELEM_ERR_CRC = -1, TELEM_ERR_FORMAT = -2, TELEM_ERR_SYNC = -3 };
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+// Monotonic time from the DWT cycle counter, extended to 64 bits.
+// time_now_cycles() must run at least once per CYCCNT wrap (25 s at
+// 168 MHz); the scheduler tick takes care of that.
+
+void timebase_init(void);
+void timebase_clock_changed(void);  // call after SystemCoreClock changes
+void timebase_credit(uint32_t cycles);  // time the counter did not see (sleep)
+
+uint64_t time_now_cycles(void);
+uint64_t time_now_us(void);
+
+void delay_us(uint32_t us);  // busy-wait, up to 25 s at 168 MHz
+void delay_ms(uint32_t ms);
+
+#endif
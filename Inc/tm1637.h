@@ -0,0 +1,25 @@
+#ifndef TM1637_H
+#define TM1637_H
+
+#include <stdint.h>
+
+// TM1637 4-digit display on PC0 (CLK) / PC1 (DIO, open-drain).
+// An update is compiled into GPIOC->BSRR words (start/stop conditions,
+// LSB-first data bits, ACK slots) and clocked out by TIM8 update DMA on
+// DMA2 Stream1, one word per TM1637_STEP_US. The CPU only builds the buffer.
+
+#define TM1637_STEP_US 10
+
+void tm1637_init(void);
+void tm1637_brightness(uint8_t level);  // 0..7, applied on the next update
+void tm1637_show_segments(const uint8_t seg[4]);
+void tm1637_show_number(int value, uint8_t leading_zeros);  // -999..9999
+void tm1637_blank(void);
+uint8_t tm1637_busy(void);
+
+// Exposed for checking the generated waveform. Start 2 + stop 3 + 18 words
+// per byte, three transactions of 1, 5 and 1 bytes.
+#define TM1637_WORDS (3 * 5 + 7 * 18)
+uint16_t tm1637_build(uint32_t *buf, const uint8_t seg[4], uint8_t display_ctrl);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+// USART3 console on PC10 (TX) / PC11 (RX), 8N1.
+// TX: two buffers, DMA1 Stream3 sends one while writers fill the other, so
+// a write costs a copy instead of the wire time. Data that does not fit is
+// dropped and counted. uart_write_blocking() is the polled path for fatal
+// messages; it flushes what is queued first.
+// RX: DMA1 Stream1 runs circular into a buffer. Idle line, half and full
+// transfer interrupts publish how far it has got.
+
+#define UART_BAUD    115200
+#define UART_TX_BUF  512   // bytes per TX buffer, two of them
+#define UART_RX_BUF  256   // power of two
+
+typedef struct {
+    uint32_t tx_bytes;     // handed to the DMA
+    uint32_t tx_dropped;   // bytes that did not fit
+    uint32_t tx_overflows; // writes that lost data
+    uint32_t tx_blocking;  // bytes sent by the polled fatal path
+    uint32_t rx_bytes;
+    uint32_t rx_overruns;  // bytes overwritten before they were read
+} uart_stats_t;
+
+void uart_init(void);
+
+// Zero-copy TX: reserve n bytes in the fill buffer, write them, commit.
+// Returns 0 if the space is not there. Safe from ISRs; commit in reverse
+// order of reserve when nesting.
+char *uart_tx_reserve(uint32_t n);
+void uart_tx_commit(void);
+
+int  uart_write(const char *p, int len);           // bytes queued
+void uart_write_blocking(const char *p, int len);  // fatal logs
+int  uart_read(char *p, int len);                  // bytes available now, never blocks
+void uart_stats(uart_stats_t *s, uint8_t reset);
+
+#endif
@@ -0,0 +1,35 @@
+#include "stm32f4xx.h"
+#include "mem.h"
+#include <string.h>
+
+// RAM-backed peripherals for the host build
+
+host_periph_t host_periph;
+
+uint32_t host_primask;
+uint32_t host_nvic_enabled[4];
+uint8_t host_nvic_prio[96];
+
+// system_stm32f4xx.c is target-only, the host runs at a fixed 168 MHz
+uint32_t SystemCoreClock = 168000000;
+
+void SystemCoreClockUpdate(void) {
+}
+
+// sysmem.c is target-only, the host has no linker heap or MSP stack to watch
+void mem_init(void) {
+}
+
+void mem_heap_lock(void) {
+}
+
+void mem_stats(mem_stats_t *s) {
+	memset(s, 0, sizeof(*s));
+}
+
+// Overridden by the simulator
+__attribute__((weak)) void host_wfi(void) {
+}
+
+__attribute__((weak)) void host_irq_unmasked(void) {
+}
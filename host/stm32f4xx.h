@@ -0,0 +1,213 @@
+#ifndef HOST_STM32F4XX_H
+#define HOST_STM32F4XX_H
+
+#include <stdint.h>
+
+// Host stand-in for the CMSIS device header. Peripherals are plain structs
+// in RAM (host/periph.c) so the drivers compile and run unchanged on a PC;
+// nothing reacts to register writes unless the simulator (sim/) does it.
+
+#define __IO volatile
+
+typedef struct { __IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2]; } GPIO_TypeDef;
+typedef struct {
+	__IO uint32_t CR, PLLCFGR, CFGR, CIR, AHB1RSTR, AHB2RSTR, AHB3RSTR, RESERVED0, APB1RSTR, APB2RSTR,
+	              RESERVED1[2], AHB1ENR, AHB2ENR, AHB3ENR, RESERVED2, APB1ENR, APB2ENR, RESERVED3[2],
+	              AHB1LPENR, AHB2LPENR, AHB3LPENR, RESERVED4, APB1LPENR, APB2LPENR, RESERVED5[2], BDCR, CSR;
+} RCC_TypeDef;
+typedef struct {
+	__IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR,
+	              CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR;
+} TIM_TypeDef;
+typedef struct {
+	__IO uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR1, JOFR2, JOFR3, JOFR4, HTR, LTR, SQR1, SQR2, SQR3,
+	              JSQR, JDR1, JDR2, JDR3, JDR4, DR;
+} ADC_TypeDef;
+typedef struct { __IO uint32_t CSR, CCR, CDR; } ADC_Common_TypeDef;
+typedef struct { __IO uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR; } DMA_Stream_TypeDef;
+typedef struct { __IO uint32_t LISR, HISR, LIFCR, HIFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { __IO uint32_t MEMRMP, PMC, EXTICR[4], RESERVED[2], CMPCR; } SYSCFG_TypeDef;
+typedef struct { __IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, OPTCR; } FLASH_TypeDef;
+typedef struct { __IO uint32_t CR, CSR; } PWR_TypeDef;
+typedef struct { __IO uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+typedef struct { __IO uint32_t CTRL, CYCCNT, CPICNT, EXCCNT, SLEEPCNT, LSUCNT, FOLDCNT, PCSR; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+typedef struct {
+	__IO union { uint8_t u8; uint16_t u16; uint32_t u32; } PORT[32];
+	__IO uint32_t TER, TPR, TCR;
+} ITM_Type;
+typedef struct { __IO uint32_t CPUID, ICSR, VTOR, AIRCR, SCR, CCR; } SCB_Type;
+
+// Every peripheral lives in one page-aligned block, so the simulator in
+// sim/ can protect it and trap each register access
+typedef struct {
+	GPIO_TypeDef gpioa, gpiob, gpioc;
+	RCC_TypeDef rcc;
+	TIM_TypeDef tim2, tim3, tim4, tim6, tim8;
+	ADC_TypeDef adc1;
+	ADC_Common_TypeDef adc123_common;
+	DMA_TypeDef dma1, dma2;
+	DMA_Stream_TypeDef dma1_stream[8], dma2_stream[8];
+	EXTI_TypeDef exti;
+	SYSCFG_TypeDef syscfg;
+	FLASH_TypeDef flash;
+	PWR_TypeDef pwr;
+	USART_TypeDef usart3;
+	SysTick_Type systick;
+	DWT_Type dwt;
+	CoreDebug_Type coredebug;
+	ITM_Type itm;
+	SCB_Type scb;
+} __attribute__((aligned(4096))) host_periph_t;
+
+extern host_periph_t host_periph;
+
+#define GPIOA          (&host_periph.gpioa)
+#define GPIOB          (&host_periph.gpiob)
+#define GPIOC          (&host_periph.gpioc)
+#define RCC            (&host_periph.rcc)
+#define TIM2           (&host_periph.tim2)
+#define TIM3           (&host_periph.tim3)
+#define TIM4           (&host_periph.tim4)
+#define TIM6           (&host_periph.tim6)
+#define TIM8           (&host_periph.tim8)
+#define ADC1           (&host_periph.adc1)
+#define ADC123_COMMON  (&host_periph.adc123_common)
+#define DMA1           (&host_periph.dma1)
+#define DMA2           (&host_periph.dma2)
+#define DMA1_Stream0   (&host_periph.dma1_stream[0])
+#define DMA1_Stream1   (&host_periph.dma1_stream[1])
+#define DMA1_Stream3   (&host_periph.dma1_stream[3])
+#define DMA1_Stream6   (&host_periph.dma1_stream[6])
+#define DMA2_Stream0   (&host_periph.dma2_stream[0])
+#define DMA2_Stream1   (&host_periph.dma2_stream[1])
+#define EXTI           (&host_periph.exti)
+#define SYSCFG         (&host_periph.syscfg)
+#define FLASH          (&host_periph.flash)
+#define PWR            (&host_periph.pwr)
+#define USART3         (&host_periph.usart3)
+#define SysTick        (&host_periph.systick)
+#define DWT            (&host_periph.dwt)
+#define CoreDebug      (&host_periph.coredebug)
+#define ITM            (&host_periph.itm)
+#define SCB            (&host_periph.scb)
+
+typedef enum {
+	WWDG_IRQn = 0, EXTI4_IRQn = 10, DMA1_Stream1_IRQn = 12, DMA1_Stream3_IRQn = 14,
+	DMA1_Stream6_IRQn = 17, EXTI9_5_IRQn = 23, TIM2_IRQn = 28, TIM3_IRQn = 29, TIM4_IRQn = 30,
+	USART3_IRQn = 39, EXTI15_10_IRQn = 40, TIM6_DAC_IRQn = 54, DMA2_Stream0_IRQn = 56,
+	DMA2_Stream1_IRQn = 57, SysTick_IRQn = -1
+} IRQn_Type;
+
+#define __NVIC_PRIO_BITS 4
+
+extern uint32_t SystemCoreClock;
+void SystemCoreClockUpdate(void);
+
+// Core intrinsics; PRIMASK and NVIC state are kept so tests can inspect them
+extern uint32_t host_primask;
+extern uint32_t host_nvic_enabled[4];
+extern uint8_t host_nvic_prio[96];
+
+// No-ops in host/periph.c; the simulator takes interrupts here
+void host_wfi(void);
+void host_irq_unmasked(void);
+
+static inline uint32_t __get_PRIMASK(void) { return host_primask; }
+static inline void __set_PRIMASK(uint32_t v) { host_primask = v; if (!v) host_irq_unmasked(); }
+static inline void __disable_irq(void) { host_primask = 1; }
+static inline void __enable_irq(void) { host_primask = 0; host_irq_unmasked(); }
+static inline void __NOP(void) {}
+static inline void __WFI(void) { host_wfi(); }
+static inline void __DSB(void) {}
+static inline void __ISB(void) {}
+static inline void __DMB(void) {}
+
+static inline void NVIC_EnableIRQ(IRQn_Type n) { if (n >= 0) host_nvic_enabled[n >> 5] |= 1U << (n & 31); }
+static inline void NVIC_DisableIRQ(IRQn_Type n) { if (n >= 0) host_nvic_enabled[n >> 5] &= ~(1U << (n & 31)); }
+static inline void NVIC_SetPriority(IRQn_Type n, uint32_t p) { if (n >= 0) host_nvic_prio[n] = p; }
+
+static inline uint32_t SysTick_Config(uint32_t ticks) {
+	SysTick->LOAD = ticks - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = 7;
+	return 0;
+}
+
+#define RCC_CR_HSION               (1U << 0)
+#define RCC_CR_HSIRDY              (1U << 1)
+#define RCC_CR_HSEON               (1U << 16)
+#define RCC_CR_HSERDY              (1U << 17)
+#define RCC_CR_PLLON               (1U << 24)
+#define RCC_CR_PLLRDY              (1U << 25)
+#define RCC_PLLCFGR_PLLSRC_HSE     (1U << 22)
+#define RCC_AHB1ENR_GPIOAEN        (1U << 0)
+#define RCC_AHB1ENR_GPIOBEN        (1U << 1)
+#define RCC_AHB1ENR_GPIOCEN        (1U << 2)
+#define RCC_AHB1ENR_DMA1EN         (1U << 21)
+#define RCC_AHB1ENR_DMA2EN         (1U << 22)
+#define RCC_APB1ENR_TIM2EN         (1U << 0)
+#define RCC_APB1ENR_TIM3EN         (1U << 1)
+#define RCC_APB1ENR_TIM4EN         (1U << 2)
+#define RCC_APB1ENR_TIM6EN         (1U << 4)
+#define RCC_APB1ENR_USART3EN       (1U << 18)
+#define RCC_APB1ENR_PWREN          (1U << 28)
+#define RCC_APB2ENR_TIM8EN         (1U << 1)
+#define RCC_APB2ENR_ADC1EN         (1U << 8)
+#define RCC_APB2ENR_SYSCFGEN       (1U << 14)
+
+#define FLASH_ACR_LATENCY          (7U << 0)
+#define FLASH_ACR_PRFTEN           (1U << 8)
+#define FLASH_ACR_ICEN             (1U << 9)
+#define FLASH_ACR_DCEN             (1U << 10)
+#define FLASH_ACR_ICRST            (1U << 11)
+#define FLASH_ACR_DCRST            (1U << 12)
+#define PWR_CR_VOS                 (1U << 14)
+
+#define TIM_CR1_CEN                (1U << 0)
+#define TIM_CR1_URS                (1U << 2)
+#define TIM_CR1_OPM                (1U << 3)
+#define TIM_CR1_ARPE               (1U << 7)
+#define TIM_DIER_UIE               (1U << 0)
+#define TIM_DIER_CC1IE             (1U << 1)
+#define TIM_DIER_UDE               (1U << 8)
+#define TIM_SR_UIF                 (1U << 0)
+#define TIM_SR_CC1IF               (1U << 1)
+#define TIM_EGR_UG                 (1U << 0)
+#define TIM_CCMR1_OC1PE            (1U << 3)
+#define TIM_CCMR2_OC4PE            (1U << 11)
+#define TIM_CCMR1_OC2PE            (1U << 11)
+#define TIM_CCER_CC1E              (1U << 0)
+#define TIM_CCER_CC4E              (1U << 12)
+#define TIM_CCER_CC2E              (1U << 4)
+
+#define ADC_SR_EOC                 (1U << 1)
+#define ADC_CR2_ADON               (1U << 0)
+#define ADC_CR2_SWSTART            (1U << 30)
+#define EXTI_PR_PR4                (1U << 4)
+
+#define USART_SR_ORE               (1U << 3)
+#define USART_SR_IDLE              (1U << 4)
+#define USART_SR_TC                (1U << 6)
+#define USART_SR_TXE               (1U << 7)
+#define USART_CR1_RE               (1U << 2)
+#define USART_CR1_TE               (1U << 3)
+#define USART_CR1_IDLEIE           (1U << 4)
+#define USART_CR1_UE               (1U << 13)
+#define USART_CR3_DMAR             (1U << 6)
+#define USART_CR3_DMAT             (1U << 7)
+
+#define SysTick_CTRL_ENABLE_Msk    (1U << 0)
+#define SysTick_CTRL_TICKINT_Msk   (1U << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk (1U << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk (1U << 16)
+#define SCB_ICSR_PENDSTCLR_Msk     (1U << 25)
+#define SCB_ICSR_PENDSTSET_Msk     (1U << 26)
+#define SCB_SCR_SLEEPDEEP_Msk      (1U << 2)
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+#define ITM_TCR_ITMENA_Msk         (1U << 0)
+#define DWT_CTRL_CYCCNTENA_Msk     (1U << 0)
+
+#endif
@@ -1,22 +1,20 @@
 #include "stm32f4xx.h"
 #include "lcd.h"
+#include "swtimer.h"
+#include "keyscan.h"
+#include "tm1637.h"
+#include "app.h"
+#include "board.h"
+#include "telemetry.h"
+#include "fmt.h"
 #include <string.h>
-#include <stdlib.h>
 
-#define GREEN_LED_PIN 6   // PC6 - Access Granted LED
-#define RED_LED_PIN   13  // PB13 - Access Denied LED
-
-// 7-segment display on PC0 (CLK) and PC1 (DIO)
-#define SEG_CLK_PIN 0
-#define SEG_DIO_PIN 1
-#define SEG_PORT GPIOC
-
-char entered_key[6] = "";
-volatile uint32_t system_ticks = 0;
-volatile uint32_t last_random_time = 0;
-volatile int current_random_number = 0;
-volatile int expected_security_code = 0;
-volatile uint8_t access_granted = 0;
+// Only touched from access_task(); ISR data arrives through keyscan's ring
+// and the swtimer flags below
+static char entered_key[6] = "";
+static int current_random_number = 0;
+static int expected_security_code = 0;
+static uint8_t access_granted = 0;
 
 const char keymap[4][4] = {
     {'1','2','3','A'},
@@ -25,32 +23,15 @@ const char keymap[4][4] = {
     {'*','0','#','D'}
 };
 
-const uint8_t seven_seg_patterns[10] = {
-    0x3F, 0x06, 0x5B, 0x4F, 0x66,
-    0x6D, 0x7D, 0x07, 0x7F, 0x6F
-};
-
-#define TM1637_CMD1 0x40
-#define TM1637_CMD2 0xC0
-#define TM1637_CMD3 0x88
-
-// Optimized delay function - much faster
-void delayUs(uint32_t us) {
-    for(uint32_t i = 0; i < us * 16; i++) __NOP();
-}
-
-void delayMs(uint32_t ms) {
-    for(uint32_t i = 0; i < ms; i++) {
-        delayUs(1000);
-    }
-}
-
+// Last four digits back to front, from their characters rather than /10s
 int reverse_number(int number) {
-    int digit1 = (number / 1000) % 10;
-    int digit2 = (number / 100) % 10;
-    int digit3 = (number / 10) % 10;
-    int digit4 = number % 10;
-    return digit4 * 1000 + digit3 * 100 + digit2 * 10 + digit1;
+    char d[FMT_MAX];
+    uint32_t n = fmt_u32(d, number, 4, FMT_ZERO);
+    int r = 0;
+
+    for (int i = n - 1; i >= (int)n - 4; i--)
+        r = r * 10 + (d[i] - '0');
+    return r;
 }
 
 int generate_random(void) {
@@ -59,251 +40,166 @@ int generate_random(void) {
     return (seed % 9000) + 1000;
 }
 
-// TM1637 functions with proper timing for reliability
-void tm1637_start(void) {
-    SEG_PORT->ODR |= (1 << SEG_CLK_PIN) | (1 << SEG_DIO_PIN);
-    delayUs(50);
-    SEG_PORT->ODR &= ~(1 << SEG_DIO_PIN);
-    delayUs(50);
-    SEG_PORT->ODR &= ~(1 << SEG_CLK_PIN);
-    delayUs(50);
-}
-
-void tm1637_stop(void) {
-    SEG_PORT->ODR &= ~(1 << SEG_CLK_PIN);
-    SEG_PORT->ODR &= ~(1 << SEG_DIO_PIN);
-    delayUs(50);
-    SEG_PORT->ODR |= (1 << SEG_CLK_PIN);
-    delayUs(50);
-    SEG_PORT->ODR |= (1 << SEG_DIO_PIN);
-    delayUs(50);
-}
-
-void tm1637_write_byte(uint8_t data) {
-    for (int i = 0; i < 8; i++) {
-        SEG_PORT->ODR &= ~(1 << SEG_CLK_PIN);
-        delayUs(30);
-        if (data & 0x01)
-            SEG_PORT->ODR |= (1 << SEG_DIO_PIN);
-        else
-            SEG_PORT->ODR &= ~(1 << SEG_DIO_PIN);
-        delayUs(30);
-        SEG_PORT->ODR |= (1 << SEG_CLK_PIN);
-        delayUs(30);
-        data >>= 1;
-    }
-
-    // ACK bit handling
-    SEG_PORT->ODR &= ~(1 << SEG_CLK_PIN);
-    SEG_PORT->ODR |= (1 << SEG_DIO_PIN);
-    delayUs(30);
-    SEG_PORT->ODR |= (1 << SEG_CLK_PIN);
-    delayUs(30);
-    SEG_PORT->ODR &= ~(1 << SEG_CLK_PIN);
-    delayUs(30);
-}
-
+// 7-segment display on SEG_CLK and SEG_DIO, sent by DMA in tm1637.c.
+// Negative numbers blank the display.
 void display_7_segment_4_digit(int number) {
-    if (number < 0) {
-        tm1637_start();
-        tm1637_write_byte(TM1637_CMD1);
-        tm1637_stop();
-        delayUs(100);
-
-        tm1637_start();
-        tm1637_write_byte(TM1637_CMD2);
-        tm1637_write_byte(0x00);
-        tm1637_write_byte(0x00);
-        tm1637_write_byte(0x00);
-        tm1637_write_byte(0x00);
-        tm1637_stop();
-        delayUs(100);
-
-        tm1637_start();
-        tm1637_write_byte(TM1637_CMD3);
-        tm1637_stop();
-        delayUs(100);
-        return;
-    }
-
-    int digit1 = (number / 1000) % 10;
-    int digit2 = (number / 100) % 10;
-    int digit3 = (number / 10) % 10;
-    int digit4 = number % 10;
-
-    // Set data command
-    tm1637_start();
-    tm1637_write_byte(TM1637_CMD1);
-    tm1637_stop();
-    delayUs(100);
-
-    // Set address and send data
-    tm1637_start();
-    tm1637_write_byte(TM1637_CMD2);
-    tm1637_write_byte(seven_seg_patterns[digit1]);
-    tm1637_write_byte(seven_seg_patterns[digit2]);
-    tm1637_write_byte(seven_seg_patterns[digit3]);
-    tm1637_write_byte(seven_seg_patterns[digit4]);
-    tm1637_stop();
-    delayUs(100);
-
-    // Set display control (brightness)
-    tm1637_start();
-    tm1637_write_byte(TM1637_CMD3);
-    tm1637_stop();
-    delayUs(100);
+    if (number < 0)
+        tm1637_blank();
+    else
+        tm1637_show_number(number, 1);
 }
 
+// Pins are set up by board_init(), LEDs start off
 void gpio_init(void) {
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN | RCC_AHB1ENR_GPIOAEN;
-
-    for (int pin = 2; pin <= 5; pin++) {
-        GPIOB->MODER &= ~(3 << (pin * 2));
-        GPIOB->MODER |= (1 << (pin * 2));
-        GPIOB->ODR |= (1 << pin);
-    }
-
-    for (int pin = 9; pin <= 12; pin++) {
-        GPIOA->MODER &= ~(3 << (pin * 2));
-        GPIOA->PUPDR &= ~(3 << (pin * 2));
-        GPIOA->PUPDR |= (1 << (pin * 2));
-    }
-
-    GPIOC->MODER &= ~(3 << (GREEN_LED_PIN * 2));
-    GPIOC->MODER |= (1 << (GREEN_LED_PIN * 2));
-
-    GPIOB->MODER &= ~(3 << (RED_LED_PIN * 2));
-    GPIOB->MODER |= (1 << (RED_LED_PIN * 2));
-
-    SEG_PORT->MODER &= ~(3 << (SEG_CLK_PIN * 2));
-    SEG_PORT->MODER |= (1 << (SEG_CLK_PIN * 2));
-    SEG_PORT->MODER &= ~(3 << (SEG_DIO_PIN * 2));
-    SEG_PORT->MODER |= (1 << (SEG_DIO_PIN * 2));
-
-    SEG_PORT->ODR |= (1 << SEG_CLK_PIN);
-    SEG_PORT->ODR |= (1 << SEG_DIO_PIN);
-
-    GPIOC->ODR &= ~(1 << GREEN_LED_PIN);
-    GPIOB->ODR &= ~(1 << RED_LED_PIN);
-}
-
-void systick_init(void) {
-    SysTick_Config(SystemCoreClock / 1000);
-}
-
-void SysTick_Handler(void) {
-    system_ticks++;
+    tm1637_init();
 }
 
 void generate_new_random_number(void) {
     current_random_number = generate_random();
     expected_security_code = reverse_number(current_random_number);
     display_7_segment_4_digit(current_random_number);
-    last_random_time = system_ticks;
 }
 
-// Fast keypad scanning with minimal debounce
+// Next key press from the interrupt-driven matrix scanner, 0 if none
 char scan_keypad(void) {
-    for (int row = 0; row < 4; row++) {
-        GPIOB->ODR |= (0xF << 2);
-        GPIOB->ODR &= ~(1 << (row + 2));
-        delayUs(50); // Minimal setup time
+    key_event_t ev;
 
-        for (int col = 0; col < 4; col++) {
-            if (!(GPIOA->IDR & (1 << (9 + col)))) {
-                while (!(GPIOA->IDR & (1 << (9 + col))));
-                delayMs(5); // Very quick debounce for faster response
-                return keymap[row][col];
-            }
+    while (keyscan_get(&ev)) {
+        if (ev.type == KEY_PRESS) {
+            char key = keymap[ev.code >> 2][ev.code & 3];
+
+            // Digits make up the access code, only their occurrence is sent
+            telem_set(TM_KEY, (key >= '0' && key <= '9') ? 'n' : key);
+            return key;
         }
     }
     return 0;
 }
 
-int main(void) {
+enum { AC_IDLE, AC_ENTRY, AC_GRANTED, AC_READY, AC_DENIED };
+
+static uint8_t ac_state = AC_IDLE;
+static int rotate_timer, state_timer;
+static volatile uint8_t rotate_due, state_due;
+static int key_index;
+
+static void start_code_entry(void) {
+    lcd_print(0x80, "Security Code:  ");
+    lcd_print(0xC0, "                ");
+    generate_new_random_number();
+    memset(entered_key, 0, sizeof(entered_key));
+    key_index = 0;
+    rotate_due = 0;
+    swtimer_start(rotate_timer, 20000, 20000);  // new code every 20 s
+    ac_state = AC_ENTRY;
+}
+
+static void back_to_welcome(void) {
+    lcd_print(0x80, "Welcome         ");
+    lcd_print(0xC0, "                ");
+    ac_state = AC_IDLE;
+}
+
+static void set_flag(void *flag) {
+    *(volatile uint8_t *)flag = 1;
+}
+
+static void enter_state(uint8_t state, uint32_t timeout_ms) {
+    ac_state = state;
+    state_due = 0;
+    swtimer_start(state_timer, timeout_ms, 0);
+}
+
+void access_init(void) {
     gpio_init();
-    systick_init();
-    LcdInit();
+    keyscan_init();
+    rotate_timer = swtimer_create(set_flag, (void *)&rotate_due);
+    state_timer = swtimer_create(set_flag, (void *)&state_due);
 
-    lcd_print(0x80, "Welcome");
+    lcd_print(0x80, "Welcome         ");
+    lcd_fb_flush();
     display_7_segment_4_digit(-1);
+}
 
-    while (1) {
-        char key = scan_keypad();
+uint8_t access_busy(void) {
+    return ac_state != AC_IDLE;
+}
 
-        if (key == '*' && !access_granted) {
-            lcd_print(0x80, "Security Code:");
-            generate_new_random_number();
-            memset(entered_key, 0, sizeof(entered_key));
-            int index = 0;
+// Runs every 10 ms, one keypad scan per pass
+void access_task(void) {
+    char key = scan_keypad();
 
-            while (1) {
-                if (!access_granted && (system_ticks - last_random_time) >= 20000) {
-                    generate_new_random_number();
-                }
+    switch (ac_state) {
+    case AC_IDLE:
+        if (key == '*')
+            start_code_entry();
+        break;
 
-                key = scan_keypad();
-                if (key) {
-                    if (key == '#') {
-                        entered_key[index] = '\0';
-                        int entered_code = atoi(entered_key);
+    case AC_ENTRY:
+        if (rotate_due) {
+            rotate_due = 0;
+            generate_new_random_number();
+        }
 
-                        if (entered_code == expected_security_code) {
-                            lcd_print(0x80, "Access Granted");
-                            lcd_print(0xC0, "Welcome!");
-                            GPIOC->ODR |= (1 << GREEN_LED_PIN);
-                            GPIOB->ODR &= ~(1 << RED_LED_PIN);
-                            display_7_segment_4_digit(-1);
-                            access_granted = 1;
-                            delayMs(2000); // Reduced from 3000ms to 2000ms
-                            lcd_print(0x80, "System Ready");
-                            lcd_print(0xC0, "Press * to lock");
-                        } else {
-                            lcd_print(0x80, "Access Denied");
-                            lcd_print(0xC0, "Press * to retry");
-                            GPIOB->ODR |= (1 << RED_LED_PIN);
-                            GPIOC->ODR &= ~(1 << GREEN_LED_PIN);
-                            display_7_segment_4_digit(-1);
+        if (key == '#') {
+            entered_key[key_index] = '\0';
+            int entered_code = 0;
+            for (int i = 0; i < key_index; i++)
+                entered_code = entered_code * 10 + (entered_key[i] - '0');
+
+            if (entered_code == expected_security_code) {
+                lcd_print(0x80, "Access Granted  ");
+                lcd_print(0xC0, "Welcome!        ");
+                PIN_SET(LED_GREEN);
+                PIN_CLR(LED_RED);
+                display_7_segment_4_digit(-1);
+                access_granted = 1;
+                enter_state(AC_GRANTED, 2000);
+            } else {
+                lcd_print(0x80, "Access Denied   ");
+                lcd_print(0xC0, "Press * to retry");
+                PIN_SET(LED_RED);
+                PIN_CLR(LED_GREEN);
+                display_7_segment_4_digit(-1);
+                enter_state(AC_DENIED, 10000);
+            }
+            swtimer_stop(rotate_timer);
+        } else if (key_index < 5 && key >= '0' && key <= '9') {
+            entered_key[key_index++] = key;
+            char display[17] = "Code:           ";
+            for (int i = 0; i < key_index; i++)
+                display[6 + i] = '*';
+            lcd_print(0xC0, display);
+        }
+        break;
 
-                            uint32_t denied_start_time = system_ticks;
-                            while ((system_ticks - denied_start_time) < 10000) {
-                                char retry_key = scan_keypad();
-                                if (retry_key == '*') {
-                                    lcd_print(0x80, "                ");
-                                    lcd_print(0xC0, "                ");
-                                    delayMs(50); // Reduced from 100ms to 50ms
-                                    lcd_print(0x80, "Security Code:");
-                                    lcd_print(0xC0, "                ");
-                                    generate_new_random_number();
-                                    memset(entered_key, 0, sizeof(entered_key));
-                                    index = 0;
-                                    GPIOB->ODR &= ~(1 << RED_LED_PIN);
-                                    goto continue_security_entry;
-                                }
-                            }
-                            lcd_print(0x80, "Welcome");
-                            lcd_print(0xC0, "                ");
-                            GPIOB->ODR &= ~(1 << RED_LED_PIN);
-                        }
-                        break;
+    case AC_GRANTED:
+        if (state_due) {
+            lcd_print(0x80, "System Ready    ");
+            lcd_print(0xC0, "Press * to lock ");
+            ac_state = AC_READY;
+        }
+        break;
 
-                        continue_security_entry:;
-                    } else if (index < 5 && key != '*' && key >= '0' && key <= '9') {
-                        entered_key[index++] = key;
-                        char display[17] = "Code: ";
-                        for (int i = 0; i < index; i++)
-                            display[6 + i] = '*';
-                        display[6 + index] = '\0';
-                        lcd_print(0xC0, display);
-                    }
-                }
-            }
-        } else if (key == '*' && access_granted) {
+    case AC_READY:
+        if (key == '*') {
             access_granted = 0;
-            GPIOC->ODR &= ~(1 << GREEN_LED_PIN);
-            GPIOB->ODR &= ~(1 << RED_LED_PIN);
-            lcd_print(0x80, "Welcome");
-            lcd_print(0xC0, "                ");
+            PIN_CLR(LED_GREEN);
+            PIN_CLR(LED_RED);
+            back_to_welcome();
+        }
+        break;
+
+    case AC_DENIED:
+        if (key == '*') {
+            PIN_CLR(LED_RED);
+            start_code_entry();
+        } else if (state_due) {
+            PIN_CLR(LED_RED);
+            back_to_welcome();
         }
+        break;
     }
+
+    lcd_fb_flush();
 }
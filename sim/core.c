@@ -0,0 +1,582 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "simint.h"
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "the simulator traps register accesses with x86-64 Linux signals"
+#endif
+
+#define TRAP_FLAG  0x100       // EFLAGS.TF: SIGTRAP after one instruction
+#define PF_WRITE   0x2         // page fault error code: write access
+#define PROF_SLOTS 4096        // power of two
+#define PROF_DEPTH 256
+
+uint64_t sim_now;
+FILE *sim_logf;
+
+static uint64_t sim_end = SIM_NEVER;
+static uint64_t next_due;      // earliest hardware, device or scenario event
+static uint64_t idle_cycles;   // spent in WFI
+static int unlocked = 1;       // sim_unlock() nesting, the block starts writable
+static uint8_t in_isr;
+
+// The access being single-stepped
+static volatile uint32_t *trap_reg;
+static uint8_t trap_write;
+static uint32_t trap_old;
+static uint64_t traps;
+
+static void (*exit_fn)(void);
+
+// Instruction counting: the trap flag stays set between sim_count_begin()
+// and sim_count_end(), the hooks run unstepped through sim_tf_resume
+static uint8_t counting;
+static sim_count_t count;
+static uint64_t count_start;
+uint64_t sim_resume_rip;
+
+void sim_tf_resume(void);
+__asm__(".text\n"
+        ".globl sim_tf_resume\n"
+        "sim_tf_resume:\n"
+        "\tpushq sim_resume_rip(%rip)\n"
+        "\tpushfq\n"
+        "\torq $0x100, (%rsp)\n"
+        "\tpopfq\n"
+        "\tret\n");
+
+// Interrupts: the vector slots the firmware can have handlers for
+typedef struct {
+	uint8_t n;
+	void (*fn)(void);
+	const char *name;
+} vector_t;
+
+#define VECTORS(X) \
+	X(10, EXTI4_IRQHandler) X(12, DMA1_Stream1_IRQHandler) X(14, DMA1_Stream3_IRQHandler) \
+	X(17, DMA1_Stream6_IRQHandler) X(18, ADC_IRQHandler) X(23, EXTI9_5_IRQHandler) \
+	X(28, TIM2_IRQHandler) X(29, TIM3_IRQHandler) X(30, TIM4_IRQHandler) \
+	X(39, USART3_IRQHandler) X(40, EXTI15_10_IRQHandler) X(44, TIM8_UP_TIM13_IRQHandler) \
+	X(54, TIM6_DAC_IRQHandler) X(56, DMA2_Stream0_IRQHandler) X(57, DMA2_Stream1_IRQHandler) \
+	X(IRQ_SYSTICK, SysTick_Handler)
+
+#define VEC_DECL(n, name) extern void name(void) __attribute__((weak));
+#define VEC_ENTRY(n, name) { n, name, #name },
+VECTORS(VEC_DECL)
+static vector_t vectors[] = { VECTORS(VEC_ENTRY) };
+#define NVECTORS (sizeof(vectors) / sizeof(vectors[0]))
+
+static uint32_t pending;       // bit per vectors[] entry, asserted and enabled
+
+// Profile: per function calls and virtual cycles
+typedef struct {
+	void *fn;
+	const char *name;          // vectors for interrupt entries
+	uint64_t calls, incl, excl;
+} prof_t;
+
+typedef struct {
+	prof_t *p;
+	uint64_t start, child;
+} frame_t;
+
+static prof_t prof[PROF_SLOTS];
+static frame_t stack[PROF_DEPTH];
+static int depth, lost_frames;
+
+// Scenario events, a binary heap on (when, seq)
+typedef struct {
+	uint64_t when, seq;
+	sim_event_fn fn;
+	void *arg;
+} event_t;
+
+static event_t *events;
+static uint32_t nevents, events_cap;
+static uint64_t event_seq;
+
+void sim_fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "sim: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	exit(1);
+}
+
+static void protect(int prot)
+{
+	if (mprotect(&host_periph, sizeof(host_periph), prot))
+		sim_fatal("mprotect failed");
+}
+
+void sim_unlock(void)
+{
+	if (unlocked++ == 0)
+		protect(PROT_READ | PROT_WRITE);
+}
+
+void sim_lock(void)
+{
+	if (--unlocked == 0)
+		protect(PROT_NONE);
+}
+
+static int ev_less(const event_t *a, const event_t *b)
+{
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+void sim_at(uint64_t when, sim_event_fn fn, void *arg)
+{
+	uint32_t i;
+
+	if (nevents == events_cap) {
+		events_cap = events_cap ? events_cap * 2 : 64;
+		events = realloc(events, events_cap * sizeof(*events));
+		if (!events)
+			sim_fatal("out of memory");
+	}
+	i = nevents++;
+	events[i] = (event_t){ when, event_seq++, fn, arg };
+	while (i && ev_less(&events[i], &events[(i - 1) / 2])) {
+		event_t t = events[i];
+
+		events[i] = events[(i - 1) / 2];
+		events[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+	if (when < next_due)
+		next_due = when;
+}
+
+static void ev_pop(void)
+{
+	uint32_t i = 0;
+
+	events[0] = events[--nevents];
+	for (;;) {
+		uint32_t l = 2 * i + 1, r = l + 1, m = i;
+		event_t t;
+
+		if (l < nevents && ev_less(&events[l], &events[m]))
+			m = l;
+		if (r < nevents && ev_less(&events[r], &events[m]))
+			m = r;
+		if (m == i)
+			break;
+		t = events[i];
+		events[i] = events[m];
+		events[m] = t;
+		i = m;
+	}
+}
+
+static uint64_t next_event(void)
+{
+	uint64_t t = hw_next(), d = dev_next();
+
+	if (d < t)
+		t = d;
+	if (nevents && events[0].when < t)
+		t = events[0].when;
+	return t;
+}
+
+static int vec_enabled(uint8_t n)
+{
+	if (n == IRQ_SYSTICK)
+		return (SysTick->CTRL & SysTick_CTRL_TICKINT_Msk) != 0;
+	return (host_nvic_enabled[n >> 5] >> (n & 31)) & 1;
+}
+
+// Unlocked. Recompute what is due after a model or register change.
+void sim_changed(void)
+{
+	next_due = next_event();
+	pending = 0;
+	for (uint32_t i = 0; i < NVECTORS; i++)
+		if (vectors[i].fn && vec_enabled(vectors[i].n) && hw_irq(vectors[i].n))
+			pending |= 1UL << i;
+}
+
+// Run every event up to sim_now, each at its own time
+static void fire_due(void)
+{
+	uint64_t now = sim_now, t;
+
+	sim_unlock();
+	while ((t = next_event()) <= now) {
+		if (t > sim_now)
+			sim_now = t;
+		hw_fire();
+		dev_fire();
+		while (nevents && events[0].when <= sim_now) {
+			event_t e = events[0];
+
+			ev_pop();
+			e.fn(e.arg);
+		}
+	}
+	if (now > sim_now)
+		sim_now = now;
+	sim_changed();
+	sim_lock();
+}
+
+static prof_t *prof_slot(void *fn, const char *name)
+{
+	uint32_t h = ((uintptr_t)fn >> 4) * 2654435761u;
+
+	for (uint32_t i = 0; i < PROF_SLOTS; i++) {
+		prof_t *p = &prof[(h + i) & (PROF_SLOTS - 1)];
+
+		if (p->fn == fn)
+			return p;
+		if (!p->fn) {
+			p->fn = fn;
+			p->name = name;
+			return p;
+		}
+	}
+	sim_fatal("profile table full");
+	return 0;
+}
+
+static void prof_enter(void *fn, const char *name)
+{
+	prof_t *p = prof_slot(fn, name);
+
+	p->calls++;
+	if (depth == PROF_DEPTH) {
+		lost_frames++;
+		return;
+	}
+	stack[depth++] = (frame_t){ p, sim_now, 0 };
+}
+
+static void prof_exit(void)
+{
+	frame_t *f;
+	uint64_t incl;
+
+	if (lost_frames) {
+		lost_frames--;
+		return;
+	}
+	if (!depth)
+		return;
+	f = &stack[--depth];
+	incl = sim_now - f->start;
+	f->p->incl += incl;
+	f->p->excl += incl - f->child;
+	if (depth)
+		stack[depth - 1].child += incl;
+}
+
+static void sim_finish(void) __attribute__((noreturn));
+
+// Take pending interrupts, highest NVIC priority first. Locked on entry.
+static void dispatch(void)
+{
+	sim_unlock();
+	while (pending && !host_primask && !in_isr) {
+		int best = -1;
+
+		for (uint32_t i = 0; i < NVECTORS; i++) {
+			uint8_t n = vectors[i].n;
+			uint8_t prio = n == IRQ_SYSTICK ? 15 : host_nvic_prio[n];
+
+			if ((pending >> i) & 1 &&
+			    (best < 0 || prio < (vectors[best].n == IRQ_SYSTICK ? 15 : host_nvic_prio[vectors[best].n])))
+				best = i;
+		}
+
+		in_isr = 1;
+		hw_irq_done(vectors[best].n);
+		vcd_value(VCD_IRQ, vectors[best].n);
+		prof_enter(vectors[best].fn, vectors[best].name);
+		sim_now += SIM_IRQ_CYCLES;
+		sim_lock();
+		vectors[best].fn();
+		sim_unlock();
+		prof_exit();
+		vcd_value(VCD_IRQ, 0);
+		in_isr = 0;
+		sim_changed();
+	}
+	sim_lock();
+}
+
+// Instrumented firmware calls these around every function
+__attribute__((no_instrument_function))
+void __cyg_profile_func_enter(void *fn, void *site)
+{
+	(void)site;
+	if (counting)
+		count.calls++;
+	prof_enter(fn, 0);
+	sim_now += SIM_CALL_CYCLES;
+	if (sim_now >= next_due)
+		fire_due();
+	if (sim_now >= sim_end)
+		sim_finish();
+	if (pending && !host_primask && !in_isr)
+		dispatch();
+}
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_exit(void *fn, void *site)
+{
+	(void)fn;
+	(void)site;
+	prof_exit();
+}
+
+void host_irq_unmasked(void)
+{
+	if (pending && !in_isr)
+		dispatch();
+}
+
+// Sleep: jump to the next event until an enabled interrupt is pending.
+// PRIMASK does not matter for waking, as on the core.
+void host_wfi(void)
+{
+	uint64_t start = sim_now;
+
+	while (!pending) {
+		if (next_due >= sim_end) {
+			sim_now = sim_end;
+			idle_cycles += sim_now - start;
+			sim_finish();
+		}
+		sim_now = next_due;
+		fire_due();
+	}
+	// Sleep is nobody's cost: move the open frames past it
+	for (int i = 0; i < depth; i++)
+		stack[i].start += sim_now - start;
+	idle_cycles += sim_now - start;
+}
+
+// Busy-wait: the core is held for the cycles while the hardware and the
+// devices run on; interrupts are taken at the end, as at the next call
+void sim_spin(uint64_t cycles)
+{
+	sim_now += cycles;
+	if (sim_now >= next_due)
+		fire_due();
+	if (sim_now >= sim_end)
+		sim_finish();
+	if (pending && !host_primask && !in_isr)
+		dispatch();
+}
+
+static void on_segv(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	uintptr_t a = (uintptr_t)si->si_addr, base = (uintptr_t)&host_periph;
+
+	if (a < base || a >= base + sizeof(host_periph) || unlocked || trap_reg) {
+		signal(sig, SIG_DFL);  // a real crash
+		return;
+	}
+	traps++;
+	if (counting)
+		count.accesses++;
+	trap_reg = (volatile uint32_t *)(a & ~(uintptr_t)3);
+	trap_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+
+	sim_now += SIM_BUS_CYCLES;
+	if (sim_now >= next_due)
+		fire_due();
+	sim_unlock();
+	hw_read(trap_reg);  // writes too: read-modify-write instructions fault as writes
+	trap_old = *trap_reg;
+	uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+static void on_trap(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+
+	(void)sig;
+	(void)si;
+	if (counting) {
+		greg_t *sp = (greg_t *)uc->uc_mcontext.gregs[REG_RSP];
+		greg_t ip = uc->uc_mcontext.gregs[REG_RIP];
+
+		count.insns++;
+		if (ip == (greg_t)__cyg_profile_func_enter || ip == (greg_t)__cyg_profile_func_exit) {
+			// Let the hook run free, stepping resumes at its return
+			sim_resume_rip = *sp;
+			*sp = (greg_t)sim_tf_resume;
+			uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+		}
+	} else {
+		uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+	}
+	if (!trap_reg)
+		return;
+	if (trap_write)
+		hw_write(trap_reg, trap_old);
+	else
+		hw_read_done(trap_reg);
+	trap_reg = 0;
+	sim_changed();
+	sim_lock();
+}
+
+// The red zone is skipped, pushfq would clobber it in a leaf function
+void sim_count_begin(void)
+{
+	memset(&count, 0, sizeof(count));
+	count_start = sim_now;
+	counting = 1;
+	__asm__ volatile("subq $128, %%rsp\n\tpushfq\n\torq $0x100, (%%rsp)\n\tpopfq\n\taddq $128, %%rsp"
+	                 ::: "memory", "cc");
+}
+
+void sim_count_end(sim_count_t *c)
+{
+	__asm__ volatile("subq $128, %%rsp\n\tpushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq\n\taddq $128, %%rsp"
+	                 ::: "memory", "cc");
+	counting = 0;
+	count.cycles = sim_now - count_start;
+	*c = count;
+}
+
+void sim_init(void)
+{
+	struct sigaction sa;
+
+	if ((uintptr_t)&host_periph >> 32)
+		sim_fatal("peripheral block above 4 GB, link with -no-pie");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &sa, 0);
+	sa.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &sa, 0);
+
+	hw_init();
+	dev_init();
+	sim_changed();
+}
+
+void sim_on_exit(void (*fn)(void))
+{
+	exit_fn = fn;
+}
+
+static void sim_finish(void)
+{
+	sim_unlock();
+	if (exit_fn)
+		exit_fn();
+	vcd_close();
+	exit(0);
+}
+
+void sim_run(int (*fw_main)(void), uint64_t until)
+{
+	sim_end = until;
+	sim_changed();
+	sim_lock();
+	fw_main();
+	sim_finish();
+}
+
+// Function names from the executable's symbol table
+typedef struct {
+	uintptr_t addr;
+	char name[64];
+} sym_t;
+
+static sym_t *syms;
+static uint32_t nsyms;
+
+static void load_syms(void)
+{
+	char line[256], path[64];
+	uint32_t cap = 0;
+	FILE *p;
+
+	snprintf(path, sizeof(path), "nm --defined-only /proc/%d/exe", (int)getpid());
+	if (!(p = popen(path, "r")))
+		return;
+	while (fgets(line, sizeof(line), p)) {
+		unsigned long addr;
+		char type, name[200];
+
+		if (sscanf(line, "%lx %c %199s", &addr, &type, name) != 3 || (type != 't' && type != 'T'))
+			continue;
+		if (nsyms == cap) {
+			cap = cap ? cap * 2 : 512;
+			syms = realloc(syms, cap * sizeof(*syms));
+		}
+		syms[nsyms].addr = addr;
+		snprintf(syms[nsyms].name, sizeof(syms[nsyms].name), "%.63s", name);
+		nsyms++;
+	}
+	pclose(p);
+}
+
+static const char *sym_name(prof_t *p)
+{
+	static char buf[32];
+
+	if (p->name)
+		return p->name;
+	for (uint32_t i = 0; i < nsyms; i++)
+		if (syms[i].addr == (uintptr_t)p->fn)
+			return syms[i].name;
+	snprintf(buf, sizeof(buf), "%p", p->fn);
+	return buf;
+}
+
+static int by_excl(const void *a, const void *b)
+{
+	const prof_t *x = *(prof_t * const *)a, *y = *(prof_t * const *)b;
+
+	return x->excl < y->excl ? 1 : x->excl > y->excl ? -1 : 0;
+}
+
+void sim_profile_write(FILE *f)
+{
+	prof_t *list[PROF_SLOTS];
+	uint32_t n = 0;
+	uint64_t busy = sim_now - idle_cycles;
+
+	if (!nsyms)
+		load_syms();
+	for (uint32_t i = 0; i < PROF_SLOTS; i++)
+		if (prof[i].fn)
+			list[n++] = &prof[i];
+	qsort(list, n, sizeof(list[0]), by_excl);
+
+	fprintf(f, "virtual time %.6f s, %llu cycles, busy %llu cycles (%.3f%%), %llu register traps\n",
+	        (double)sim_now / SIM_HZ, (unsigned long long)sim_now, (unsigned long long)busy,
+	        sim_now ? 100.0 * busy / sim_now : 0.0, (unsigned long long)traps);
+	fprintf(f, "%10s %14s %14s %7s %10s  %s\n", "calls", "incl_cycles", "excl_cycles", "excl%", "excl/call", "function");
+	for (uint32_t i = 0; i < n; i++) {
+		prof_t *p = list[i];
+
+		fprintf(f, "%10llu %14llu %14llu %6.2f%% %10llu  %s\n",
+		        (unsigned long long)p->calls, (unsigned long long)p->incl, (unsigned long long)p->excl,
+		        busy ? 100.0 * p->excl / busy : 0.0,
+		        (unsigned long long)(p->calls ? p->excl / p->calls : 0), sym_name(p));
+	}
+}
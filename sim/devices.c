@@ -0,0 +1,355 @@
+#include <string.h>
+#include "simint.h"
+#include "board.h"
+
+// Devices on the board pins: HD44780 in 8-bit mode, DHT11, the LDR divider
+// on the ADC, TM1637 and the 4x4 keypad
+
+#define LEVEL(name) ((hw_levels(name##_P) >> name##_N) & 1)
+
+static double secs(void)
+{
+	return (double)sim_now / SIM_HZ;
+}
+
+void sim_log(FILE *f)
+{
+	sim_logf = f;
+}
+
+// HD44780: latches on the falling edge of EN
+
+static struct {
+	char ddram[0x68];
+	uint8_t addr, inc, on;
+	uint64_t busy_until, log_at;
+	uint64_t setup_at;          // last RS or data change
+	uint32_t writes;            // commands and data latched
+	uint32_t violations;
+	uint32_t setup_violations;  // EN rose within tAS of RS or data
+	char line[2][17];
+	char logged[2][17];
+} lcd = { .inc = 1, .log_at = SIM_NEVER };
+
+static uint8_t lcd_data(void)
+{
+	return LEVEL(LCD_D0) | LEVEL(LCD_D1) << 1 | LEVEL(LCD_D2) << 2 | LEVEL(LCD_D3) << 3 |
+	       LEVEL(LCD_D4) << 4 | LEVEL(LCD_D5) << 5 | LEVEL(LCD_D6) << 6 | LEVEL(LCD_D7) << 7;
+}
+
+static void lcd_render(void)
+{
+	for (int r = 0; r < 2; r++) {
+		for (int i = 0; i < 16; i++) {
+			char c = lcd.ddram[r * 0x40 + i];
+
+			lcd.line[r][i] = lcd.on && c >= 0x20 && c < 0x7F ? c : ' ';
+		}
+		lcd.line[r][16] = 0;
+	}
+}
+
+static void lcd_latch(void)
+{
+	uint8_t v = lcd_data();
+
+	lcd.writes++;
+	// 40 ms power-on wait, then 37 us per command, 1.52 ms for clear/home
+	if (sim_now < lcd.busy_until || sim_now < SIM_MS(40))
+		lcd.violations++;
+	lcd.busy_until = sim_now + SIM_US(37);
+
+	if (LEVEL(LCD_RS)) {
+		if (lcd.addr < sizeof(lcd.ddram))
+			lcd.ddram[lcd.addr] = v;
+		lcd.addr += lcd.inc ? 1 : -1;
+		if (lcd.addr == 0x28)
+			lcd.addr = 0x40;
+		else if (lcd.addr >= 0x68)
+			lcd.addr = 0;
+		lcd.busy_until = sim_now + SIM_US(41);
+	} else if (v & 0x80) {
+		lcd.addr = v & 0x7F;
+	} else if (v & 0x20) {
+		// function set, 8-bit two-line assumed
+	} else if (v & 0x08) {
+		lcd.on = (v >> 2) & 1;
+	} else if (v & 0x04) {
+		lcd.inc = (v >> 1) & 1;
+	} else if (v & 0x02) {
+		lcd.addr = 0;
+		lcd.busy_until = sim_now + SIM_US(1520);
+	} else if (v & 0x01) {
+		memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+		lcd.addr = 0;
+		lcd.inc = 1;
+		lcd.busy_until = sim_now + SIM_US(1520);
+	}
+	lcd_render();
+	lcd.log_at = sim_now + SIM_MS(1);        // log once the screen settles
+}
+
+const char *sim_lcd_line(int row)
+{
+	return lcd.line[row & 1];
+}
+
+uint32_t sim_lcd_writes(void)
+{
+	return lcd.writes;
+}
+
+uint32_t sim_lcd_violations(void)
+{
+	return lcd.violations;
+}
+
+uint32_t sim_lcd_setup_violations(void)
+{
+	return lcd.setup_violations;
+}
+
+#define LCD_TAS_CYCLES 7  // 40 ns at SIM_HZ, rounded up
+#define LCD_ON(name, port) (name##_P == (port) ? PIN_BIT(name) : 0)
+
+static void lcd_pins(uint8_t port, uint16_t old, uint16_t now)
+{
+	uint16_t bus = LCD_ON(LCD_RS, port) | LCD_ON(LCD_D0, port) | LCD_ON(LCD_D1, port) |
+	               LCD_ON(LCD_D2, port) | LCD_ON(LCD_D3, port) | LCD_ON(LCD_D4, port) |
+	               LCD_ON(LCD_D5, port) | LCD_ON(LCD_D6, port) | LCD_ON(LCD_D7, port);
+
+	if ((old ^ now) & bus)
+		lcd.setup_at = sim_now;
+	if (port == LCD_EN_P && (now >> LCD_EN_N & 1) && !(old >> LCD_EN_N & 1) &&
+	    sim_now - lcd.setup_at < LCD_TAS_CYCLES)
+		lcd.setup_violations++;
+	if (port == LCD_EN_P && (old >> LCD_EN_N & 1) && !(now >> LCD_EN_N & 1))
+		lcd_latch();
+}
+
+// DHT11: answers a start pulse of at least 18 ms with its 40-bit frame
+
+#define DHT_EDGES 90
+
+static struct {
+	uint8_t temp, hum, fail, busy;
+	uint64_t low_since;
+	uint64_t when[DHT_EDGES];
+	int8_t level[DHT_EDGES];
+	uint8_t n, i;
+} dht = { .temp = 22, .hum = 50 };
+
+static void dht_edge(uint64_t *t, uint32_t us, int8_t level)
+{
+	*t += SIM_US(us);
+	dht.when[dht.n] = *t;
+	dht.level[dht.n++] = level;
+}
+
+static void dht_respond(void)
+{
+	uint8_t b[5] = { dht.hum, 0, dht.temp, 0, 0 };
+	uint64_t t = sim_now;
+
+	b[4] = b[0] + b[1] + b[2] + b[3];
+	dht.n = dht.i = 0;
+	dht_edge(&t, 30, 0);
+	dht_edge(&t, 80, -1);
+	for (int i = 0; i < 40; i++) {
+		dht_edge(&t, i ? (b[(i - 1) >> 3] >> (7 - ((i - 1) & 7)) & 1 ? 70 : 26) : 80, 0);
+		dht_edge(&t, 50, -1);
+	}
+	dht_edge(&t, b[4] & 1 ? 70 : 26, 0);
+	dht_edge(&t, 50, -1);
+	dht.busy = 1;
+	if (sim_logf)
+		fprintf(sim_logf, "%12.6f dht11 %u C %u %%\n", secs(), dht.temp, dht.hum);
+}
+
+static void dht_pins(uint16_t old, uint16_t now)
+{
+	uint16_t bit = 1 << DHT11_N;
+
+	if (dht.busy || !((old ^ now) & bit))
+		return;
+	if (!(now & bit)) {
+		dht.low_since = sim_now;
+	} else if (dht.low_since && sim_now - dht.low_since >= SIM_US(18000) - SIM_US(100)) {
+		dht.low_since = 0;
+		if (!dht.fail)
+			dht_respond();
+	}
+}
+
+void sim_dht11_set(uint8_t temp, uint8_t hum)
+{
+	dht.temp = temp;
+	dht.hum = hum;
+}
+
+void sim_dht11_fail(uint8_t on)
+{
+	dht.fail = on;
+}
+
+// LDR divider on PA5 (ADC channel 5)
+
+static uint16_t ldr_mv = 1650;
+
+void sim_ldr_set(uint16_t mv)
+{
+	ldr_mv = mv > 3300 ? 3300 : mv;
+}
+
+uint16_t dev_adc(uint8_t ch)
+{
+	return ch == 5 ? (uint32_t)ldr_mv * 4095 / 3300 : 0;
+}
+
+// TM1637: start/stop with CLK high, data sampled on the rising CLK edge,
+// LSB first, ninth clock is the ack
+
+static struct {
+	uint8_t active, bits, byte, n;
+	uint8_t buf[8];
+	uint8_t seg[4], ctrl;
+	char text[5];
+} tm = { .text = "    " };
+
+static char seg_char(uint8_t s)
+{
+	static const uint8_t digit[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+
+	for (int i = 0; i < 10; i++)
+		if ((s & 0x7F) == digit[i])
+			return '0' + i;
+	return s == 0x40 ? '-' : s ? '?' : ' ';
+}
+
+static void tm_frame(void)
+{
+	char text[5];
+
+	if (!tm.n)
+		return;
+	if ((tm.buf[0] & 0xC0) == 0xC0)
+		for (uint8_t i = 1; i < tm.n; i++)
+			tm.seg[(tm.buf[0] + i - 1) & 3] = tm.buf[i];
+	else if ((tm.buf[0] & 0xC0) == 0x80)
+		tm.ctrl = tm.buf[0];
+
+	for (int i = 0; i < 4; i++)
+		text[i] = tm.ctrl & 0x08 ? seg_char(tm.seg[i]) : ' ';
+	text[4] = 0;
+	if (strcmp(text, tm.text)) {
+		memcpy(tm.text, text, sizeof(text));
+		if (sim_logf)
+			fprintf(sim_logf, "%12.6f tm1637 |%s|\n", secs(), tm.text);
+	}
+}
+
+static void tm_pins(uint16_t old, uint16_t now)
+{
+	uint8_t oclk = (old >> SEG_CLK_N) & 1, clk = (now >> SEG_CLK_N) & 1;
+	uint8_t odio = (old >> SEG_DIO_N) & 1, dio = (now >> SEG_DIO_N) & 1;
+
+	if (oclk && clk && odio != dio) {
+		if (!dio) {
+			tm.active = 1;
+			tm.bits = tm.byte = tm.n = 0;
+		} else if (tm.active) {
+			tm.active = 0;
+			tm_frame();
+		}
+	} else if (!oclk && clk && tm.active) {
+		if (tm.bits < 8) {
+			tm.byte |= dio << tm.bits++;
+		} else {
+			if (tm.n < sizeof(tm.buf))
+				tm.buf[tm.n++] = tm.byte;
+			tm.bits = tm.byte = 0;
+		}
+	}
+}
+
+const char *sim_tm1637_text(void)
+{
+	return tm.text;
+}
+
+// Keypad: a held key ties its column to its row while the row drives low
+
+static uint16_t keys;
+
+static void keypad_update(void)
+{
+	uint16_t rows = ~hw_levels(KEY_ROW0_P) & hw_outputs(KEY_ROW0_P);
+
+	for (uint8_t c = 0; c < 4; c++) {
+		int low = 0;
+
+		for (uint8_t r = 0; r < 4; r++)
+			if (keys >> (r * 4 + c) & 1 && rows >> (KEY_ROW0_N + r) & 1)
+				low = 1;
+		hw_pin_ext(KEY_COL0_P, KEY_COL0_N + c, low ? 0 : -1);
+	}
+}
+
+void sim_key(uint8_t code, uint8_t down)
+{
+	sim_unlock();
+	if (down)
+		keys |= 1 << (code & 15);
+	else
+		keys &= ~(1 << (code & 15));
+	keypad_update();
+	sim_changed();
+	sim_lock();
+}
+
+// Pin changes from hw.c
+
+void dev_pins(uint8_t port, uint16_t old, uint16_t now)
+{
+	if (port < 3)
+		lcd_pins(port, old, now);
+	if (port == DHT11_P)
+		dht_pins(old, now);
+	if (port == SEG_CLK_P && ((old ^ now) & (PIN_BIT(SEG_CLK) | PIN_BIT(SEG_DIO))))
+		tm_pins(old, now);
+	if (port == KEY_ROW0_P && ((old ^ now) & (0xFU << KEY_ROW0_N)))
+		keypad_update();
+}
+
+uint64_t dev_next(void)
+{
+	uint64_t t = lcd.log_at;
+
+	if (dht.busy && dht.when[dht.i] < t)
+		t = dht.when[dht.i];
+	return t;
+}
+
+void dev_fire(void)
+{
+	while (dht.busy && dht.when[dht.i] <= sim_now) {
+		int8_t level = dht.level[dht.i];
+
+		if (++dht.i == dht.n)
+			dht.busy = 0;
+		hw_pin_ext(DHT11_P, DHT11_N, level);
+	}
+	if (lcd.log_at <= sim_now) {
+		lcd.log_at = SIM_NEVER;
+		if (sim_logf && memcmp(lcd.line, lcd.logged, sizeof(lcd.line))) {
+			memcpy(lcd.logged, lcd.line, sizeof(lcd.line));
+			fprintf(sim_logf, "%12.6f lcd |%s|%s|\n", secs(), lcd.line[0], lcd.line[1]);
+		}
+	}
+}
+
+void dev_init(void)
+{
+	memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+	lcd_render();
+}
@@ -0,0 +1,729 @@
+#include <string.h>
+#include "simint.h"
+
+// Register models. hw_read() runs before a firmware access, so lazily
+// kept state (counters, flags) is current; hw_write() runs after a write
+// with the register's previous value.
+
+#define IN(reg, periph) \
+	((uintptr_t)(reg) >= (uintptr_t)(periph) && (uintptr_t)(reg) < (uintptr_t)((periph) + 1))
+
+#define DMA_EN    (1U << 0)
+#define DMA_TCIE  (1U << 4)
+#define DMA_HTIE  (1U << 3)
+#define DMA_TEIE  (1U << 2)
+#define DMA_DMEIE (1U << 1)
+#define DMA_CIRC  (1U << 8)
+#define DMA_PINC  (1U << 9)
+#define DMA_MINC  (1U << 10)
+#define DMA_HT    (1U << 4)
+#define DMA_TC    (1U << 5)
+
+// GPIO
+
+static GPIO_TypeDef * const ports[SIM_PORTS] = { GPIOA, GPIOB, GPIOC };
+static int8_t ext[SIM_PORTS][16];        // external drive, -1 = released
+static uint16_t level[SIM_PORTS];
+
+static void exti_edges(uint8_t p, uint16_t old, uint16_t now)
+{
+	uint16_t ch = old ^ now;
+
+	for (uint8_t n = 0; ch; n++, ch >>= 1) {
+		uint32_t bit = 1U << n;
+
+		if (!(ch & 1) || ((SYSCFG->EXTICR[n >> 2] >> ((n & 3) * 4)) & 0xF) != p)
+			continue;
+		// PR latches whatever IMR says, the firmware clears it before unmasking
+		if ((now & bit) ? EXTI->RTSR & bit : EXTI->FTSR & bit)
+			EXTI->PR |= bit;
+	}
+}
+
+static void gpio_update(uint8_t p)
+{
+	GPIO_TypeDef *g = ports[p];
+	uint16_t old = level[p], lv = 0;
+
+	for (uint8_t n = 0; n < 16; n++) {
+		uint32_t mode = (g->MODER >> (n * 2)) & 3, pull = (g->PUPDR >> (n * 2)) & 3;
+		uint32_t out = (g->ODR >> n) & 1;
+		int bit;
+
+		if ((mode == 1 || mode == 2) && (g->OTYPER >> n) & 1)
+			bit = out && ext[p][n] != 0;         // open drain: anyone can pull low
+		else if (mode == 1 || mode == 2)
+			bit = out;
+		else if (mode == 0)
+			bit = ext[p][n] >= 0 ? ext[p][n] : pull == 1;
+		else
+			bit = 0;                              // analog
+		lv |= bit << n;
+	}
+	g->IDR = lv;
+	level[p] = lv;
+	if (lv != old) {
+		exti_edges(p, old, lv);
+		vcd_pins(p, lv);
+		dev_pins(p, old, lv);
+	}
+}
+
+void hw_pin_ext(uint8_t port, uint8_t pin, int level)
+{
+	ext[port][pin] = level;
+	gpio_update(port);
+}
+
+uint16_t hw_levels(uint8_t port)
+{
+	return level[port];
+}
+
+uint16_t hw_outputs(uint8_t port)
+{
+	uint16_t m = 0;
+
+	for (uint8_t n = 0; n < 16; n++)
+		if (((ports[port]->MODER >> (n * 2)) & 3) == 1)
+			m |= 1 << n;
+	return m;
+}
+
+uint8_t sim_pin(uint8_t port, uint8_t pin)
+{
+	return (level[port] >> pin) & 1;
+}
+
+void sim_pin_drive(uint8_t port, uint8_t pin, int level)
+{
+	sim_unlock();
+	hw_pin_ext(port, pin, level);
+	sim_changed();
+	sim_lock();
+}
+
+static void gpio_write(uint8_t p, volatile uint32_t *reg, uint32_t old)
+{
+	GPIO_TypeDef *g = ports[p];
+
+	if (reg == &g->BSRR) {
+		g->ODR = (g->ODR & ~(g->BSRR >> 16)) | (g->BSRR & 0xFFFF);
+		g->BSRR = 0;
+	} else if (reg == &g->IDR) {
+		g->IDR = old;
+	}
+	gpio_update(p);
+}
+
+// DMA streams
+
+typedef struct {
+	uint32_t total, mem, per;                // latched when enabled
+} stream_t;
+
+static stream_t streams[2][8];
+static DMA_TypeDef * const dmas[2] = { DMA1, DMA2 };
+static const uint8_t flag_shift[4] = { 0, 6, 16, 22 };
+
+static DMA_Stream_TypeDef *dma_stream(uint8_t c, uint8_t s)
+{
+	return c ? &host_periph.dma2_stream[s] : &host_periph.dma1_stream[s];
+}
+
+static uint32_t dma_flags(uint8_t c, uint8_t s)
+{
+	uint32_t isr = s < 4 ? dmas[c]->LISR : dmas[c]->HISR;
+
+	return (isr >> flag_shift[s & 3]) & 0x3D;
+}
+
+static void dma_flag(uint8_t c, uint8_t s, uint32_t f)
+{
+	if (s < 4)
+		dmas[c]->LISR |= f << flag_shift[s & 3];
+	else
+		dmas[c]->HISR |= f << flag_shift[s & 3];
+}
+
+static int in_periph(uint32_t addr)
+{
+	uintptr_t base = (uintptr_t)&host_periph;
+
+	return addr >= base && addr < base + sizeof(host_periph);
+}
+
+static uint32_t bus_read(uint32_t addr, uint32_t size)
+{
+	uint32_t v = 0;
+
+	if (in_periph(addr))
+		return hw_load((volatile uint32_t *)(uintptr_t)(addr & ~3U)) >> ((addr & 3) * 8);
+	if (!addr)
+		sim_fatal("DMA read from address 0");
+	memcpy(&v, (void *)(uintptr_t)addr, size);
+	return v;
+}
+
+static void bus_write(uint32_t addr, uint32_t v, uint32_t size)
+{
+	if (in_periph(addr)) {
+		hw_store((volatile uint32_t *)(uintptr_t)(addr & ~3U), v);
+		return;
+	}
+	if (!addr)
+		sim_fatal("DMA write to address 0");
+	memcpy((void *)(uintptr_t)addr, &v, size);
+}
+
+// One request from a peripheral on channel ch: move one item
+static void dma_request(uint8_t c, uint8_t s, uint8_t ch)
+{
+	DMA_Stream_TypeDef *st = dma_stream(c, s);
+	stream_t *m = &streams[c][s];
+	uint32_t cr = st->CR, psize, msize, idx, paddr, maddr, v;
+
+	if (!(cr & DMA_EN) || ((cr >> 25) & 7) != ch || !st->NDTR)
+		return;
+	psize = 1U << ((cr >> 11) & 3);
+	msize = 1U << ((cr >> 13) & 3);
+	idx = m->total - st->NDTR;
+	paddr = m->per + (cr & DMA_PINC ? idx * psize : 0);
+	maddr = m->mem + (cr & DMA_MINC ? idx * msize : 0);
+
+	if (((cr >> 6) & 3) == 1) {              // memory to peripheral
+		v = bus_read(maddr, msize);
+		bus_write(paddr, v, psize);
+	} else {                                 // peripheral to memory
+		v = bus_read(paddr, psize);
+		bus_write(maddr, v, msize);
+	}
+
+	st->NDTR--;
+	if (st->NDTR == m->total / 2)
+		dma_flag(c, s, DMA_HT);
+	if (!st->NDTR) {
+		dma_flag(c, s, DMA_TC);
+		if (cr & DMA_CIRC)
+			st->NDTR = m->total;
+		else
+			st->CR &= ~DMA_EN;
+	}
+}
+
+static void dma_write(uint8_t c, volatile uint32_t *reg, uint32_t old)
+{
+	DMA_TypeDef *d = dmas[c];
+
+	if (reg == &d->LIFCR || reg == &d->HIFCR) {
+		if (reg == &d->LIFCR)
+			d->LISR &= ~*reg;
+		else
+			d->HISR &= ~*reg;
+		*reg = 0;
+		return;
+	}
+	if (reg == &d->LISR || reg == &d->HISR) {
+		*reg = old;
+		return;
+	}
+	for (uint8_t s = 0; s < 8; s++) {
+		DMA_Stream_TypeDef *st = dma_stream(c, s);
+
+		if (!IN(reg, st))
+			continue;
+		if (reg == &st->CR && !(old & DMA_EN) && (st->CR & DMA_EN))
+			streams[c][s] = (stream_t){ st->NDTR, st->M0AR, st->PAR };
+		else if (reg != &st->CR && (st->CR & DMA_EN))
+			*reg = old;                      // configuration is locked while enabled
+		return;
+	}
+}
+
+// ADC1: a TIM3 TRGO edge converts the whole regular sequence at once
+
+static void adc_trigger(void)
+{
+	uint32_t cr2 = ADC1->CR2, n = ((ADC1->SQR1 >> 20) & 0xF) + 1;
+
+	if (!(cr2 & ADC_CR2_ADON) || !((cr2 >> 28) & 3) || ((cr2 >> 24) & 0xF) != 8)
+		return;
+	for (uint32_t i = 0; i < n && i < 6; i++) {
+		ADC1->DR = dev_adc((ADC1->SQR3 >> (i * 5)) & 0x1F) & 0xFFF;
+		ADC1->SR |= ADC_SR_EOC;
+		if (cr2 & (1U << 8))                 // DMA
+			dma_request(1, 0, 0);
+	}
+}
+
+// Timers: the counter is cnt0 at time t0 and advances every tick cycles
+
+typedef struct {
+	TIM_TypeDef *r;
+	uint8_t apb2;
+	int8_t dma_c, dma_s, dma_ch;             // update DMA request, -1 = none
+	uint64_t t0, cnt0;
+	uint8_t burst;                           // next DMAR register
+} tim_t;
+
+static tim_t tims[] = {
+	{ .r = TIM2, .dma_c = -1 },
+	{ .r = TIM3, .dma_c = -1 },
+	{ .r = TIM4, .dma_c = 0, .dma_s = 6, .dma_ch = 2 },
+	{ .r = TIM6, .dma_c = -1 },
+	{ .r = TIM8, .apb2 = 1, .dma_c = 1, .dma_s = 1, .dma_ch = 7 },
+};
+#define NTIMS (sizeof(tims) / sizeof(tims[0]))
+
+static uint32_t apb_div(uint8_t apb2)
+{
+	uint32_t ppre = (RCC->CFGR >> (apb2 ? 13 : 10)) & 7;
+
+	return ppre < 4 ? 1 : 1U << (ppre - 3);
+}
+
+// Timer clocks run at twice PCLK when the APB is divided
+static uint64_t tim_tick(tim_t *t)
+{
+	uint32_t d = apb_div(t->apb2);
+
+	return ((uint64_t)t->r->PSC + 1) * (d == 1 ? 1 : d / 2);
+}
+
+static uint64_t tim_top(tim_t *t)
+{
+	return t->r == TIM2 ? t->r->ARR : t->r->ARR & 0xFFFF;
+}
+
+static void tim_sync(tim_t *t)
+{
+	uint64_t tick, n;
+
+	if (t->r->CR1 & TIM_CR1_CEN) {
+		tick = tim_tick(t);
+		n = (sim_now - t->t0) / tick;
+		t->cnt0 += n;
+		t->t0 += n * tick;
+	}
+	t->r->CNT = (uint32_t)t->cnt0;
+}
+
+static uint64_t tim_next(tim_t *t)
+{
+	uint64_t tick, when;
+
+	if (!(t->r->CR1 & TIM_CR1_CEN))
+		return SIM_NEVER;
+	tick = tim_tick(t);
+	when = t->t0 + (tim_top(t) + 1 - t->cnt0) * tick;
+	for (uint8_t ch = 0; ch < 4; ch++) {
+		uint64_t ccr = (&t->r->CCR1)[ch];
+
+		if ((t->r->DIER >> (ch + 1)) & 1 && ccr > t->cnt0 && ccr <= tim_top(t) &&
+		    t->t0 + (ccr - t->cnt0) * tick < when)
+			when = t->t0 + (ccr - t->cnt0) * tick;
+	}
+	return when;
+}
+
+static void tim_latch_pwm(tim_t *t)
+{
+	if (t->r != TIM4)
+		return;
+	if (t->r->CCER & TIM_CCER_CC1E)
+		hw_pwm(0, t->r->CCR1, t->r->ARR + 1);
+	if (t->r->CCER & TIM_CCER_CC4E)
+		hw_pwm(1, t->r->CCR4, t->r->ARR + 1);
+}
+
+static void tim_update(tim_t *t)
+{
+	TIM_TypeDef *r = t->r;
+
+	r->SR |= TIM_SR_UIF;
+	tim_latch_pwm(t);
+	if (r->DIER & TIM_DIER_UDE && t->dma_c >= 0) {
+		DMA_Stream_TypeDef *st = dma_stream(t->dma_c, t->dma_s);
+		uint32_t n = st->PAR == (uint32_t)(uintptr_t)&r->DMAR ? ((r->DCR >> 8) & 0x1F) + 1 : 1;
+
+		while (n--)
+			dma_request(t->dma_c, t->dma_s, t->dma_ch);
+	}
+	if (r == TIM3 && ((r->CR2 >> 4) & 7) == 2)
+		adc_trigger();
+	if (r->CR1 & TIM_CR1_OPM)
+		r->CR1 &= ~TIM_CR1_CEN;
+}
+
+static void tim_fire(tim_t *t)
+{
+	if (tim_next(t) > sim_now)
+		return;
+	tim_sync(t);
+	if (t->cnt0 > tim_top(t)) {
+		t->cnt0 = 0;
+		t->r->CNT = 0;
+		tim_update(t);
+		return;
+	}
+	for (uint8_t ch = 0; ch < 4; ch++)
+		if ((t->r->DIER >> (ch + 1)) & 1 && (&t->r->CCR1)[ch] == t->cnt0)
+			t->r->SR |= 1U << (ch + 1);
+}
+
+static void tim_write(tim_t *t, volatile uint32_t *reg, uint32_t old)
+{
+	TIM_TypeDef *r = t->r;
+
+	if (reg == &r->CNT) {
+		t->cnt0 = r->CNT;
+		t->t0 = sim_now;
+	} else if (reg == &r->CR1) {
+		if (!(old & TIM_CR1_CEN) && (r->CR1 & TIM_CR1_CEN))
+			t->t0 = sim_now;
+	} else if (reg == &r->SR) {
+		r->SR = old & r->SR;                 // write 0 to clear
+	} else if (reg == &r->EGR) {
+		if (r->EGR & TIM_EGR_UG) {
+			t->cnt0 = 0;
+			t->t0 = sim_now;
+			r->CNT = 0;
+			if (!(r->CR1 & TIM_CR1_URS))
+				r->SR |= TIM_SR_UIF;
+			tim_latch_pwm(t);
+		}
+		r->EGR = 0;
+	} else if (reg == &r->DCR) {
+		t->burst = 0;
+	} else if (reg == &r->DMAR) {
+		uint32_t len = ((r->DCR >> 8) & 0x1F) + 1;
+		volatile uint32_t *dst = (volatile uint32_t *)r + (r->DCR & 0x1F) + t->burst;
+
+		t->burst = (t->burst + 1) % len;
+		hw_store(dst, r->DMAR);
+	} else if (reg == &r->CCR1 && !(r->CCMR1 & TIM_CCMR1_OC1PE)) {
+		tim_latch_pwm(t);
+	} else if (reg == &r->CCR4 && !(r->CCMR2 & TIM_CCMR2_OC4PE)) {
+		tim_latch_pwm(t);
+	}
+}
+
+// SysTick, counting down at the core clock
+
+static uint64_t st_zero;                 // when the counter next reaches 0
+static uint32_t st_val;                  // VAL while stopped
+static uint8_t st_pend;
+
+static uint32_t st_cur(void)
+{
+	if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk))
+		return st_val;
+	return (uint32_t)(st_zero - sim_now);
+}
+
+static uint64_t st_next(void)
+{
+	return SysTick->CTRL & SysTick_CTRL_ENABLE_Msk && SysTick->LOAD ? st_zero : SIM_NEVER;
+}
+
+static void st_fire(void)
+{
+	if (st_next() > sim_now)
+		return;
+	SysTick->CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+	if (SysTick->CTRL & SysTick_CTRL_TICKINT_Msk)
+		st_pend = 1;
+	st_zero += (uint64_t)SysTick->LOAD + 1;
+}
+
+static void st_write(volatile uint32_t *reg, uint32_t old)
+{
+	uint32_t on = SysTick->CTRL & SysTick_CTRL_ENABLE_Msk;
+
+	if (reg == &SysTick->CTRL) {
+		SysTick->CTRL = (SysTick->CTRL & ~SysTick_CTRL_COUNTFLAG_Msk) | (old & SysTick_CTRL_COUNTFLAG_Msk);
+		if (on && !(old & SysTick_CTRL_ENABLE_Msk))
+			st_zero = sim_now + (st_val ? st_val : (uint64_t)SysTick->LOAD + 1);
+		else if (!on && (old & SysTick_CTRL_ENABLE_Msk))
+			st_val = (uint32_t)(st_zero - sim_now);
+	} else if (reg == &SysTick->VAL) {
+		// Any write clears the counter; the next clock reloads it
+		SysTick->VAL = 0;
+		SysTick->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+		st_val = 0;
+		if (on)
+			st_zero = sim_now + 1 + SysTick->LOAD;
+	}
+}
+
+// USART3: bytes take ten bit times at the BRR baud rate
+
+#define RX_QUEUE 4096
+
+static uint64_t tx_free;                 // transmitter idle from
+static uint64_t rx_next = SIM_NEVER, idle_at = SIM_NEVER;
+static uint8_t rx_q[RX_QUEUE];
+static uint32_t rx_head, rx_tail;
+static FILE *uart_out;
+
+static uint64_t byte_cycles(void)
+{
+	return USART3->BRR ? 10ULL * USART3->BRR * apb_div(0) : SIM_MS(1);
+}
+
+static int tx_dma_ready(void)
+{
+	DMA_Stream_TypeDef *st = dma_stream(0, 3);
+
+	return USART3->CR3 & USART_CR3_DMAT && st->CR & DMA_EN && st->NDTR;
+}
+
+static uint64_t usart_next(void)
+{
+	uint64_t t = rx_next < idle_at ? rx_next : idle_at;
+
+	if (tx_dma_ready()) {
+		uint64_t tx = tx_free > sim_now ? tx_free : sim_now;
+
+		if (tx < t)
+			t = tx;
+	}
+	return t;
+}
+
+static void usart_fire(void)
+{
+	if (tx_dma_ready() && tx_free <= sim_now)
+		dma_request(0, 3, 4);
+
+	if (rx_next <= sim_now) {
+		if (USART3->SR & (1U << 5))
+			USART3->SR |= USART_SR_ORE;
+		USART3->DR = rx_q[rx_tail++ % RX_QUEUE];
+		USART3->SR |= 1U << 5;               // RXNE
+		if (USART3->CR3 & USART_CR3_DMAR)
+			dma_request(0, 1, 4);
+		if (rx_head == rx_tail) {
+			rx_next = SIM_NEVER;
+			idle_at = sim_now + byte_cycles();
+		} else {
+			rx_next += byte_cycles();
+		}
+	}
+	if (idle_at <= sim_now) {
+		USART3->SR |= USART_SR_IDLE;
+		idle_at = SIM_NEVER;
+	}
+}
+
+static void usart_write(volatile uint32_t *reg, uint32_t old)
+{
+	if (reg == &USART3->DR && USART3->CR1 & USART_CR1_TE) {
+		uint8_t c = USART3->DR;
+
+		tx_free = (tx_free > sim_now ? tx_free : sim_now) + byte_cycles();
+		USART3->SR &= ~(USART_SR_TXE | USART_SR_TC);
+		if (uart_out)
+			fputc(c, uart_out);
+	} else if (reg == &USART3->SR) {
+		USART3->SR = old;
+	}
+}
+
+void sim_uart_rx(const char *p, int len)
+{
+	sim_unlock();
+	if (rx_head == rx_tail)
+		rx_next = sim_now + byte_cycles();
+	while (len-- > 0 && rx_head - rx_tail < RX_QUEUE)
+		rx_q[rx_head++ % RX_QUEUE] = *p++;
+	sim_changed();
+	sim_lock();
+}
+
+void sim_uart_capture(FILE *f)
+{
+	uart_out = f;
+}
+
+// Bus hooks
+
+static uint64_t dwt_base;
+
+void hw_read(volatile uint32_t *reg)
+{
+	for (uint32_t i = 0; i < NTIMS; i++)
+		if (IN(reg, tims[i].r)) {
+			tim_sync(&tims[i]);
+			return;
+		}
+	if (reg == &SysTick->VAL) {
+		SysTick->VAL = st_cur();
+	} else if (reg == &DWT->CYCCNT) {
+		if (DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)
+			DWT->CYCCNT = (uint32_t)(sim_now - dwt_base);
+	} else if (reg == &SCB->ICSR) {
+		SCB->ICSR = st_pend ? SCB_ICSR_PENDSTSET_Msk : 0;
+	} else if (reg == &USART3->SR) {
+		if (tx_free <= sim_now + byte_cycles())
+			USART3->SR |= USART_SR_TXE;
+		if (tx_free <= sim_now)
+			USART3->SR |= USART_SR_TC;
+	}
+}
+
+void hw_read_done(volatile uint32_t *reg)
+{
+	if (reg == &SysTick->CTRL)
+		SysTick->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+	else if (reg == &ADC1->DR)
+		ADC1->SR &= ~ADC_SR_EOC;
+	else if (reg == &USART3->DR)
+		USART3->SR &= ~((1U << 5) | USART_SR_IDLE | USART_SR_ORE);
+}
+
+void hw_write(volatile uint32_t *reg, uint32_t old)
+{
+	for (uint8_t p = 0; p < SIM_PORTS; p++)
+		if (IN(reg, ports[p])) {
+			gpio_write(p, reg, old);
+			return;
+		}
+	for (uint32_t i = 0; i < NTIMS; i++)
+		if (IN(reg, tims[i].r)) {
+			tim_write(&tims[i], reg, old);
+			return;
+		}
+	if (IN(reg, DMA1) || IN(reg, &host_periph.dma1_stream))
+		dma_write(0, reg, old);
+	else if (IN(reg, DMA2) || IN(reg, &host_periph.dma2_stream))
+		dma_write(1, reg, old);
+	else if (IN(reg, SysTick))
+		st_write(reg, old);
+	else if (IN(reg, USART3))
+		usart_write(reg, old);
+	else if (reg == &EXTI->PR)
+		EXTI->PR = old & ~EXTI->PR;          // write 1 to clear
+	else if (reg == &EXTI->SWIER)
+		EXTI->PR |= EXTI->SWIER & ~old, EXTI->SWIER = 0;
+	else if (reg == &DWT->CYCCNT)
+		dwt_base = sim_now - DWT->CYCCNT;
+	else if (reg == &DWT->CTRL && !(old & DWT_CTRL_CYCCNTENA_Msk))
+		dwt_base = sim_now - DWT->CYCCNT;
+	else if (reg == &SCB->ICSR) {
+		if (SCB->ICSR & SCB_ICSR_PENDSTCLR_Msk)
+			st_pend = 0;
+		if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+			st_pend = 1;
+	} else if (reg == &ADC1->CR2 && ADC1->CR2 & ADC_CR2_SWSTART) {
+		ADC1->CR2 &= ~ADC_CR2_SWSTART;
+		adc_trigger();
+	} else if (reg == &RCC->CR) {
+		// Oscillators and the PLL are ready as soon as they are switched on
+		RCC->CR = (RCC->CR & ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY)) |
+		          (RCC->CR & RCC_CR_HSION) << 1 | (RCC->CR & RCC_CR_HSEON) << 1 |
+		          (RCC->CR & RCC_CR_PLLON) << 1;
+	} else if (reg == &RCC->CFGR) {
+		RCC->CFGR = (RCC->CFGR & ~(3U << 2)) | (RCC->CFGR & 3) << 2;
+	}
+}
+
+uint32_t hw_load(volatile uint32_t *reg)
+{
+	uint32_t v;
+
+	hw_read(reg);
+	v = *reg;
+	hw_read_done(reg);
+	return v;
+}
+
+void hw_store(volatile uint32_t *reg, uint32_t val)
+{
+	uint32_t old;
+
+	hw_read(reg);
+	old = *reg;
+	*reg = val;
+	hw_write(reg, old);
+}
+
+uint64_t hw_next(void)
+{
+	uint64_t t = st_next(), u = usart_next();
+
+	if (u < t)
+		t = u;
+	for (uint32_t i = 0; i < NTIMS; i++) {
+		u = tim_next(&tims[i]);
+		if (u < t)
+			t = u;
+	}
+	return t;
+}
+
+void hw_fire(void)
+{
+	for (uint32_t i = 0; i < NTIMS; i++)
+		tim_fire(&tims[i]);
+	st_fire();
+	usart_fire();
+}
+
+int hw_irq(uint8_t n)
+{
+	static const uint8_t dma_irq[2][8] = {
+		{ 11, 12, 13, 14, 15, 16, 17, IRQ_DMA1_S7 },
+		{ 56, 57, 58, 59, 60, 68, 69, 70 },
+	};
+	uint32_t pr = EXTI->PR & EXTI->IMR;
+
+	if (n >= IRQ_EXTI0 && n < IRQ_EXTI0 + 5)
+		return (pr >> (n - IRQ_EXTI0)) & 1;
+	switch (n) {
+	case 23: return (pr & 0x03E0) != 0;
+	case 40: return (pr & 0xFC00) != 0;
+	case 28: return (TIM2->SR & TIM2->DIER & 0x1F) != 0;
+	case 29: return (TIM3->SR & TIM3->DIER & 0x1F) != 0;
+	case 30: return (TIM4->SR & TIM4->DIER & 0x1F) != 0;
+	case 54: return (TIM6->SR & TIM6->DIER & TIM_SR_UIF) != 0;
+	case IRQ_TIM8_UP: return (TIM8->SR & TIM8->DIER & TIM_SR_UIF) != 0;
+	case IRQ_ADC: return (ADC1->SR & ADC_SR_EOC) && (ADC1->CR1 & (1U << 5));
+	case 39: return (USART3->SR & USART3->CR1 & (USART_CR1_IDLEIE | 0xE0)) != 0;
+	case IRQ_SYSTICK: return st_pend;
+	}
+	for (uint8_t c = 0; c < 2; c++)
+		for (uint8_t s = 0; s < 8; s++)
+			if (dma_irq[c][s] == n) {
+				uint32_t f = dma_flags(c, s), cr = dma_stream(c, s)->CR;
+
+				return (f & DMA_TC && cr & DMA_TCIE) || (f & DMA_HT && cr & DMA_HTIE) ||
+				       (f & (1U << 3) && cr & DMA_TEIE) || (f & (1U << 2) && cr & DMA_DMEIE);
+			}
+	return 0;
+}
+
+void hw_irq_done(uint8_t n)
+{
+	if (n == IRQ_SYSTICK)
+		st_pend = 0;
+}
+
+void hw_pwm(uint8_t ch, uint16_t duty, uint16_t top)
+{
+	vcd_value(VCD_PWMA + ch, duty < top ? duty : top);
+}
+
+void hw_init(void)
+{
+	memset(ext, -1, sizeof(ext));
+	// Reset values: JTAG/SWD pins in AF mode, HSI on
+	GPIOA->MODER = 0xA8000000;
+	GPIOA->PUPDR = 0x64000000;
+	GPIOB->MODER = 0x00000280;
+	GPIOB->PUPDR = 0x00000100;
+	RCC->CR = RCC_CR_HSION | RCC_CR_HSIRDY;
+	USART3->SR = USART_SR_TXE | USART_SR_TC;
+	for (uint8_t p = 0; p < SIM_PORTS; p++)
+		gpio_update(p);
+}
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+
+// greenhouse-sim: the firmware image (every module) on the host simulator
+//
+//   greenhouse-sim [-t seconds] [-v trace.vcd] [-p profile.txt] [-u uart.bin]
+//                  [-T celsius] [-H percent] [-L millivolts] [-q]
+//                  [-k ms:keys]... [-b ms]... [-r ms:text]...
+//
+// The device log (LCD screens, TM1637 digits, DHT11 reads) goes to stdout
+// and a summary with the top of the profile to stderr.
+
+#define KEY_HOLD_MS 50
+#define KEY_GAP_MS  150
+#define BUTTON_MS   80
+
+int firmware_main(void);
+extern const char keymap[4][4];
+
+static const char *profile_path;
+static FILE *uart_file;
+static struct timespec host_start;
+
+static void usage(void)
+{
+	fprintf(stderr,
+	        "usage: greenhouse-sim [-t seconds] [-v trace.vcd] [-p profile.txt] [-u uart.bin]\n"
+	        "                      [-T celsius] [-H percent] [-L millivolts] [-q]\n"
+	        "                      [-k ms:keys]... [-b ms]... [-r ms:text]...\n");
+	exit(2);
+}
+
+static void key_event(void *arg)
+{
+	uintptr_t v = (uintptr_t)arg;
+
+	sim_key(v & 15, v >> 4);
+}
+
+static void button_event(void *arg)
+{
+	sim_pin_drive(1, 7, arg ? 0 : -1);       // PB7, active low
+}
+
+static void uart_event(void *arg)
+{
+	sim_uart_rx(arg, strlen(arg));
+}
+
+static int key_code(char c)
+{
+	for (int i = 0; i < 16; i++)
+		if (keymap[i >> 2][i & 3] == c)
+			return i;
+	return -1;
+}
+
+static char *split_ms(char *arg, uint64_t *when)
+{
+	char *end;
+
+	*when = SIM_MS(strtoull(arg, &end, 10));
+	if (*end != ':')
+		usage();
+	return end + 1;
+}
+
+static void at_exit(void)
+{
+	struct timespec end;
+	double host, virt = (double)sim_now / SIM_HZ;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	host = (end.tv_sec - host_start.tv_sec) + (end.tv_nsec - host_start.tv_nsec) / 1e9;
+
+	fprintf(stderr, "ran %.3f s virtual in %.3f s host (%.1fx real time)\n", virt, host,
+	        host > 0 ? virt / host : 0.0);
+	fprintf(stderr, "lcd    |%s|\n       |%s|\n", sim_lcd_line(0), sim_lcd_line(1));
+	fprintf(stderr, "tm1637 |%s|\n", sim_tm1637_text());
+	fprintf(stderr, "lcd commands while busy: %u\n", sim_lcd_violations());
+	fprintf(stderr, "lcd EN raised before RS/data setup: %u\n", sim_lcd_setup_violations());
+	if (profile_path) {
+		FILE *f = fopen(profile_path, "w");
+
+		if (!f) {
+			perror(profile_path);
+			return;
+		}
+		sim_profile_write(f);
+		fclose(f);
+	}
+	if (uart_file)
+		fclose(uart_file);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 10;
+	int opt, temp = 22, hum = 50, quiet = 0;
+	uint64_t when;
+	char *p;
+
+	sim_init();
+	while ((opt = getopt(argc, argv, "t:v:p:u:T:H:L:qk:b:r:")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'v':
+			if (sim_vcd_open(optarg)) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			profile_path = optarg;
+			break;
+		case 'u':
+			if (!(uart_file = fopen(optarg, "wb"))) {
+				perror(optarg);
+				return 1;
+			}
+			sim_uart_capture(uart_file);
+			break;
+		case 'T':
+			temp = atoi(optarg);
+			break;
+		case 'H':
+			hum = atoi(optarg);
+			break;
+		case 'L':
+			sim_ldr_set(atoi(optarg));
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'k':
+			for (p = split_ms(optarg, &when); *p; p++, when += SIM_MS(KEY_GAP_MS)) {
+				int code = key_code(*p);
+
+				if (code < 0) {
+					fprintf(stderr, "no key '%c' on the keypad\n", *p);
+					return 2;
+				}
+				sim_at(when, key_event, (void *)(uintptr_t)(code | 16));
+				sim_at(when + SIM_MS(KEY_HOLD_MS), key_event, (void *)(uintptr_t)code);
+			}
+			break;
+		case 'b':
+			when = SIM_MS(strtoull(optarg, 0, 10));
+			sim_at(when, button_event, (void *)1);
+			sim_at(when + SIM_MS(BUTTON_MS), button_event, 0);
+			break;
+		case 'r':
+			p = split_ms(optarg, &when);
+			sim_at(when, uart_event, p);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	sim_dht11_set(temp, hum);
+	sim_log(quiet ? 0 : stdout);
+	sim_on_exit(at_exit);
+	clock_gettime(CLOCK_MONOTONIC, &host_start);
+	sim_run(firmware_main, (uint64_t)(seconds * SIM_HZ));
+	return 0;
+}
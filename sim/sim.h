@@ -0,0 +1,88 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Host simulator. The unchanged firmware (built against host/stm32f4xx.h)
+// runs on Linux against a model of the board:
+//
+// - The peripheral block is kept PROT_NONE. Each register access faults,
+//   is single-stepped, and goes through the register models in hw.c: GPIO
+//   with EXTI, TIM2/3/4/6/8, SysTick, DWT, DMA1/2 streams, ADC1, USART3
+//   and RCC ready bits.
+// - Virtual time is in core cycles at SIM_HZ. Firmware code is charged a
+//   fixed cost per function call (-finstrument-functions) and per register
+//   access. WFI skips ahead to the next hardware event, so idle time is
+//   free. The same inputs give the same run.
+// - Interrupts are taken at function entry, when PRIMASK clears and in WFI.
+//   They run to completion without nesting.
+// - Pin levels go to the devices in devices.c (HD44780, DHT11, LDR on the
+//   ADC, TM1637, 4x4 keypad) and to an optional VCD trace.
+// - Every instrumented function is timed; sim_profile_write() reports
+//   calls and inclusive/exclusive virtual cycles.
+//
+// Needs x86-64 Linux: the trap relies on the trap flag and the page-fault
+// error code.
+
+#define SIM_HZ          168000000ULL
+#define SIM_CALL_CYCLES 12    // call, prologue, epilogue, return
+#define SIM_BUS_CYCLES  3     // one APB/AHB register access
+#define SIM_IRQ_CYCLES  24    // exception entry and exit
+#define SIM_NEVER       UINT64_MAX
+
+#define SIM_US(us) ((uint64_t)(us) * (SIM_HZ / 1000000))
+#define SIM_MS(ms) ((uint64_t)(ms) * (SIM_HZ / 1000))
+#define SIM_S(s)   ((uint64_t)(s) * SIM_HZ)
+
+extern uint64_t sim_now;  // virtual time, core cycles
+
+typedef void (*sim_event_fn)(void *arg);
+
+void sim_init(void);
+void sim_at(uint64_t when, sim_event_fn fn, void *arg);  // scenario callback
+void sim_run(int (*fw_main)(void), uint64_t until);      // does not return
+
+// Called once when the run ends, before the reports are written
+void sim_on_exit(void (*fn)(void));
+
+// Pins, by port index (0 = A) and number
+uint8_t sim_pin(uint8_t port, uint8_t pin);
+void sim_pin_drive(uint8_t port, uint8_t pin, int level);  // 0, 1, -1 = released
+
+// Devices
+void sim_dht11_set(uint8_t temp, uint8_t hum);
+void sim_dht11_fail(uint8_t on);                    // stop answering
+void sim_ldr_set(uint16_t mv);                      // voltage on PA5
+void sim_key(uint8_t code, uint8_t down);           // row * 4 + col
+void sim_uart_rx(const char *p, int len);
+void sim_log(FILE *f);                              // device log, 0 = off
+const char *sim_lcd_line(int row);
+const char *sim_tm1637_text(void);
+uint32_t sim_lcd_writes(void);                      // commands and data latched
+uint32_t sim_lcd_violations(void);                  // commands sent while busy
+uint32_t sim_lcd_setup_violations(void);            // EN rose within tAS of RS/data
+
+// Benchmarks: every host instruction between begin and end is
+// single-stepped and counted, with the firmware's register accesses and
+// calls. The instrumentation hooks themselves are not counted. Keep
+// interrupts masked in the window.
+typedef struct {
+	uint64_t insns;      // host instructions
+	uint64_t accesses;   // peripheral register accesses
+	uint64_t calls;      // instrumented function calls
+	uint64_t cycles;     // virtual time
+} sim_count_t;
+
+void sim_count_begin(void);
+void sim_count_end(sim_count_t *c);
+
+// A busy-wait of the given cycles without stepping a polling loop on the host
+void sim_spin(uint64_t cycles);
+
+// Output
+int  sim_vcd_open(const char *path);
+void sim_uart_capture(FILE *f);
+void sim_profile_write(FILE *f);
+
+#endif
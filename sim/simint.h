@@ -0,0 +1,55 @@
+#ifndef SIMINT_H
+#define SIMINT_H
+
+#include "sim.h"
+#include "stm32f4xx.h"
+
+// Shared between the simulator files
+
+#define SIM_PORTS 3
+
+// IRQ numbers the host header does not name
+#define IRQ_EXTI0       6
+#define IRQ_ADC         18
+#define IRQ_TIM8_UP     44
+#define IRQ_DMA1_S7     47
+#define IRQ_SYSTICK     95   // slot for SysTick in the pending set
+#define IRQ_SLOTS       96
+
+// core.c
+extern FILE *sim_logf;
+void sim_unlock(void);              // peripherals readable by the simulator
+void sim_lock(void);
+void sim_changed(void);             // a model changed, recompute the next event
+void sim_fatal(const char *fmt, ...);
+
+// hw.c
+void     hw_init(void);
+void     hw_read(volatile uint32_t *reg);                 // before a firmware read
+void     hw_read_done(volatile uint32_t *reg);            // after it
+void     hw_write(volatile uint32_t *reg, uint32_t old);  // after a firmware write
+uint32_t hw_load(volatile uint32_t *reg);                 // read as a bus master
+void     hw_store(volatile uint32_t *reg, uint32_t val);  // write as a bus master
+uint64_t hw_next(void);
+void     hw_fire(void);
+int      hw_irq(uint8_t n);          // line asserted
+void     hw_irq_done(uint8_t n);     // handler taken, clears edge pends
+void     hw_pin_ext(uint8_t port, uint8_t pin, int level);
+uint16_t hw_levels(uint8_t port);
+uint16_t hw_outputs(uint8_t port);   // pins in output mode
+void     hw_pwm(uint8_t ch, uint16_t duty, uint16_t top);
+
+// devices.c
+void     dev_init(void);
+void     dev_pins(uint8_t port, uint16_t old, uint16_t now);
+uint16_t dev_adc(uint8_t ch);
+uint64_t dev_next(void);
+void     dev_fire(void);
+
+// vcd.c
+void vcd_pins(uint8_t port, uint16_t levels);
+void vcd_value(int sig, uint32_t v);
+void vcd_close(void);
+enum { VCD_PWMA, VCD_PWMB, VCD_IRQ, VCD_VALUES };
+
+#endif
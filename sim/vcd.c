@@ -0,0 +1,116 @@
+#include <string.h>
+#include "simint.h"
+#include "board.h"
+
+// Value change dump of every board pin plus the PWM duties and the
+// interrupt being served, 1 ns timescale
+
+typedef struct {
+	uint8_t port, pin;
+	const char *name;
+} vcd_pin_t;
+
+#define VCD_PIN_A(name, pin, ...) { 0, pin, #name },
+#define VCD_PIN_B(name, pin, ...) { 1, pin, #name },
+#define VCD_PIN_C(name, pin, ...) { 2, pin, #name },
+static const vcd_pin_t pins[] = {
+	BOARD_PINS_A(VCD_PIN_A)
+	BOARD_PINS_B(VCD_PIN_B)
+	BOARD_PINS_C(VCD_PIN_C)
+};
+#define NPINS (sizeof(pins) / sizeof(pins[0]))
+
+static const struct {
+	const char *name;
+	uint8_t width;
+} values[VCD_VALUES] = {
+	[VCD_PWMA] = { "pwm_a", 16 },
+	[VCD_PWMB] = { "pwm_b", 16 },
+	[VCD_IRQ] = { "irq", 8 },
+};
+
+// Identifiers run from '!', pins first
+static FILE *vcd;
+static uint64_t last_ns = SIM_NEVER;
+static uint16_t shown[SIM_PORTS];
+static int8_t pin_index[SIM_PORTS][16];
+
+static uint64_t now_ns(void)
+{
+	return sim_now / SIM_HZ * 1000000000ULL + sim_now % SIM_HZ * 1000000000ULL / SIM_HZ;
+}
+
+static void stamp(void)
+{
+	uint64_t t = now_ns();
+
+	// Models can report a little behind the firmware, keep time monotonic
+	if (last_ns != SIM_NEVER && t <= last_ns)
+		return;
+	fprintf(vcd, "#%llu\n", (unsigned long long)t);
+	last_ns = t;
+}
+
+static void put_value(int sig, uint32_t v)
+{
+	fputc('b', vcd);
+	for (int i = values[sig].width - 1; i >= 0; i--)
+		fputc('0' + ((v >> i) & 1), vcd);
+	fprintf(vcd, " %c\n", (char)('!' + NPINS + sig));
+}
+
+int sim_vcd_open(const char *path)
+{
+	if (!(vcd = fopen(path, "w")))
+		return -1;
+	memset(pin_index, -1, sizeof(pin_index));
+	fprintf(vcd, "$timescale 1ns $end\n$scope module board $end\n");
+	for (uint32_t i = 0; i < NPINS; i++) {
+		pin_index[pins[i].port][pins[i].pin] = i;
+		fprintf(vcd, "$var wire 1 %c %s $end\n", (char)('!' + i), pins[i].name);
+	}
+	for (int s = 0; s < VCD_VALUES; s++)
+		fprintf(vcd, "$var wire %u %c %s $end\n", values[s].width, (char)('!' + NPINS + s), values[s].name);
+	fprintf(vcd, "$upscope $end\n$enddefinitions $end\n$dumpvars\n");
+	for (uint32_t i = 0; i < NPINS; i++) {
+		shown[pins[i].port] = hw_levels(pins[i].port);
+		fprintf(vcd, "%c%c\n", '0' + sim_pin(pins[i].port, pins[i].pin), (char)('!' + i));
+	}
+	for (int s = 0; s < VCD_VALUES; s++)
+		put_value(s, 0);
+	fprintf(vcd, "$end\n");
+	return 0;
+}
+
+void vcd_pins(uint8_t port, uint16_t levels)
+{
+	uint16_t ch;
+
+	if (!vcd)
+		return;
+	ch = levels ^ shown[port];
+	shown[port] = levels;
+	for (uint8_t n = 0; ch; n++, ch >>= 1) {
+		if (!(ch & 1) || pin_index[port][n] < 0)
+			continue;
+		stamp();
+		fprintf(vcd, "%c%c\n", '0' + ((levels >> n) & 1), (char)('!' + pin_index[port][n]));
+	}
+}
+
+void vcd_value(int sig, uint32_t v)
+{
+	if (!vcd)
+		return;
+	stamp();
+	put_value(sig, v);
+}
+
+void vcd_close(void)
+{
+	if (vcd) {
+		stamp();
+		fclose(vcd);
+		vcd = 0;
+	}
+}
@@ -0,0 +1,107 @@
+#include "stm32f4xx.h"
+#include "adc.h"
+#include "clock.h"
+#include "probe.h"
+
+// Scan order: ADC channel numbers, index = ADC_CH_x
+static const uint8_t adc_channels[ADC_NUM_CH] = { 5 };
+
+static volatile uint16_t adc_buf[2][ADC_OVERSAMPLE][ADC_NUM_CH];
+static volatile uint16_t adc_out[ADC_NUM_CH];
+static volatile uint32_t adc_blocks;
+
+// TIM3 paces the scans, the ADC clock stays at or below 36 MHz
+static void adc_clock_update(void) {
+    uint32_t pclk2 = clock_apb2_hz();
+    uint32_t pre = 0;
+
+    while (pre < 3 && pclk2 / ((pre + 1) * 2) > 36000000)
+        pre++;
+    ADC123_COMMON->CCR = (ADC123_COMMON->CCR & ~(3 << 16)) | (pre << 16);
+
+    TIM3->PSC = clock_apb1_timer_hz() / 1000000 - 1;
+    TIM3->ARR = 1000000 / ADC_SCAN_HZ - 1;
+}
+
+void adc_init(void) {
+    RCC->APB2ENR |= RCC_APB2ENR_ADC1EN;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+
+    adc_clock_update();
+    clock_on_change(adc_clock_update);
+
+    // TIM3 update -> TRGO
+    TIM3->CR2 = (2 << 4);                  // MMS = update
+
+    // ADC1: scan, DMA with continuous requests, external trigger TIM3_TRGO rising
+    ADC1->CR2 = 0;
+    ADC1->CR1 = (1 << 8);                  // SCAN
+    ADC1->SQR1 = (ADC_NUM_CH - 1) << 20;   // L = number of conversions - 1
+    ADC1->SQR3 = 0;
+    for (int i = 0; i < ADC_NUM_CH; i++) {
+        uint8_t ch = adc_channels[i];
+        ADC1->SQR3 |= ch << (i * 5);       // up to 6 channels in SQR3
+        if (ch >= 10)
+            ADC1->SMPR1 |= 7 << ((ch - 10) * 3);
+        else
+            ADC1->SMPR2 |= 7 << (ch * 3);  // max sample time
+    }
+    ADC1->CR2 = (1 << 8) | (1 << 9) |      // DMA, DDS
+                (8 << 24) | (1 << 28);     // EXTSEL = TIM3_TRGO, EXTEN = rising
+
+    // DMA2 Stream0 channel 0: ADC1->DR to adc_buf, 16-bit, circular, HT+TC irqs
+    DMA2_Stream0->CR = 0;
+    while (DMA2_Stream0->CR & 1);
+    DMA2_Stream0->PAR = (uint32_t)&ADC1->DR;
+    DMA2_Stream0->M0AR = (uint32_t)adc_buf;
+    DMA2_Stream0->NDTR = 2 * ADC_OVERSAMPLE * ADC_NUM_CH;
+    DMA2_Stream0->CR = (0 << 25) |         // CHSEL = 0
+                       (1 << 13) | (1 << 11) | // MSIZE, PSIZE = 16-bit
+                       (1 << 10) | (1 << 8) |  // MINC, CIRC
+                       (1 << 4) | (1 << 3);    // TCIE, HTIE
+    DMA2->LIFCR = 0x3D;                    // clear stream 0 flags
+    DMA2_Stream0->CR |= 1;                 // EN
+
+    NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+    ADC1->CR2 |= ADC_CR2_ADON;
+    TIM3->CR1 |= TIM_CR1_CEN;
+}
+
+// Sum ADC_OVERSAMPLE scans per channel and keep ADC_BITS of the result
+void adc_decimate(volatile uint16_t (*blk)[ADC_NUM_CH], volatile uint16_t *out) {
+    for (int c = 0; c < ADC_NUM_CH; c++) {
+        uint32_t sum = 0;
+        for (int i = 0; i < ADC_OVERSAMPLE; i++)
+            sum += blk[i][c];
+        out[c] = sum >> ADC_DECIM_SHIFT;
+    }
+}
+
+// Decimate one half buffer while DMA fills the other
+void DMA2_Stream0_IRQHandler(void) {
+    uint32_t isr = DMA2->LISR;
+    volatile uint16_t (*blk)[ADC_NUM_CH];
+
+    DMA2->LIFCR = isr & 0x3D;
+    if (isr & (1 << 4))                    // HTIF0
+        blk = adc_buf[0];
+    else if (isr & (1 << 5))               // TCIF0
+        blk = adc_buf[1];
+    else
+        return;                            // not timed, there is no block
+
+    probe_begin(PROBE_ADC_DMA);
+    adc_decimate(blk, adc_out);
+    adc_blocks++;
+    probe_end(PROBE_ADC_DMA);
+}
+
+// Single halfword loads, so the main loop reads without locking
+uint16_t adc_value(uint8_t ch) {
+    return adc_out[ch];
+}
+
+uint32_t adc_seq(void) {
+    return adc_blocks;
+}
@@ -0,0 +1,127 @@
+#include "stm32f4xx.h"
+#include "clock.h"
+
+#define CLOCK_MAX_HOOKS 8
+#define HSE_TIMEOUT     100000
+
+// PLL input is fixed at 2 MHz, VCO at 336 MHz, USB/SDIO at 336/7 = 48 MHz
+#define PLL_IN_HZ 2000000UL
+#define PLL_N     168
+#define PLL_Q     7
+
+// APB prescaler codes for CFGR PPREx: 0 = /1, 4 = /2, 5 = /4
+static const struct {
+	uint8_t pll;     // 0 = run from HSI directly
+	uint8_t pllp;    // SYSCLK = VCO / pllp
+	uint8_t ppre1;
+	uint8_t ppre2;
+	uint8_t latency; // flash wait states at 2.7-3.6 V
+} profiles[CLOCK_PROFILES] = {
+	[CLOCK_FULL]      = { 1, 2, 5, 4, 5 },
+	[CLOCK_BALANCED]  = { 1, 4, 4, 0, 2 },
+	[CLOCK_LOW_POWER] = { 0, 2, 0, 0, 0 },
+};
+
+// Lives in .bss: zero (CLOCK_FULL) matches what SystemInit selects
+static clock_profile_t current;
+static clock_hook_t hooks[CLOCK_MAX_HOOKS];
+static uint8_t nhooks;
+
+// Touches registers only, so SystemInit can call it before .data/.bss exist
+void clock_setup(clock_profile_t p) {
+	uint32_t src_hz = HSI_VALUE;
+	uint32_t src = 0;
+
+	// Park on HSI while the PLL and flash timing are changed
+	RCC->CR |= RCC_CR_HSION;
+	while (!(RCC->CR & RCC_CR_HSIRDY));
+	RCC->CFGR &= ~(3 << 0);                // SW = HSI
+	while (RCC->CFGR & (3 << 2));          // SWS = HSI
+
+	// Higher latency is always safe at 16 MHz, so set the target now
+	FLASH->ACR = FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN | profiles[p].latency;
+
+	RCC->CR &= ~RCC_CR_PLLON;
+	while (RCC->CR & RCC_CR_PLLRDY);
+
+	// AHB /1, APB prescalers for the new profile
+	RCC->CFGR = (RCC->CFGR & ~((0xF << 4) | (7 << 10) | (7 << 13))) |
+	            (profiles[p].ppre1 << 10) | (profiles[p].ppre2 << 13);
+
+	if (!profiles[p].pll) {
+		RCC->CR &= ~RCC_CR_HSEON;
+		return;
+	}
+
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR |= PWR_CR_VOS;                 // scale 1, needed above 144 MHz
+
+	// Fall back to HSI as PLL source if the crystal does not start
+	RCC->CR |= RCC_CR_HSEON;
+	for (uint32_t t = 0; t < HSE_TIMEOUT; t++) {
+		if (RCC->CR & RCC_CR_HSERDY) {
+			src_hz = HSE_VALUE;
+			src = RCC_PLLCFGR_PLLSRC_HSE;
+			break;
+		}
+	}
+	if (!src)
+		RCC->CR &= ~RCC_CR_HSEON;
+
+	RCC->PLLCFGR = (src_hz / PLL_IN_HZ) | (PLL_N << 6) |
+	               ((profiles[p].pllp / 2 - 1) << 16) | src | (PLL_Q << 24);
+	RCC->CR |= RCC_CR_PLLON;
+	while (!(RCC->CR & RCC_CR_PLLRDY));
+
+	RCC->CFGR |= (2 << 0);                 // SW = PLL
+	while ((RCC->CFGR & (3 << 2)) != (2 << 2));
+}
+
+void clock_set_profile(clock_profile_t p) {
+	uint32_t primask = __get_PRIMASK();
+
+	if (p >= CLOCK_PROFILES)
+		return;
+
+	__disable_irq();
+	clock_setup(p);
+	current = p;
+	SystemCoreClockUpdate();
+	for (int i = 0; i < nhooks; i++)
+		hooks[i]();
+	__set_PRIMASK(primask);
+}
+
+clock_profile_t clock_profile(void) {
+	return current;
+}
+
+int clock_on_change(clock_hook_t fn) {
+	if (nhooks >= CLOCK_MAX_HOOKS)
+		return -1;
+	hooks[nhooks++] = fn;
+	return 0;
+}
+
+static uint32_t apb_hz(uint32_t ppre) {
+	return (ppre & 4) ? SystemCoreClock >> ((ppre & 3) + 1) : SystemCoreClock;
+}
+
+uint32_t clock_apb1_hz(void) {
+	return apb_hz((RCC->CFGR >> 10) & 7);
+}
+
+uint32_t clock_apb2_hz(void) {
+	return apb_hz((RCC->CFGR >> 13) & 7);
+}
+
+// Timer kernels run at twice PCLK whenever the APB prescaler is not 1
+uint32_t clock_apb1_timer_hz(void) {
+	uint32_t ppre = (RCC->CFGR >> 10) & 7;
+	return (ppre & 4) ? 2 * apb_hz(ppre) : SystemCoreClock;
+}
+
+uint32_t clock_apb2_timer_hz(void) {
+	uint32_t ppre = (RCC->CFGR >> 13) & 7;
+	return (ppre & 4) ? 2 * apb_hz(ppre) : SystemCoreClock;
+}
@@ -0,0 +1,115 @@
+#include "stm32f4xx.h"
+#include "debounce.h"
+#include "ring.h"
+
+RING_DEFINE(db_ring, db_event_t, DEBOUNCE_QUEUE)
+
+typedef struct {
+	uint8_t port;
+	uint16_t mask;
+	uint16_t active_low;
+	uint16_t long_sent;
+	uint16_t hold[16];      // ms each pressed pin has been held
+	db_ring_t q;            // filled in the tick, drained by debounce_get()
+} db_watch_t;
+
+static GPIO_TypeDef * const db_gpio[DB_PORTS] = { GPIOA, GPIOB, GPIOC };
+
+// Per port: debounced state and the three counter bit-planes
+static uint16_t db_state[DB_PORTS];
+static uint16_t db_c0[DB_PORTS], db_c1[DB_PORTS], db_c2[DB_PORTS];
+static uint8_t db_used;  // bitmask of ports with at least one watch
+
+static db_watch_t watches[DEBOUNCE_MAX_WATCH];
+static uint8_t nwatches;
+
+int debounce_watch(uint8_t port, uint16_t mask, uint16_t active_low) {
+	db_watch_t *w;
+
+	if (nwatches >= DEBOUNCE_MAX_WATCH || port >= DB_PORTS)
+		return -1;
+
+	w = &watches[nwatches];
+	w->port = port;
+	w->mask = mask;
+	w->active_low = active_low;
+	if (!(db_used & (1 << port)))
+		db_state[port] = db_gpio[port]->IDR;  // start from the current levels
+	db_used |= 1 << port;
+	return nwatches++;
+}
+
+int debounce_get(int id, db_event_t *ev) {
+	return db_ring_pop(&watches[id].q, ev);
+}
+
+uint16_t debounce_level(uint8_t port) {
+	return db_state[port];
+}
+
+static void db_push(db_watch_t *w, uint8_t pin, uint8_t type) {
+	db_event_t ev = { w->port, pin, type, DWT->CYCCNT };
+
+	db_ring_push(&w->q, &ev);  // dropped if the consumer is behind
+}
+
+static void db_events(db_watch_t *w, uint16_t toggled, uint16_t state) {
+	uint16_t pressed = (state ^ w->active_low) & w->mask;
+	uint16_t bits;
+
+	toggled &= w->mask;
+	while (toggled) {
+		uint8_t pin = __builtin_ctz(toggled);
+		toggled &= toggled - 1;
+		db_push(w, pin, (pressed & (1 << pin)) ? DB_PRESS : DB_RELEASE);
+		w->hold[pin] = 0;
+		w->long_sent &= ~(1 << pin);
+	}
+
+	// Only pins that are held down cost anything here
+	bits = pressed & ~w->long_sent;
+	while (bits) {
+		uint8_t pin = __builtin_ctz(bits);
+		bits &= bits - 1;
+		if (++w->hold[pin] >= DEBOUNCE_LONG_MS) {
+			db_push(w, pin, DB_LONG);
+			w->long_sent |= 1 << pin;
+		}
+	}
+}
+
+// A counter mid-count, or a pressed pin still timing its long press
+uint8_t debounce_busy(void) {
+	for (uint8_t p = 0; p < DB_PORTS; p++)
+		if (db_c0[p] | db_c1[p] | db_c2[p])
+			return 1;
+	for (uint8_t i = 0; i < nwatches; i++) {
+		db_watch_t *w = &watches[i];
+
+		if ((db_state[w->port] ^ w->active_low) & w->mask & ~w->long_sent)
+			return 1;
+	}
+	return 0;
+}
+
+void debounce_tick(void) {
+	for (uint8_t p = 0; p < DB_PORTS; p++) {
+		uint16_t delta, toggled;
+
+		if (!(db_used & (1 << p)))
+			continue;
+
+		// Count consecutive samples that disagree with the state; a pin
+		// flips when its counter wraps from 7, any agreeing sample clears it
+		delta = db_gpio[p]->IDR ^ db_state[p];
+		toggled = delta & db_c0[p] & db_c1[p] & db_c2[p];
+		db_c2[p] = (db_c2[p] ^ (db_c1[p] & db_c0[p])) & delta;
+		db_c1[p] = (db_c1[p] ^ db_c0[p]) & delta;
+		db_c0[p] = ~db_c0[p] & delta;
+		db_state[p] ^= toggled;
+
+		for (uint8_t i = 0; i < nwatches; i++)
+			if (watches[i].port == p)
+				db_events(&watches[i], toggled, db_state[p]);
+	}
+}
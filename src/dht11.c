@@ -0,0 +1,183 @@
+#include "stm32f4xx.h"
+#include "dht11.h"
+#include "clock.h"
+#include "board.h"
+#include "ring.h"
+#include "probe.h"
+
+#define DHT11_PORT PIN_PORT(DHT11)
+#define DHT11_PIN  DHT11_N
+
+#define DHT11_START_US   18000  // host start pulse
+#define DHT11_FRAME_US    6000  // response + 40 bits is ~5 ms worst case
+#define DHT11_BIT_ONE_US   100  // bit period is ~78 us for 0, ~120 us for 1
+
+enum { PH_IDLE, PH_START, PH_CAPTURE };
+
+static volatile uint8_t phase = PH_IDLE;
+static dht11_sample_t last = { DHT11_ERR, 0, 0 };  // main loop side
+
+// Finished reads, status and values travel together so they cannot tear
+RING_DEFINE(dht11_ring, dht11_sample_t, DHT11_QUEUE)
+static dht11_ring_t samples;
+static dht11_cb_t done_cb;
+static dht11_dec_t dec;
+
+void dht11_dec_reset(dht11_dec_t *d)
+{
+	d->last = 0;
+	d->edges = 0;
+	for (int i = 0; i < 5; i++)
+		d->d[i] = 0;
+}
+
+// Feed one falling-edge timestamp (us). Edge 0 is the sensor pulling the
+// line low, edge 1 ends the 80+80 us response, edges 2..41 each end a bit.
+int dht11_dec_edge(dht11_dec_t *d, uint32_t ts)
+{
+	uint32_t w = ts - d->last;
+	uint8_t n = d->edges++;
+
+	d->last = ts;
+	if (n == 0)
+		return DHT11_BUSY;
+	if (n == 1)
+		return (w >= 120 && w <= 200) ? DHT11_BUSY : DHT11_ERR;
+	if (w < 60 || w > 145)
+		return DHT11_ERR;
+
+	n -= 2;
+	if (w >= DHT11_BIT_ONE_US)
+		d->d[n >> 3] |= 0x80 >> (n & 7);
+	if (n < 39)
+		return DHT11_BUSY;
+
+	if ((uint8_t)(d->d[0] + d->d[1] + d->d[2] + d->d[3]) != d->d[4])
+		return DHT11_ERR_SUM;
+	return DHT11_OK;
+}
+
+// TIM2 sits on APB1; keep it at 1 tick per us whatever the clock profile
+static void dht11_clock_update(void)
+{
+	TIM2->PSC = clock_apb1_timer_hz() / 1000000 - 1;
+	TIM2->EGR = TIM_EGR_UG;
+}
+
+static void dht11_finish(int st)
+{
+	dht11_sample_t smp = { st, 0, 0 };
+
+	EXTI->IMR &= ~(1 << DHT11_PIN);
+	TIM2->DIER &= ~TIM_DIER_CC1IE;
+	if (st == DHT11_OK) {
+		smp.h = dec.d[0];
+		smp.t = dec.d[2];
+	}
+	dht11_ring_push(&samples, &smp);
+	probe_begin(PROBE_FAN_LAT);  // ends when climate_task acts on it
+	phase = PH_IDLE;
+	if (done_cb)
+		done_cb(st, smp.t, smp.h);
+}
+
+void dht11_init(dht11_cb_t cb)
+{
+	done_cb = cb;
+
+	RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+	RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+
+	// TIM2: 32-bit free-running counter at 1 MHz, CC1 used as a one-shot alarm
+	TIM2->ARR = 0xFFFFFFFF;
+	dht11_clock_update();
+	clock_on_change(dht11_clock_update);
+	TIM2->SR = 0;
+	TIM2->CR1 |= TIM_CR1_CEN;
+
+	// EXTI4 <- PA4, falling edge, masked until a read is in progress
+	SYSCFG->EXTICR[1] &= ~(0xF << 0);
+	EXTI->FTSR |= (1 << DHT11_PIN);
+	EXTI->RTSR &= ~(1 << DHT11_PIN);
+	EXTI->IMR &= ~(1 << DHT11_PIN);
+
+	NVIC_EnableIRQ(TIM2_IRQn);
+	NVIC_EnableIRQ(EXTI4_IRQn);
+}
+
+int dht11_start(void)
+{
+	if (phase != PH_IDLE)
+		return -1;
+
+	dht11_dec_reset(&dec);
+
+	// Drive the line low for the start pulse, TIM2 CC1 releases it
+	DHT11_PORT->BSRR = (1 << (DHT11_PIN + 16));
+	DHT11_PORT->MODER |= (1 << (DHT11_PIN * 2));
+	phase = PH_START;
+
+	TIM2->CCR1 = TIM2->CNT + DHT11_START_US;
+	TIM2->SR = ~TIM_SR_CC1IF;
+	TIM2->DIER |= TIM_DIER_CC1IE;
+	return 0;
+}
+
+int dht11_get(dht11_sample_t *smp)
+{
+	return dht11_ring_pop(&samples, smp);
+}
+
+int dht11_result(uint8_t *t, uint8_t *h)
+{
+	dht11_sample_t smp;
+	int got = 0;
+
+	while (dht11_get(&smp)) {
+		last = smp;
+		got = 1;
+	}
+	if (!got && phase != PH_IDLE)
+		return DHT11_BUSY;
+	if (last.status != DHT11_OK)
+		return last.status;
+	*t = last.t;
+	*h = last.h;
+	return DHT11_OK;
+}
+
+void TIM2_IRQHandler(void)
+{
+	if (!(TIM2->SR & TIM_SR_CC1IF))
+		return;
+	TIM2->SR = ~TIM_SR_CC1IF;
+
+	if (phase == PH_START) {
+		// Release the line and start listening for the sensor response
+		DHT11_PORT->BSRR = (1 << DHT11_PIN);
+		DHT11_PORT->MODER &= ~(3 << (DHT11_PIN * 2));
+		EXTI->PR = (1 << DHT11_PIN);
+		EXTI->IMR |= (1 << DHT11_PIN);
+		phase = PH_CAPTURE;
+		TIM2->CCR1 = TIM2->CNT + DHT11_FRAME_US;
+	} else if (phase == PH_CAPTURE) {
+		dht11_finish(DHT11_ERR);  // frame timed out
+	}
+}
+
+void EXTI4_IRQHandler(void)
+{
+	uint32_t ts = TIM2->CNT;
+	int st;
+
+	EXTI->PR = (1 << DHT11_PIN);
+	if (phase != PH_CAPTURE)
+		return;
+
+	// Only edges of a capture are timed, the early-out would leave it open
+	probe_begin(PROBE_DHT_EDGE);
+	st = dht11_dec_edge(&dec, ts);
+	if (st != DHT11_BUSY)
+		dht11_finish(st);
+	probe_end(PROBE_DHT_EDGE);
+}
@@ -1,135 +1,138 @@
 #include "stm32f4xx.h"
 #include "lcd.h"
-
-#define DHT11_PORT GPIOA
-#define DHT11_PIN  4
-#define MOTOR_PORT GPIOB
-#define MOTOR_PIN  0
-#define TEMP_THRESHOLD 20
-
-void DHT11_Out(void)
-{
-    DHT11_PORT->MODER &= ~(3 << 8);
-    DHT11_PORT->MODER |=  (1 << (DHT11_PIN * 2));
-}
-
-void DHT11_In(void)
-{
-    DHT11_PORT->MODER &= ~(3 << (DHT11_PIN * 2));
-    DHT11_PORT->PUPDR &= ~(3 << (DHT11_PIN * 2));
-    DHT11_PORT->PUPDR |=  (1 << (DHT11_PIN * 2));
-}
-
-void DHT11_Write(uint8_t x)
-{
-    if (x)
-        DHT11_PORT->BSRR = (1 << DHT11_PIN);
+#include "dht11.h"
+#include "app.h"
+#include "board.h"
+#include "telemetry.h"
+#include "pid.h"
+#include "tb6612.h"
+#include "probe.h"
+#include "fmt.h"
+#include "sched.h"
+#include <string.h>
+
+#define TEMP_SETPOINT 20   // deg C
+#define HUM_SETPOINT  70   // %RH
+#define DHT11_MISSES  3    // failed reads the fan holds its speed through
+#define FAN_RAMP_MS   200  // each new speed is eased in on TB6612 channel A
+
+// One controller per input, the fan runs at the larger demand. Gains are
+// per 2 s step. Without the motor driver there is only the on/off FAN pin,
+// so both run as hysteresis controllers.
+static pid_ctrl_t fan_temp = {
+    .kp = PID_Q16(0.1),       // 10% per C, the integrator does the rest
+    .ki = PID_Q16(0.01),
+    .kd = PID_Q16(0.1),
+    .d_alpha = PID_Q16(0.25), // DHT11 steps are 1 C, smooth them
+    .out_min = 0, .out_max = PID_ONE,
+    .rate = PID_Q16(0.1),     // 10% per step, no current surges
+    .hyst = PID_Q16(1),
+    .reverse = 1,
+};
+
+static pid_ctrl_t fan_hum = {
+    .kp = PID_Q16(0.02),      // 2% per %RH
+    .ki = PID_Q16(0.002),
+    .kd = PID_Q16(0.05),
+    .d_alpha = PID_Q16(0.25),
+    .out_min = 0, .out_max = PID_ONE,
+    .rate = PID_Q16(0.1),
+    .hyst = PID_Q16(3),
+    .reverse = 1,
+};
+
+static uint8_t misses;
+static int climate_id;
+static volatile uint8_t climate_ready;  // a read finished, set from the DHT11 ISRs
+
+static void fan_set(int32_t out) {
+    if (out)
+        PIN_SET(FAN);
     else
-        DHT11_PORT->BSRR = (1 << (DHT11_PIN + 16));
+        PIN_CLR(FAN);
+#if CONFIG_MOTOR
+    motor_set(MOTOR_A, ((int64_t)out * MOTOR_PWM_TOP) >> PID_Q, FAN_RAMP_MS);
+#endif
+    telem_set(TM_FAN, out != 0);
+    telem_set(TM_DUTY, ((int64_t)out * 1000) >> PID_Q);
 }
 
-uint8_t DHT11_Read(void) {
-    return (DHT11_PORT->IDR >> DHT11_PIN) & 0x01;
+// Runs in the EXTI4/TIM2 ISR that finished the read: the fan acts on the
+// fresh sample instead of waiting for the next 2 s release
+static void climate_done(int st, uint8_t t, uint8_t h) {
+    (void)st; (void)t; (void)h;
+    climate_ready = 1;
+    sched_once(climate_id, 0);
 }
 
-void delay_us(uint32_t us)
-{
-    SysTick->LOAD = (SystemCoreClock / 1000000) * us - 1; //15
-    SysTick->VAL = 0;
-    SysTick->CTRL = 5;
-    while (!(SysTick->CTRL & (1 << 16)));
-    SysTick->CTRL = 0;
-}
+void climate_init(int task) {
+    climate_id = task;
+    dht11_init(climate_done);
 
-void delay_ms(uint32_t ms) {
-    for (uint32_t i = 0; i < ms * 1000; i++) __NOP();
-}
-
-int dht11_read(uint8_t *t, uint8_t *h) {
-    uint8_t d[5] = {0};
-
-    DHT11_Out();
-    DHT11_Write(0);
-    delay_ms(18);
-    DHT11_Write(1);
-    delay_us(30);
-    DHT11_In();
-
-    delay_us(40);
-    if (DHT11_Read()) return -1;
-    delay_us(80);
-    if (!DHT11_Read()) return -1;
-    delay_us(80);
-
-    for (int i = 0; i < 5; i++) {
-        for (int j = 0; j < 8; j++) {
-            uint32_t tmo = 1000;
-            while (!DHT11_Read() && tmo--) delay_us(1);
-            delay_us(40);
-            if (DHT11_Read())
-                d[i] |= (1 << (7 - j));
-            tmo = 1000;
-            while (DHT11_Read() && tmo--) delay_us(1);
-        }
-    }
+    pid_reset(&fan_temp, 0);
+    pid_reset(&fan_hum, 0);
+#if !CONFIG_MOTOR
+    pid_set_mode(&fan_temp, PID_HYST);
+    pid_set_mode(&fan_hum, PID_HYST);
+#endif
 
-    if ((d[0] + d[1] + d[2] + d[3]) != d[4]) return -1;
-
-    *h = d[0];
-    *t = d[2];
-    return 0;
-}
-
-void motor_init(void) {
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
-    MOTOR_PORT->MODER &= ~(3 << (MOTOR_PIN * 2));
-    MOTOR_PORT->MODER |=  (1 << (MOTOR_PIN * 2));
-}
-
-void motor_on(void) {
-    MOTOR_PORT->BSRR = (1 << MOTOR_PIN);
-}
-
-void motor_off(void) {
-    MOTOR_PORT->BSRR = (1 << (MOTOR_PIN + 16));
+    // The read runs in the background and brings climate_task in when done
+    dht11_start();
 }
 
-int main(void) {
-    SystemCoreClockUpdate();
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOCEN;
-
-    motor_init();
-    lcd_gpio_init();
-    lcd_init();
-
+// Every 2 s starts a read, and runs again as soon as that read is in. The
+// early run moves the release, so the next read starts 2 s after this one.
+void climate_task(void) {
     uint8_t temp, hum;
+    int st;
+    int32_t out, h;
 
-    while (1) {
-        if (dht11_read(&temp, &hum) == 0) {
-            lcd(0x80, 0);
-            lcd_string("T:");
-            single_print(temp);
-            lcd_string("C H:");
-            single_print(hum);
-            lcd_string("%");
+    if (!climate_ready) {
+        probe_mark(PROBE_CLIMATE_PER);
+        dht11_start();
+        return;
+    }
+    climate_ready = 0;
+    st = dht11_result(&temp, &hum);
+
+    if (st == DHT11_OK) {
+        misses = 0;
+        telem_set(TM_TEMP, temp);
+        telem_set(TM_HUM, hum);
+        out = pid_step(&fan_temp, TEMP_SETPOINT << PID_Q, (int32_t)temp << PID_Q);
+        h = pid_step(&fan_hum, HUM_SETPOINT << PID_Q, (int32_t)hum << PID_Q);
+        fan_set(out > h ? out : h);
+        probe_end(PROBE_FAN_LAT);
+    } else if (++misses >= DHT11_MISSES) {
+        // Sensor gone: stop, and restart the loops from rest when it is back
+        misses = DHT11_MISSES;
+        pid_reset(&fan_temp, 0);
+        pid_reset(&fan_hum, 0);
+        fan_set(0);
+    }
 
-            lcd(0xC0, 0);
-            if (temp >= TEMP_THRESHOLD) {
-                lcd_string("Fan ON - Hot    ");
-                motor_on();
-            } else {
-                lcd_string("Fan OFF - Normal");
-                motor_off();
-            }
-        } else {
-            lcd(0x80, 0);
-            lcd_string("DHT11 Error     ");
-            lcd(0xC0, 0);
-            lcd_string("Check Wiring    ");
-            motor_off();
-        }
-        delay_ms(2000);
+#if CONFIG_ACCESS
+    // Access control has the panel while a code is being entered
+    if (access_busy())
+        return;
+#endif
+
+    if (st == DHT11_OK) {
+        char line[LCD_COLS + 1] = "T:0000C H:0000% ";
+        char fan[LCD_COLS + 1] = "Fan:0000% Normal";
+        int32_t duty = fan_temp.out > fan_hum.out ? fan_temp.out : fan_hum.out;
+
+        // Same 4-digit layout single_print() puts on the panel
+        fmt_u32(&line[2], temp, 4, FMT_ZERO);
+        fmt_u32(&line[10], hum, 4, FMT_ZERO);
+        fmt_u32(&fan[4], ((int64_t)duty * 100) >> PID_Q, 4, FMT_ZERO);
+        if (temp > TEMP_SETPOINT)
+            memcpy(&fan[10], "Hot   ", 6);
+        lcd_fb_puts(0, 0, line);
+        lcd_fb_puts(1, 0, fan);
+    } else {
+        lcd_fb_puts(0, 0, "DHT11 Error     ");
+        lcd_fb_puts(1, 0, "Check Wiring    ");
     }
+    lcd_fb_flush();
 }
-
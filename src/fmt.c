@@ -0,0 +1,103 @@
+#include "fmt.h"
+
+static const char pairs[200] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const uint32_t pow10_tab[10] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Sign, padding and body in the order the flags ask for
+static uint32_t emit(char *d, char sign, const char *body, uint32_t len, uint8_t width, uint8_t flags) {
+	uint32_t total = len + (sign != 0), pad = width > total ? width - total : 0;
+	char *p = d;
+
+	if (pad && !(flags & (FMT_LEFT | FMT_ZERO)))
+		for (; pad; pad--)
+			*p++ = ' ';
+	if (sign)
+		*p++ = sign;
+	if (pad && !(flags & FMT_LEFT))
+		for (; pad; pad--)
+			*p++ = '0';
+	while (len--)
+		*p++ = *body++;
+	for (; pad; pad--)
+		*p++ = ' ';
+	return p - d;
+}
+
+// Digits backwards from the end of a local buffer, two per step; v / 100
+// is v * ceil(2^37 / 100) >> 37, exact for every 32-bit v
+static uint32_t number(char *d, uint32_t v, uint8_t neg, uint8_t decimals, uint8_t width, uint8_t flags) {
+	char buf[FMT_MAX], *end = buf + sizeof(buf), *s = end;
+
+	while (v >= 100) {
+		uint32_t q = (uint32_t)(((uint64_t)v * 0x51EB851FU) >> 37);
+		uint32_t r = v - q * 100;
+
+		s -= 2;
+		s[0] = pairs[2 * r];
+		s[1] = pairs[2 * r + 1];
+		v = q;
+	}
+	if (v >= 10) {
+		s -= 2;
+		s[0] = pairs[2 * v];
+		s[1] = pairs[2 * v + 1];
+	} else {
+		*--s = '0' + v;
+	}
+	if (decimals) {
+		// At least one digit before the point, which the integer part
+		// moves left to make room for
+		while (end - s < decimals + 1)
+			*--s = '0';
+		for (char *p = s - 1; p < end - decimals - 1; p++)
+			p[0] = p[1];
+		s--;
+		end[-decimals - 1] = '.';
+	}
+	return emit(d, neg ? '-' : (flags & FMT_PLUS) ? '+' : 0, s, end - s, width, flags);
+}
+
+uint32_t fmt_u32(char *d, uint32_t v, uint8_t width, uint8_t flags) {
+	return number(d, v, 0, 0, width, flags);
+}
+
+uint32_t fmt_i32(char *d, int32_t v, uint8_t width, uint8_t flags) {
+	return number(d, v < 0 ? 0U - (uint32_t)v : (uint32_t)v, v < 0, 0, width, flags);
+}
+
+uint32_t fmt_fixed(char *d, int32_t v, uint8_t decimals, uint8_t width, uint8_t flags) {
+	if (decimals > 9)
+		decimals = 9;
+	return number(d, v < 0 ? 0U - (uint32_t)v : (uint32_t)v, v < 0, decimals, width, flags);
+}
+
+// Rounds half away from zero; a result past 32 bits saturates
+uint32_t fmt_q(char *d, int32_t v, uint8_t frac_bits, uint8_t decimals, uint8_t width, uint8_t flags) {
+	uint64_t mag = v < 0 ? 0U - (uint32_t)v : (uint32_t)v;
+
+	if (decimals > 9)
+		decimals = 9;
+	mag *= pow10_tab[decimals];
+	if (frac_bits)
+		mag = (mag + (1ULL << (frac_bits - 1))) >> frac_bits;
+	if (mag > 0xFFFFFFFFU)
+		mag = 0xFFFFFFFFU;
+	return number(d, (uint32_t)mag, v < 0 && mag, decimals, width, flags);
+}
+
+uint32_t fmt_hex(char *d, uint32_t v, uint8_t width, uint8_t flags) {
+	const char *hex = (flags & FMT_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+	char buf[8], *s = buf + sizeof(buf);
+
+	do {
+		*--s = hex[v & 15];
+		v >>= 4;
+	} while (v);
+	return emit(d, 0, s, buf + sizeof(buf) - s, width, flags);
+}
@@ -0,0 +1,153 @@
+#include "stm32f4xx.h"
+#include "keyscan.h"
+#include "swtimer.h"
+#include "board.h"
+#include "ring.h"
+
+#define ROW_PORT  PIN_PORT(KEY_ROW0)
+#define COL_PORT  PIN_PORT(KEY_COL0)
+#define ROW_SHIFT KEY_ROW0_N   // PB2..PB5
+#define COL_SHIFT KEY_COL0_N   // PA9..PA12
+#define ROW_MASK  (0xF << ROW_SHIFT)
+#define COL_MASK  (0xF << COL_SHIFT)
+
+static int scan_timer;
+static uint8_t scan_row;
+static uint16_t frame, prev_frame, keys;
+
+RING_DEFINE(key_ring, key_event_t, KEYSCAN_QUEUE)
+static key_ring_t q;
+
+static uint32_t ghost_frames;
+static uint32_t wake_cyc;         // CYCCNT at the column interrupt
+static uint8_t wake_pending;
+static uint32_t latency_max;
+
+static void q_push(uint8_t code, uint8_t type) {
+    key_event_t ev = { code, type };
+
+    key_ring_push(&q, &ev);  // dropped if the consumer is behind
+}
+
+int keyscan_get(key_event_t *ev) {
+    return key_ring_pop(&q, ev);
+}
+
+uint16_t keyscan_state(void) {
+    return keys;
+}
+
+void keyscan_stats(uint32_t *ghosts, uint32_t *latency_max_cycles) {
+    *ghosts = ghost_frames;
+    *latency_max_cycles = latency_max;
+}
+
+// Without diodes, two rows sharing two pressed columns make a rectangle
+// whose fourth corner may be a phantom key
+static uint8_t frame_ghosted(uint16_t f) {
+    for (int a = 0; a < 3; a++)
+        for (int b = a + 1; b < 4; b++) {
+            uint8_t both = (f >> (a * 4)) & (f >> (b * 4)) & 0xF;
+            if (both & (both - 1))
+                return 1;
+        }
+    return 0;
+}
+
+static void keyscan_idle(void) {
+    uint32_t primask = __get_PRIMASK();
+
+    swtimer_stop(scan_timer);
+    ROW_PORT->BSRR = ROW_MASK << 16;           // all rows low
+    EXTI->PR = COL_MASK;
+    __disable_irq();                        // IMR is shared with the DHT11 line
+    EXTI->IMR |= COL_MASK;
+    __set_PRIMASK(primask);
+    // A key that went down while unmasking would not produce an edge
+    if ((COL_PORT->IDR & COL_MASK) != COL_MASK)
+        EXTI->SWIER |= COL_MASK & ~COL_PORT->IDR;
+}
+
+static void keyscan_frame(uint16_t f) {
+    uint16_t changed;
+
+    if (f == prev_frame) {
+        changed = f ^ keys;
+        if (changed && frame_ghosted(f)) {
+            ghost_frames++;
+            changed &= keys;                // releases only
+        }
+        while (changed) {
+            uint8_t code = __builtin_ctz(changed);
+            changed &= changed - 1;
+            keys ^= 1 << code;
+            q_push(code, (keys & (1 << code)) ? KEY_PRESS : KEY_RELEASE);
+            if (wake_pending && (keys & (1 << code))) {
+                uint32_t lat = DWT->CYCCNT - wake_cyc;
+                if (lat > latency_max)
+                    latency_max = lat;
+                wake_pending = 0;
+            }
+        }
+    }
+    prev_frame = f;
+
+    if (!f && !keys)
+        keyscan_idle();
+}
+
+// 1 ms step: read the columns for the row driven last tick, drive the next
+static void keyscan_step(void *arg) {
+    uint16_t cols = (~COL_PORT->IDR & COL_MASK) >> COL_SHIFT;
+
+    (void)arg;
+    frame |= cols << (scan_row * 4);
+    scan_row = (scan_row + 1) & 3;
+    ROW_PORT->BSRR = (ROW_MASK & ~(1 << (scan_row + ROW_SHIFT))) | (1 << (scan_row + ROW_SHIFT + 16));
+    if (scan_row == 0) {
+        uint16_t f = frame;
+        frame = 0;
+        keyscan_frame(f);
+    }
+}
+
+static void keyscan_wake(void) {
+    EXTI->IMR &= ~COL_MASK;
+    EXTI->PR = COL_MASK;
+    if (swtimer_active(scan_timer))
+        return;
+
+    wake_cyc = DWT->CYCCNT;
+    wake_pending = 1;
+    scan_row = 0;
+    frame = 0;
+    prev_frame = 0xFFFF;                    // first frame is never accepted alone
+    ROW_PORT->BSRR = (ROW_MASK & ~(1 << ROW_SHIFT)) | (1 << (ROW_SHIFT + 16));
+    swtimer_start(scan_timer, 1, 1);
+}
+
+void EXTI9_5_IRQHandler(void) {
+    keyscan_wake();
+}
+
+void EXTI15_10_IRQHandler(void) {
+    keyscan_wake();
+}
+
+void keyscan_init(void) {
+    RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+    scan_timer = swtimer_create(keyscan_step, 0);
+
+    // EXTI9..12 <- port A, falling edge
+    SYSCFG->EXTICR[2] &= ~((0xF << 4) | (0xF << 8) | (0xF << 12));
+    SYSCFG->EXTICR[3] &= ~(0xF << 0);
+    EXTI->FTSR |= COL_MASK;
+    EXTI->RTSR &= ~COL_MASK;
+
+    // keyscan_wake() starts the scan timer, so no preempting the tick
+    NVIC_SetPriority(EXTI9_5_IRQn, SWTIMER_IRQ_PRIO);
+    NVIC_SetPriority(EXTI15_10_IRQn, SWTIMER_IRQ_PRIO);
+    NVIC_EnableIRQ(EXTI9_5_IRQn);
+    NVIC_EnableIRQ(EXTI15_10_IRQn);
+    keyscan_idle();
+}
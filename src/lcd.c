@@ -1,92 +1,140 @@
-#include <STM32F405xx.h>
+#include "stm32f4xx.h"
 #include "lcd.h"
+#include "clock.h"
+#include "ring.h"
+#include "fmt.h"
+#include "board.h"
+
+// BSRR words for the data bus, per port and indexed by nibble, built from
+// the LCD_D0..LCD_D7 pins in board.h. Each entry sets the 1 bits and
+// resets the 0 bits of the pins on that port, so one store per port
+// updates the bus; RS joins the store for its own port. Ports without an
+// LCD pin fold away, their tables are never referenced.
+#define LCD_BIT(name, port, v, b) (name##_P != (port) ? 0 : \
+	((v) & (1 << (b))) ? PIN_BIT(name) : PIN_BIT(name) << 16)
+#define LCD_LO(port, v) (LCD_BIT(LCD_D0, port, v, 0) | LCD_BIT(LCD_D1, port, v, 1) | \
+	LCD_BIT(LCD_D2, port, v, 2) | LCD_BIT(LCD_D3, port, v, 3))
+#define LCD_HI(port, v) (LCD_BIT(LCD_D4, port, v, 0) | LCD_BIT(LCD_D5, port, v, 1) | \
+	LCD_BIT(LCD_D6, port, v, 2) | LCD_BIT(LCD_D7, port, v, 3))
+#define LCD_LO_A(v) LCD_LO(0, v)
+#define LCD_LO_B(v) LCD_LO(1, v)
+#define LCD_LO_C(v) LCD_LO(2, v)
+#define LCD_HI_A(v) LCD_HI(0, v)
+#define LCD_HI_B(v) LCD_HI(1, v)
+#define LCD_HI_C(v) LCD_HI(2, v)
+#define LCD_NIBBLES(f) { f(0), f(1), f(2), f(3), f(4), f(5), f(6), f(7), \
+	f(8), f(9), f(10), f(11), f(12), f(13), f(14), f(15) }
+
+static const uint32_t lcd_lo[3][16] = { LCD_NIBBLES(LCD_LO_A), LCD_NIBBLES(LCD_LO_B), LCD_NIBBLES(LCD_LO_C) };
+static const uint32_t lcd_hi[3][16] = { LCD_NIBBLES(LCD_HI_A), LCD_NIBBLES(LCD_HI_B), LCD_NIBBLES(LCD_HI_C) };
+
+// Pins of the bus and RS on a port, constant so unused ports drop out
+#define LCD_ON(name, port) (name##_P == (port) ? PIN_BIT(name) : 0)
+#define LCD_BUS(port) (LCD_ON(LCD_D0, port) | LCD_ON(LCD_D1, port) | LCD_ON(LCD_D2, port) | \
+	LCD_ON(LCD_D3, port) | LCD_ON(LCD_D4, port) | LCD_ON(LCD_D5, port) | LCD_ON(LCD_D6, port) | \
+	LCD_ON(LCD_D7, port) | LCD_ON(LCD_RS, port))
+
+static void lcd_bus(uint16_t e){
+	uint32_t rs = (e & 0x100) ? PIN_BIT(LCD_RS) : PIN_BIT(LCD_RS) << 16;
+	uint8_t lo = e & 0x0F, hi = (e >> 4) & 0x0F;
+
+	if(LCD_BUS(0))
+		GPIOA->BSRR = lcd_lo[0][lo] | lcd_hi[0][hi] | (LCD_RS_P == 0 ? rs : 0);
+	if(LCD_BUS(1))
+		GPIOB->BSRR = lcd_lo[1][lo] | lcd_hi[1][hi] | (LCD_RS_P == 1 ? rs : 0);
+	if(LCD_BUS(2))
+		GPIOC->BSRR = lcd_lo[2][lo] | lcd_hi[2][hi] | (LCD_RS_P == 2 ? rs : 0);
+}
+
+// Transmit queue drained by the TIM6 ISR, one protocol step per tick:
+// RS and data, then EN high, then EN low, so RS is set up well before EN
+// rises (tAS). Entries are val | RS<<8. Only the main loop enqueues.
+#define LCD_Q_SIZE  64
+#define LCD_TICK_US 40  // >= 37 us execution time of most instructions
+#define LCD_CLR_TICKS 40 // clear/home need 1.52 ms
+#define LCD_POR_TICKS 1000 // 40 ms after power-on before the first command
+
+RING_DEFINE(lcd_ring, uint16_t, LCD_Q_SIZE)
+static lcd_ring_t lcd_q;
+static volatile uint8_t lcd_step;
+static volatile uint16_t lcd_wait;
+
+static void lcd_clock_update(void){
+	TIM6->PSC = clock_apb1_timer_hz() / 1000000 - 1; //1 MHz timer clock
+}
+
+static void lcd_timer_init(void){
+	RCC->APB1ENR |= RCC_APB1ENR_TIM6EN;
+	lcd_clock_update();
+	clock_on_change(lcd_clock_update);
+	TIM6->ARR = LCD_TICK_US - 1;
+	TIM6->DIER |= TIM_DIER_UIE;
+	lcd_wait = LCD_POR_TICKS;
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+}
+
+void lcd(uint8_t val, uint8_t cmd){
+	uint16_t e = val | (cmd ? 0x100 : 0);
+
+	while(!lcd_ring_push(&lcd_q, &e)); //queue full, wait for the ISR to make room
+	TIM6->CR1 |= TIM_CR1_CEN;
+}
+
+void lcd_flush_wait(void){
+	while(lcd_ring_count(&lcd_q) || lcd_step || lcd_wait);
+}
+
+void TIM6_DAC_IRQHandler(void){
+	uint16_t e;
 
-//GPIO initialize for lcd
-void lcd_gpio_init(void){
-	RCC->AHB1ENR = (0x07<<0);// enable the clock for Port A,B,C
-	GPIOA->MODER |=(5<<0); //PA0,1 as output
-	GPIOB->MODER |=(5<<24); //PB12,13 as output
-	GPIOB->MODER |=(5<<28); //PB14,15 as output
-	GPIOB->MODER |=(5<<0); //PB0,1 as output
-	GPIOC->MODER |=(5<<8); //PC4,5as output
+	TIM6->SR = 0;
+	if(lcd_wait){
+		lcd_wait--;
+		return;
+	}
+
+	// The entry stays queued until its EN pulse is done
+	if(!lcd_ring_peek(&lcd_q, &e)){
+		TIM6->CR1 &= ~TIM_CR1_CEN; //idle until the next lcd() call
+		return;
+	}
+	if(lcd_step == 0){
+		lcd_bus(e);
+		lcd_step = 1;
+	} else if(lcd_step == 1){
+		PIN_SET(LCD_EN);
+		lcd_step = 2;
+	} else {
+		PIN_CLR(LCD_EN); //the LCD latches on this edge
+		if(!(e & 0x100) && (e & 0xFF) <= 0x03)
+			lcd_wait = LCD_CLR_TICKS;
+		lcd_ring_drop(&lcd_q);
+		lcd_step = 0;
+	}
+}
+
+// Shadow framebuffer: fb_want is what the application asked for, fb_shown
+// is what the panel holds. Flush only sends the cells that differ.
+static char fb_want[LCD_ROWS][LCD_COLS];
+static char fb_shown[LCD_ROWS][LCD_COLS];
+static uint8_t fb_cursor = 0xFF; // DDRAM address, 0xFF = unknown
+
+static void lcd_fb_reset(void){
+	for(int r=0; r<LCD_ROWS; r++)
+		for(int c=0; c<LCD_COLS; c++){
+			fb_want[r][c] = ' ';
+			fb_shown[r][c] = ' ';
+		}
+	fb_cursor = 0x00;
 }
 
 void lcd_init(){
+	lcd_timer_init();
 	lcd(0x01,0);  //clear screen
 	lcd(0x38,0);  //2line
 	lcd(0x06,0); //increment cursor
 	lcd(0x0c,0); //display on and cursor off
-}
-
-void lcd(uint8_t val, uint8_t cmd){
-	uint8_t data;
-	//PC4
-	data = val&0x01;
-	if(data)
-		GPIOC->ODR |=(1<<4);
-	else
-		GPIOC->ODR &=~(1<<4);
-
-	//PC5
-	data =((val>>1)&0x01);
-	if(data)
-		GPIOC->ODR |=(1<<5);
-	else
-		GPIOC->ODR &=~(1<<5);
-
-	//PB0
-	data =((val>>2)&0x01);
-	if(data)
-		GPIOB->ODR |=(1<<0);
-	else
-		GPIOB->ODR &=~(1<<0);
-
-	//PB1
-	data =((val>>3)&0x01);
-	if(data)
-		GPIOB->ODR |=(1<<1);
-	else
-		GPIOB->ODR &=~(1<<1);
-
-	//PB12
-	data = ((val>>4)&0x01);
-	if(data)
-		GPIOB->ODR |= (1<<12);
-	else
-		GPIOB->ODR &=~(1<<12);
-
-	//PB13
-	data=((val>>5)&0x01);
-	if(data)
-		GPIOB->ODR |=(1<<13);
-	else
-		GPIOB->ODR &=~(1<<13);
-
-	//PB14
-	data =((val>>6)&0x01);
-	if(data)
-		GPIOB->ODR |=(1<<14);
-	else
-		GPIOB->ODR &=~(1<<14);
-
-	//PB15
-	data =((val>>7)&0x01);
-	if(data)
-		GPIOB->ODR |=(1<<15);
-	else
-		GPIOB->ODR &=~(1<<15);
-
-	//PA0 command RS
-	if(cmd)
-		GPIOA->ODR |=(1<<0);
-	else
-		GPIOA->ODR &=~(1<<0);
-
-	//PA1 EN
-	GPIOA->ODR |= (1<<1); // high
-	for(unsigned int i=0; i<16800; i++);
-	GPIOA->ODR &=~ (1<<1); // low
-	for(unsigned int i=0; i<16800; i++);
+	lcd_fb_reset(); //clear leaves spaces and the cursor at 0x00
 }
 
 void lcd_string(char *str){
@@ -99,19 +147,49 @@ void lcd_string(char *str){
 }
 
 void single_print(uint32_t val){
-	long int var=0;
-	unsigned char d1,d2,d3,d4=0;
-	 var=val;
-	 d1= var%10;
-	 var=var/10;
-	 d2=var%10;
-	 var=var/10;
-	 d3=var%10;
-	 d4=var/10;
-
-	 lcd(d4|0x30,1);
-	 lcd(d3|0x30,1);
-	 lcd(d2|0x30,1);
-	 lcd(d1|0x30,1);
+	char buf[FMT_MAX];
+	uint32_t n = fmt_u32(buf, val, 4, FMT_ZERO);
+
+	for(uint32_t i = 0; i < n; i++)
+		lcd(buf[i],1);
 }
 
+
+void lcd_fb_puts(uint8_t row, uint8_t col, const char *str){
+	if(row >= LCD_ROWS)
+		return;
+	while(col < LCD_COLS && *str)
+		fb_want[row][col++] = *str++;
+}
+
+// Nothing in fb_want is 0, lcd_fb_puts() stops at the terminator, so
+// every cell differs and the next flush redraws the whole panel
+void lcd_fb_invalidate(void){
+	for(int r=0; r<LCD_ROWS; r++)
+		for(int c=0; c<LCD_COLS; c++)
+			fb_shown[r][c] = 0;
+	fb_cursor = 0xFF;
+}
+
+void lcd_fb_flush(void){
+	for(uint8_t r=0; r<LCD_ROWS; r++){
+		for(uint8_t c=0; c<LCD_COLS; c++){
+			char ch = fb_want[r][c];
+			uint8_t addr;
+
+			if(ch == fb_shown[r][c])
+				continue;
+			addr = (r ? 0x40 : 0x00) + c;
+			if(fb_cursor != addr)
+				lcd(0x80 | addr, 0); //set DDRAM address only when not already there
+			lcd(ch, 1);
+			fb_shown[r][c] = ch;
+			fb_cursor = addr + 1;
+		}
+	}
+}
+
+// Place a string at an HD44780 DDRAM address (0x80 = line 1, 0xC0 = line 2)
+void lcd_print(uint8_t addr, const char *str){
+	lcd_fb_puts((addr & 0x40) ? 1 : 0, addr & 0x0F, str);
+}
@@ -1 +1,89 @@
+#include "stm32f4xx.h"
+#include <stdint.h>
+#include "sched.h"
+#include "app.h"
+#include "debounce.h"
+#include "board.h"
+#include "lcd.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "probe.h"
+#include "pool.h"
+#include "mem.h"
 
+#if CONFIG_RELAY
+static uint8_t relay_state = 0;
+static int button_watch;
+
+void relay_init(void) {
+    button_watch = debounce_watch(DB_PORT_B, PIN_BIT(BUTTON), PIN_BIT(BUTTON));
+}
+
+// Runs every 10 ms, the button is debounced in the tick
+void relay_task(void) {
+    db_event_t ev;
+
+    probe_mark(PROBE_RELAY_PER);
+    while (debounce_get(button_watch, &ev)) {
+        if (ev.type != DB_PRESS)
+            continue;
+
+        relay_state = !relay_state; // Toggle relay
+
+        if (relay_state) {
+            PIN_SET(RELAY);  // Relay ON (bulb ON)
+        } else {
+            PIN_CLR(RELAY);  // Relay OFF (bulb OFF)
+        }
+        probe_since(PROBE_RELAY_LAT, ev.stamp);
+        telem_set(TM_RELAY, relay_state);
+    }
+}
+#endif
+
+// Frames for whatever the modules reported since the last run
+static void telemetry_task(void) {
+    telem_poll(system_ticks, uart_write);
+}
+
+int main(void) {
+    mem_init();
+    SystemCoreClockUpdate();
+    probe_init();
+    pool_init();
+    board_init();
+    uart_init();
+    sched_init();
+
+    // The LCD is shared by climate and access, either one may be built alone
+#if CONFIG_CLIMATE || CONFIG_ACCESS
+    lcd_init();
+#endif
+
+    //        name       task          period delay prio
+#if CONFIG_RELAY
+    relay_init();
+    sched_add("relay",   relay_task,   10,    0,    0);
+#endif
+#if CONFIG_MOTOR
+    motor_app_init();
+#endif
+#if CONFIG_LIGHT
+    light_init();
+    sched_add("light",   light_task,   200,   0,    2);
+#endif
+#if CONFIG_CLIMATE
+    climate_init(sched_add("climate", climate_task, 2000, 2000, 3));
+#endif
+#if CONFIG_ACCESS
+    access_init();
+    sched_add("access",  access_task,  10,    5,    1);
+#endif
+    sched_add("telem",   telemetry_task, 1000, 500, 4);
+    sched_add("probe",   probe_task,   20,    0,    5);
+
+    // Everything from here on allocates from the pools, if at all
+    mem_heap_lock();
+
+    sched_run();
+}
@@ -0,0 +1,80 @@
+#include "pid.h"
+
+static int32_t sat(int64_t v, int64_t lo, int64_t hi)
+{
+	if (v < lo)
+		return lo;
+	if (v > hi)
+		return hi;
+	return v;
+}
+
+// Q16 x Q16, one SMULL on the M4
+static int32_t mulq(int32_t a, int32_t b)
+{
+	return sat(((int64_t)a * b) >> PID_Q, INT32_MIN, INT32_MAX);
+}
+
+void pid_reset(pid_ctrl_t *p, int32_t out)
+{
+	p->out = sat(out, p->out_min, p->out_max);
+	p->integ = p->out;
+	p->d = 0;
+	p->primed = 0;
+}
+
+// Leaving PID_HYST the integrator takes over the output where it stands
+void pid_set_mode(pid_ctrl_t *p, uint8_t mode)
+{
+	if (mode == PID_AUTO && p->mode != PID_AUTO) {
+		p->integ = p->out;
+		p->d = 0;
+	}
+	p->mode = mode;
+}
+
+int32_t pid_step(pid_ctrl_t *p, int32_t sp, int32_t meas)
+{
+	int32_t e = sat((int64_t)sp - meas, INT32_MIN + 1, INT32_MAX);
+	int32_t dm = p->primed ? sat((int64_t)meas - p->prev, INT32_MIN + 1, INT32_MAX) : 0;
+	int32_t lo = p->out_min, hi = p->out_max, d_raw, i;
+	int64_t pd, acc;
+
+	if (p->reverse) {
+		e = -e;
+		dm = -dm;
+	}
+	p->prev = meas;
+	p->primed = 1;
+
+	if (p->mode == PID_HYST) {
+		if (e > p->hyst)
+			p->out = hi;
+		else if (e < -p->hyst)
+			p->out = lo;
+		return p->out;
+	}
+
+	// Derivative of the error is minus that of the measurement
+	d_raw = mulq(-p->kd, dm);
+	p->d += mulq(sat((int64_t)d_raw - p->d, INT32_MIN, INT32_MAX), p->d_alpha);
+
+	if (p->rate) {
+		lo = sat((int64_t)p->out - p->rate, p->out_min, p->out_max);
+		hi = sat((int64_t)p->out + p->rate, p->out_min, p->out_max);
+	}
+
+	pd = (int64_t)mulq(p->kp, e) + p->d;
+	i = sat((int64_t)p->integ + mulq(p->ki, e), p->out_min, p->out_max);
+	acc = pd + i;
+
+	// Hold the integrator while the output is pinned in the direction the
+	// error pushes, by saturation or by the rate limit
+	if ((acc > hi && e > 0) || (acc < lo && e < 0))
+		acc = pd + p->integ;
+	else
+		p->integ = i;
+
+	p->out = sat(acc, lo, hi);
+	return p->out;
+}
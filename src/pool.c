@@ -0,0 +1,187 @@
+#include "stm32f4xx.h"
+#include "pool.h"
+#include <string.h>
+
+typedef struct pool_block {
+	struct pool_block *next;
+} pool_block_t;
+
+typedef struct {
+	uint8_t *mem;
+	pool_block_t *free;
+	pool_stats_t st;
+} pool_class_t;
+
+#define POOL_MEM(size, n) \
+	_Static_assert((size) % 8 == 0, "pool block size must be a multiple of 8"); \
+	static uint8_t pool_mem_##size[(size) * (n)] __attribute__((aligned(8)));
+POOL_CLASSES(POOL_MEM)
+
+#define POOL_CLASS(size, n) { pool_mem_##size, 0, { size, n, 0, 0, 0 } },
+static pool_class_t classes[POOL_NUM_CLASSES] = { POOL_CLASSES(POOL_CLASS) };
+static uint8_t ready;
+
+void pool_init(void) {
+	for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+		pool_class_t *k = &classes[c];
+
+		k->free = 0;
+		for (int i = k->st.blocks - 1; i >= 0; i--) {
+			pool_block_t *b = (pool_block_t *)(k->mem + i * k->st.size);
+
+			b->next = k->free;
+			k->free = b;
+		}
+		k->st.used = k->st.max = 0;
+		k->st.fails = 0;
+	}
+	ready = 1;
+}
+
+void *pool_alloc(uint32_t size) {
+	int c = 0, want;
+	pool_block_t *b;
+
+	if (!ready)
+		pool_init();
+	while (c < POOL_NUM_CLASSES - 1 && classes[c].st.size < size)
+		c++;
+	if (classes[c].st.size < size) {
+		classes[c].st.fails++;  // larger than any block
+		return 0;
+	}
+	for (want = c; c < POOL_NUM_CLASSES && !classes[c].free; c++);
+	if (c == POOL_NUM_CLASSES) {
+		classes[want].st.fails++;
+		return 0;
+	}
+	b = classes[c].free;
+	classes[c].free = b->next;
+	if (++classes[c].st.used > classes[c].st.max)
+		classes[c].st.max = classes[c].st.used;
+	return b;
+}
+
+static pool_class_t *pool_owner(const void *p) {
+	for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+		pool_class_t *k = &classes[c];
+		uint32_t off = (const uint8_t *)p - k->mem;
+
+		if ((const uint8_t *)p >= k->mem && off < (uint32_t)k->st.size * k->st.blocks)
+			return off % k->st.size ? 0 : k;
+	}
+	return 0;
+}
+
+// Anything that is not a block start is ignored, like free(NULL)
+void pool_free(void *p) {
+	pool_class_t *k = pool_owner(p);
+	pool_block_t *b = p;
+
+	if (!k)
+		return;
+	b->next = k->free;
+	k->free = b;
+	k->st.used--;
+}
+
+void *pool_alloc_isr(uint32_t size) {
+	uint32_t primask = __get_PRIMASK();
+	void *p;
+
+	__disable_irq();
+	p = pool_alloc(size);
+	__set_PRIMASK(primask);
+	return p;
+}
+
+void pool_free_isr(void *p) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	pool_free(p);
+	__set_PRIMASK(primask);
+}
+
+uint32_t pool_block_size(const void *p) {
+	pool_class_t *k = pool_owner(p);
+
+	return k ? k->st.size : 0;
+}
+
+int pool_stats(int cls, pool_stats_t *s) {
+	uint32_t primask = __get_PRIMASK();
+
+	if (cls < 0 || cls >= POOL_NUM_CLASSES)
+		return 0;
+	__disable_irq();
+	*s = classes[cls].st;
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+#if POOL_MALLOC && !defined(HOST_BUILD)
+#include <errno.h>
+#include <reent.h>
+#include <stdlib.h>
+
+// newlib calls the _r forms internally, user code the plain ones
+void *_malloc_r(struct _reent *r, size_t n) {
+	void *p = pool_alloc_isr(n);
+
+	if (!p)
+		r->_errno = ENOMEM;
+	return p;
+}
+
+void _free_r(struct _reent *r, void *p) {
+	pool_free_isr(p);
+}
+
+void *_calloc_r(struct _reent *r, size_t n, size_t size) {
+	void *p;
+
+	if (size && n > 0xFFFFFFFFU / size) {
+		r->_errno = ENOMEM;
+		return 0;
+	}
+	if ((p = _malloc_r(r, n * size)))
+		memset(p, 0, n * size);
+	return p;
+}
+
+void *_realloc_r(struct _reent *r, void *p, size_t n) {
+	uint32_t have = pool_block_size(p);
+	void *q;
+
+	if (!p)
+		return _malloc_r(r, n);
+	if (!n) {
+		_free_r(r, p);
+		return 0;
+	}
+	if (n <= have)
+		return p;
+	if ((q = _malloc_r(r, n))) {
+		memcpy(q, p, have);
+		_free_r(r, p);
+	}
+	return q;
+}
+
+void *malloc(size_t n) {
+	return _malloc_r(_REENT, n);
+}
+
+void free(void *p) {
+	_free_r(_REENT, p);
+}
+
+void *calloc(size_t n, size_t size) {
+	return _calloc_r(_REENT, n, size);
+}
+
+void *realloc(void *p, size_t n) {
+	return _realloc_r(_REENT, p, n);
+}
+#endif
@@ -0,0 +1,219 @@
+#include "stm32f4xx.h"
+#include "probe.h"
+#include "uart.h"
+#include "pool.h"
+#include "mem.h"
+#include "fmt.h"
+#include <string.h>
+
+#define CMD_MAX 16
+
+probe_t probes[PROBE_COUNT];
+
+#define PROBE_NAME(id, name) name,
+static const char *const names[PROBE_COUNT] = { PROBE_LIST(PROBE_NAME) };
+
+static char cmd[CMD_MAX];
+static uint8_t cmd_len;
+static int8_t report_at = -1;  // next line: 0 header, 1.. probes or pools, -1 idle
+static uint8_t report_reset;
+static uint8_t report_mem;     // "mem": heap and stack, then one line per pool
+static char line[PROBE_LINE];
+static uint32_t line_len;      // formatted, not yet sent
+
+static void probe_clear(probe_t *p) {
+	memset(p, 0, sizeof(*p));
+	p->min = 0xFFFFFFFF;
+}
+
+void probe_init(void) {
+	for (int i = 0; i < PROBE_COUNT; i++)
+		probe_clear(&probes[i]);
+}
+
+const char *probe_name(int id) {
+	return names[id];
+}
+
+// An open interval or mark survives the reset, so the next record is whole
+void probe_snapshot(int id, probe_t *out, uint8_t reset) {
+	uint32_t primask = __get_PRIMASK();
+	probe_t *p = &probes[id];
+
+	__disable_irq();
+	*out = *p;
+	if (reset) {
+		uint32_t start = p->start;
+		uint8_t open = p->open;
+
+		probe_clear(p);
+		p->start = start;
+		p->open = open;
+	}
+	__set_PRIMASK(primask);
+}
+
+uint32_t probe_p99(const probe_t *p) {
+	uint32_t need = p->count - p->count / 100, seen = 0;
+
+	for (int b = 0; b < PROBE_BUCKETS; b++) {
+		seen += p->hist[b];
+		if (seen >= need) {
+			uint32_t top = b == 31 ? 0xFFFFFFFF : (2UL << b) - 1;
+
+			return top < p->max ? top : p->max;
+		}
+	}
+	return p->max;
+}
+
+// Report
+
+static char *put_str(char *d, const char *s) {
+	while (*s)
+		*d++ = *s++;
+	return d;
+}
+
+static char *put_u32(char *d, uint32_t v) {
+	return d + fmt_u32(d, v, 0, 0);
+}
+
+// SWO leaves on PB3 as TRACESWO (AF0), which board.h gives to KEY_ROW1:
+// a debugger can enable ITM and still see nothing. ITM is only used while
+// PB3 is left in AF0.
+#define SWO_PIN 3
+
+static uint8_t itm_on(void) {
+	return (CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (ITM->TCR & ITM_TCR_ITMENA_Msk) &&
+	       (ITM->TER & (1UL << PROBE_ITM_PORT)) &&
+	       ((GPIOB->MODER >> (SWO_PIN * 2)) & 3) == 2 && !((GPIOB->AFR[0] >> (SWO_PIN * 4)) & 0xF);
+}
+
+// 0 if the UART has no room for the whole line yet
+static int probe_out(const char *s, uint32_t n) {
+	char *d;
+
+	if (itm_on()) {
+		while (n--) {
+			while (!ITM->PORT[PROBE_ITM_PORT].u32);
+			ITM->PORT[PROBE_ITM_PORT].u8 = *s++;
+		}
+		return 1;
+	}
+	if (!(d = uart_tx_reserve(n + 1)))
+		return 0;
+	memcpy(d, s, n);
+	d[n] = 0;
+	uart_tx_commit();
+	return 1;
+}
+
+static uint32_t mem_format(int at) {
+	char *d = line;
+	mem_stats_t m;
+	pool_stats_t s;
+
+	if (at == 0) {
+		mem_stats(&m);
+		d = put_str(d, "# mem heap ");
+		d = put_u32(d, m.heap_used);
+		d = put_str(d, " max ");
+		d = put_u32(d, m.heap_max);
+		d = put_str(d, " stack ");
+		d = put_u32(d, m.stack_used);
+		*d++ = '/';
+		d = put_u32(d, m.stack_size);
+		d = put_str(d, " free ");
+		d = put_u32(d, m.free);
+		d = put_str(d, " sbrk_locked ");
+		d = put_u32(d, m.sbrk_locked);
+		*d++ = '\n';
+		return d - line;
+	}
+	pool_stats(at - 1, &s);
+	d = put_str(d, "# pool ");
+	d = put_u32(d, s.size);
+	d = put_str(d, " used ");
+	d = put_u32(d, s.used);
+	d = put_str(d, " max ");
+	d = put_u32(d, s.max);
+	*d++ = '/';
+	d = put_u32(d, s.blocks);
+	d = put_str(d, " fails ");
+	d = put_u32(d, s.fails);
+	*d++ = '\n';
+	return d - line;
+}
+
+static uint32_t probe_format(int at) {
+	char *d = line;
+	probe_t p;
+
+	if (report_mem)
+		return mem_format(at);
+	if (at == 0) {
+		d = put_str(d, "# probe count min p99 max, cycles at ");
+		d = put_u32(d, SystemCoreClock / 1000000);
+		d = put_str(d, " MHz | log2 bucket:count\n");
+		return d - line;
+	}
+	probe_snapshot(at - 1, &p, report_reset);
+	d = put_str(d, "# ");
+	d = put_str(d, names[at - 1]);
+	*d++ = ' ';
+	d = put_u32(d, p.count);
+	*d++ = ' ';
+	d = put_u32(d, p.count ? p.min : 0);
+	*d++ = ' ';
+	d = put_u32(d, p.count ? probe_p99(&p) : 0);
+	*d++ = ' ';
+	d = put_u32(d, p.max);
+	*d++ = ' ';
+	*d++ = '|';
+	for (int b = 0; b < PROBE_BUCKETS; b++) {
+		if (!p.hist[b])
+			continue;
+		*d++ = ' ';
+		d = put_u32(d, b);
+		*d++ = ':';
+		d = put_u32(d, p.hist[b]);
+	}
+	*d++ = '\n';
+	return d - line;
+}
+
+static void probe_command(void) {
+	cmd[cmd_len] = 0;
+	if (!strcmp(cmd, "probe") || !strcmp(cmd, "probe reset")) {
+		report_reset = cmd[5] != 0;
+		report_mem = 0;
+		report_at = 0;
+	} else if (!strcmp(cmd, "mem")) {
+		report_mem = 1;
+		report_at = 0;
+	}
+	cmd_len = 0;
+}
+
+// One line per run keeps each write inside a UART buffer. A line that
+// does not fit yet is kept for the next run, so a reset snapshot is never lost.
+void probe_task(void) {
+	char c;
+
+	while (report_at < 0 && uart_read(&c, 1)) {
+		if (c == '\r' || c == '\n')
+			probe_command();
+		else if (cmd_len < CMD_MAX - 1)
+			cmd[cmd_len++] = c;
+	}
+	if (report_at < 0)
+		return;
+	if (!line_len)
+		line_len = probe_format(report_at);
+	if (!probe_out(line, line_len))
+		return;
+	line_len = 0;
+	if (++report_at > (report_mem ? POOL_NUM_CLASSES : PROBE_COUNT))
+		report_at = -1;
+}
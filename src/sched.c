@@ -0,0 +1,251 @@
+#include "stm32f4xx.h"
+#include "sched.h"
+#include "swtimer.h"
+#include "timebase.h"
+#include "clock.h"
+#include "debounce.h"
+#include "probe.h"
+
+volatile uint32_t system_ticks = 0;
+
+static sched_task_t tasks[SCHED_MAX_TASKS];
+static uint8_t ntasks;
+
+static uint32_t tick_cycles;   // SysTick reload for one 1 ms tick
+
+// Time spent in WFI, in CPU cycles of the profile it was spent in
+static uint64_t sleep_cycles[CLOCK_PROFILES];
+static uint32_t profile_hz[CLOCK_PROFILES];
+
+static void sched_tick(void) {
+    system_ticks++;
+    time_now_cycles();  // keeps the 64-bit cycle count across CYCCNT wraps
+    swtimer_tick();
+}
+
+// The debouncer needs one real IDR sample per tick, so it only runs here
+// and never for the ticks sched_idle() replays after a long sleep
+void SysTick_Handler(void) {
+    probe_begin(PROBE_SYSTICK);
+    sched_tick();
+    debounce_tick();
+    probe_end(PROBE_SYSTICK);
+}
+
+// Restart SysTick, stopped at DWT cycle stop, with the count that was left
+// in it less the cycles it missed; tick_cycles per reload after that
+static void systick_restart(uint32_t count, uint32_t stop) {
+    uint32_t lost = DWT->CYCCNT - stop;
+
+    count = count > lost + 2 ? count - lost : 2;
+    SysTick->LOAD = count - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = tick_cycles - 1;
+}
+
+// New core clock: rebase the timebase and keep SysTick at 1 ms. The part
+// of the current tick still to run carries over, scaled to the new clock.
+static void sched_clock_update(void) {
+    uint32_t old = tick_cycles, stop;
+    uint64_t val;
+
+    timebase_clock_changed();
+    tick_cycles = SystemCoreClock / 1000;
+    profile_hz[clock_profile()] = SystemCoreClock;
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    stop = DWT->CYCCNT;
+    val = (uint64_t)SysTick->VAL * tick_cycles / old;
+    systick_restart(val, stop);
+}
+
+void sched_init(void) {
+    timebase_init();  // DWT cycle counter for execution time measurement
+    tick_cycles = SystemCoreClock / 1000;
+    profile_hz[clock_profile()] = SystemCoreClock;
+    SysTick_Config(tick_cycles);
+    clock_on_change(sched_clock_update);
+}
+
+int sched_add(const char *name, task_fn_t fn, uint32_t period, uint32_t delay, uint8_t prio) {
+    sched_task_t *t;
+
+    if (ntasks >= SCHED_MAX_TASKS)
+        return -1;
+
+    t = &tasks[ntasks];
+    t->name = name;
+    t->fn = fn;
+    t->period = period;
+    t->deadline = period ? period : 1;
+    t->release = system_ticks + delay;
+    t->prio = prio;
+    t->active = 1;
+    return ntasks++;
+}
+
+// (Re)arm a task to run once after delay ms, periodic tasks resume their period
+void sched_once(int id, uint32_t delay) {
+    tasks[id].release = system_ticks + delay;
+    tasks[id].active = 1;
+}
+
+void sched_stop(int id) {
+    tasks[id].active = 0;
+}
+
+const sched_task_t *sched_get(int id) {
+    return (id >= 0 && id < ntasks) ? &tasks[id] : 0;
+}
+
+static sched_task_t *sched_pick(uint32_t now) {
+    sched_task_t *best = 0;
+
+    for (int i = 0; i < ntasks; i++) {
+        sched_task_t *t = &tasks[i];
+        if (!t->active || (int32_t)(now - t->release) < 0)
+            continue;
+        if (!best || t->prio < best->prio)
+            best = t;
+    }
+    return best;
+}
+
+static void sched_dispatch(sched_task_t *t) {
+    uint32_t rel = t->release;
+    uint32_t start, cycles, late;
+
+    start = DWT->CYCCNT;
+    t->fn();
+    cycles = DWT->CYCCNT - start;
+
+    t->runs++;
+    if (cycles > t->wcet)
+        t->wcet = cycles;
+
+    late = system_ticks - (rel + t->deadline);
+    if ((int32_t)late > 0) {
+        t->overruns++;
+        if (late > t->late_max)
+            t->late_max = late;
+    }
+
+    if (t->period == 0) {
+        if (t->release == rel)  // not re-armed from inside the task
+            t->active = 0;
+        return;
+    }
+    // Keep the release grid; if a whole period was missed, resync to now
+    t->release += t->period;
+    if ((int32_t)(system_ticks - t->release) >= (int32_t)t->period)
+        t->release = system_ticks + t->period;
+}
+
+// Ticks until the next task release or software timer, 0 if one is due.
+// While an input is bouncing or held the debouncer needs every tick.
+static uint32_t sched_next_event(void) {
+    uint32_t next = debounce_busy() ? 1 : swtimer_next();
+
+    for (int i = 0; i < ntasks; i++) {
+        int32_t d = (int32_t)(tasks[i].release - system_ticks);
+        if (!tasks[i].active)
+            continue;
+        if (d <= 0)
+            return 0;
+        if ((uint32_t)d < next)
+            next = d;
+    }
+    return next;
+}
+
+// Tickless idle: stretch the SysTick period up to the next event, sleep in
+// WFI, then account for the ticks that elapsed and restore the 1 ms period.
+// Any other interrupt ends the sleep early. While SysTick is stopped to be
+// reprogrammed the DWT counter keeps time, and those cycles come off the
+// count it restarts with.
+static void sched_idle(void) {
+    uint32_t max = 0xFFFFFF / tick_cycles;
+    uint32_t ms, val, reload, elapsed, remain, ticks, ctrl, cyc, stop;
+
+    __disable_irq();
+    ms = sched_next_event();
+    if (ms == 0) {
+        __enable_irq();
+        return;
+    }
+    if (ms > max)
+        ms = max;
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    stop = DWT->CYCCNT;
+    val = SysTick->VAL;  // cycles left in the current tick
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) || val < 64) {
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        __enable_irq();
+        return;
+    }
+
+    reload = val + (ms - 1) * tick_cycles;
+    reload -= DWT->CYCCNT - stop;
+    SysTick->LOAD = reload - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+    cyc = DWT->CYCCNT;
+    __DSB();
+    __WFI();
+    __ISB();
+    cyc = DWT->CYCCNT - cyc;
+
+    ctrl = SysTick->CTRL;  // reading clears COUNTFLAG
+    SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+    stop = DWT->CYCCNT;
+    if (ctrl & SysTick_CTRL_COUNTFLAG_Msk) {
+        // Slept to the end; the pending SysTick supplies the last tick
+        elapsed = reload;
+        ticks = ms - 1;
+        remain = tick_cycles;
+    } else {
+        elapsed = reload - 1 - SysTick->VAL;
+        if (elapsed < val) {
+            ticks = 0;
+            remain = val - elapsed;
+        } else {
+            ticks = 1 + (elapsed - val) / tick_cycles;
+            remain = tick_cycles - (elapsed - val) % tick_cycles;
+        }
+    }
+
+    // Finish the current tick, then drop back to the normal reload
+    systick_restart(remain, stop);
+
+    while (ticks--)
+        sched_tick();
+    sleep_cycles[clock_profile()] += elapsed;
+    if (elapsed > cyc)
+        timebase_credit(elapsed - cyc);  // CYCCNT may stop while the core sleeps
+    __enable_irq();
+}
+
+void sched_sleep_stats(uint32_t *asleep_ms, uint32_t *total_ms) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *asleep_ms = 0;
+    for (int p = 0; p < CLOCK_PROFILES; p++)
+        if (profile_hz[p])
+            *asleep_ms += sleep_cycles[p] / (profile_hz[p] / 1000);
+    *total_ms = system_ticks;
+    __set_PRIMASK(primask);
+}
+
+void sched_run(void) {
+    while (1) {
+        sched_task_t *t = sched_pick(system_ticks);
+        if (t)
+            sched_dispatch(t);
+        else
+            sched_idle();
+    }
+}
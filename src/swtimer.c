@@ -0,0 +1,164 @@
+#include "stm32f4xx.h"
+#include "swtimer.h"
+
+#define WHEEL_BITS  6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define NIL         (-1)
+
+typedef struct {
+    uint32_t expires;
+    uint32_t period;
+    swtimer_cb_t cb;
+    void *arg;
+    int16_t prev, next;
+    int16_t slot;       // list the node is on, NIL when stopped
+} swtimer_t;
+
+static swtimer_t timers[SWTIMER_MAX];
+static int16_t wheel[WHEEL_LEVELS * WHEEL_SLOTS];
+static uint16_t ntimers;
+static uint8_t wheel_ready;
+static uint32_t wheel_now;
+
+static void wheel_init(void) {
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+        wheel[i] = NIL;
+    wheel_ready = 1;
+}
+
+static void node_link(int16_t id, int16_t slot) {
+    swtimer_t *t = &timers[id];
+
+    t->slot = slot;
+    t->prev = NIL;
+    t->next = wheel[slot];
+    if (t->next != NIL)
+        timers[t->next].prev = id;
+    wheel[slot] = id;
+}
+
+static void node_unlink(int16_t id) {
+    swtimer_t *t = &timers[id];
+
+    if (t->prev != NIL)
+        timers[t->prev].next = t->next;
+    else
+        wheel[t->slot] = t->next;
+    if (t->next != NIL)
+        timers[t->next].prev = t->prev;
+    t->slot = NIL;
+}
+
+// Pick the level from the distance to expiry, the slot from the absolute time
+static void node_add(int16_t id) {
+    uint32_t exp = timers[id].expires;
+    uint32_t delta = exp - wheel_now;
+    int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= (1UL << (WHEEL_BITS * (level + 1))))
+        level++;
+    node_link(id, level * WHEEL_SLOTS + ((exp >> (WHEEL_BITS * level)) & WHEEL_MASK));
+}
+
+int swtimer_create(swtimer_cb_t cb, void *arg) {
+    swtimer_t *t;
+
+    if (!wheel_ready)
+        wheel_init();
+    if (ntimers >= SWTIMER_MAX)
+        return -1;
+
+    t = &timers[ntimers];
+    t->cb = cb;
+    t->arg = arg;
+    t->slot = NIL;
+    return ntimers++;
+}
+
+void swtimer_start(int id, uint32_t ms, uint32_t period) {
+    uint32_t primask = __get_PRIMASK();
+
+    if (ms == 0)
+        ms = 1;  // the current slot has already been processed
+    if (ms > SWTIMER_MAX_MS)
+        ms = SWTIMER_MAX_MS;
+    if (period > SWTIMER_MAX_MS)
+        period = SWTIMER_MAX_MS;  // swtimer_tick() re-arms with it unchecked
+
+    __disable_irq();
+    if (timers[id].slot != NIL)
+        node_unlink(id);
+    timers[id].expires = wheel_now + ms;
+    timers[id].period = period;
+    node_add(id);
+    __set_PRIMASK(primask);
+}
+
+void swtimer_stop(int id) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (timers[id].slot != NIL)
+        node_unlink(id);
+    __set_PRIMASK(primask);
+}
+
+uint8_t swtimer_active(int id) {
+    return timers[id].slot != NIL;
+}
+
+// Move every timer of a higher-level slot down to where it now belongs
+static void wheel_cascade(int level) {
+    int16_t slot = level * WHEEL_SLOTS + ((wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    while (wheel[slot] != NIL) {
+        int16_t id = wheel[slot];
+        node_unlink(id);
+        node_add(id);
+    }
+}
+
+// Distance to the next non-empty level-0 slot or the next cascade, whichever
+// is first. Used by the idle loop, not the tick, so the scan is allowed here.
+uint32_t swtimer_next(void) {
+    uint32_t d;
+
+    if (!wheel_ready)
+        return WHEEL_SLOTS;
+    for (d = 1; d < WHEEL_SLOTS; d++) {
+        uint32_t slot = (wheel_now + d) & WHEEL_MASK;
+        if (slot == 0 || wheel[slot] != NIL)
+            break;
+    }
+    return d;
+}
+
+// Called from SysTick_Handler once per millisecond
+void swtimer_tick(void) {
+    int16_t slot;
+
+    if (!wheel_ready)
+        return;
+
+    wheel_now++;
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if (wheel_now & ((1UL << (WHEEL_BITS * level)) - 1))
+            break;
+        wheel_cascade(level);
+    }
+
+    slot = wheel_now & WHEEL_MASK;
+    while (wheel[slot] != NIL) {
+        int16_t id = wheel[slot];
+        swtimer_t *t = &timers[id];
+
+        node_unlink(id);
+        if (t->period) {
+            t->expires += t->period;
+            node_add(id);
+        }
+        t->cb(t->arg);
+    }
+}
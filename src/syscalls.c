@@ -29,11 +29,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
-
-
-/* Variables */
-extern int __io_putchar(int ch) __attribute__((weak));
-extern int __io_getchar(void) __attribute__((weak));
+#include "uart.h"
 
 
 char *__env[1] = { 0 };
@@ -64,27 +60,29 @@ void _exit (int status)
   while (1) {}    /* Make sure we hang here */
 }
 
+/* Blocks until at least one byte has arrived on the console */
 __attribute__((weak)) int _read(int file, char *ptr, int len)
 {
   (void)file;
-  int DataIdx;
+  int n;
 
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
+  while ((n = uart_read(ptr, len)) == 0)
   {
-    *ptr++ = __io_getchar();
   }
-
-  return len;
+  return n;
 }
 
+/* stdout is queued for the UART DMA; stderr is for fatal logs and is sent
+ * polled, after anything already queued */
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
-  (void)file;
-  int DataIdx;
-
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
+  if (file == 2)
+  {
+    uart_write_blocking(ptr, len);
+  }
+  else
   {
-    __io_putchar(*ptr++);
+    uart_write(ptr, len);  /* what does not fit is dropped and counted */
   }
   return len;
 }
@@ -23,12 +23,21 @@
 /* Includes */
 #include <errno.h>
 #include <stdint.h>
+#include "stm32f4xx.h"
+#include "mem.h"
+#include "uart.h"
 
 /**
  * Pointer to the current high watermark of the heap usage
  */
 static uint8_t *__sbrk_heap_end = NULL;
 
+static uint8_t *heap_top;         /* highest __sbrk_heap_end seen */
+static uint32_t *paint_lo;        /* lowest painted stack word */
+static uint8_t heap_locked;
+static uint32_t sbrk_locked;
+static uint32_t sbrk_caller;
+
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
  *        and others from the C library
@@ -65,6 +74,24 @@ void *_sbrk(ptrdiff_t incr)
     __sbrk_heap_end = &_end;
   }
 
+  /* Heap use after init is a bug: log it, stop under a debugger, fail */
+  if (heap_locked)
+  {
+    static const char msg[] = "sbrk after init\n";
+
+    if (sbrk_locked++ == 0)
+    {
+      sbrk_caller = (uint32_t)__builtin_return_address(0);
+    }
+    uart_write_blocking(msg, sizeof(msg) - 1);
+    if (CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk)
+    {
+      __BKPT(0);
+    }
+    errno = ENOMEM;
+    return (void *)-1;
+  }
+
   /* Protect heap from growing into the reserved MSP stack */
   if (__sbrk_heap_end + incr > max_heap)
   {
@@ -74,6 +101,60 @@ void *_sbrk(ptrdiff_t incr)
 
   prev_heap_end = __sbrk_heap_end;
   __sbrk_heap_end += incr;
+  if (__sbrk_heap_end > heap_top)
+  {
+    heap_top = __sbrk_heap_end;
+  }
 
   return (void *)prev_heap_end;
 }
+
+/**
+ * @brief Paints the RAM between the heap and the current stack pointer,
+ *        with a margin for this frame, so mem_stats() can find how deep
+ *        the MSP stack has been
+ */
+void mem_init(void)
+{
+  extern uint8_t _end;
+  uint32_t *sp = (uint32_t *)(__get_MSP() & ~7UL) - 16;
+  uint32_t *p = (uint32_t *)(((uint32_t)(__sbrk_heap_end ? __sbrk_heap_end : &_end) + 7) & ~7UL);
+
+  paint_lo = p;
+  while (p < sp)
+  {
+    *p++ = MEM_PAINT;
+  }
+}
+
+void mem_heap_lock(void)
+{
+  heap_locked = 1;
+}
+
+void mem_stats(mem_stats_t *s)
+{
+  extern uint8_t _end;
+  extern uint8_t _estack;
+  extern uint32_t _Min_Stack_Size;
+  uint8_t *heap_end = __sbrk_heap_end ? __sbrk_heap_end : &_end;
+  uint32_t *p = paint_lo;
+
+  /* The heap may have grown over the low end of the paint */
+  if (p && (uint8_t *)p < heap_end)
+  {
+    p = (uint32_t *)(((uint32_t)heap_end + 3) & ~3UL);
+  }
+  while (p && (uint8_t *)p < &_estack && *p == MEM_PAINT)
+  {
+    p++;
+  }
+
+  s->heap_used = heap_end - &_end;
+  s->heap_max = (heap_top ? heap_top : &_end) - &_end;
+  s->stack_used = p ? (uint32_t)(&_estack - (uint8_t *)p) : 0;
+  s->stack_size = (uint32_t)&_Min_Stack_Size;
+  s->free = p ? (uint32_t)((uint8_t *)p - heap_end) : 0;
+  s->sbrk_locked = sbrk_locked;
+  s->sbrk_caller = sbrk_caller;
+}
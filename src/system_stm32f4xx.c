@@ -1,11 +1,36 @@
 #include "stm32f4xx.h"
+#include "clock.h"
 
-uint32_t SystemCoreClock = 16000000; // HSI by default (16 MHz)
+uint32_t SystemCoreClock = HSI_VALUE; // HSI until SystemCoreClockUpdate() runs
 
+static const uint8_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9};
+
+// Runs from the reset handler before .data/.bss are initialised
 void SystemInit(void) {
-    // Default clock is HSI, no config needed for basic test
+    clock_setup(CLOCK_FULL);
 }
 
+// Derive the core clock from the RCC registers
 void SystemCoreClockUpdate(void) {
-    SystemCoreClock = 16000000;
+    uint32_t pllcfgr = RCC->PLLCFGR;
+    uint32_t sysclk;
+
+    switch ((RCC->CFGR >> 2) & 3) {
+    case 1:  // HSE
+        sysclk = HSE_VALUE;
+        break;
+    case 2: { // PLL
+        uint32_t src = (pllcfgr & RCC_PLLCFGR_PLLSRC_HSE) ? HSE_VALUE : HSI_VALUE;
+        uint32_t m = pllcfgr & 0x3F;
+        uint32_t n = (pllcfgr >> 6) & 0x1FF;
+        uint32_t p = (((pllcfgr >> 16) & 3) + 1) * 2;
+        sysclk = src / m * n / p;
+        break;
+    }
+    default: // HSI
+        sysclk = HSI_VALUE;
+        break;
+    }
+
+    SystemCoreClock = sysclk >> AHBPrescTable[(RCC->CFGR >> 4) & 0xF];
 }
@@ -1,65 +1,309 @@
 #include "stm32f4xx.h"
+#include "tb6612.h"
+#include "app.h"
+#include "clock.h"
+#include "board.h"
 
-void delay_ms(uint32_t ms) {
-    SysTick->LOAD = (SystemCoreClock / 1000) * ms - 1;
-    SysTick->VAL = 0;
-    SysTick->CTRL = 5;
-    while (!(SysTick->CTRL & (1 << 16)));
-    SysTick->CTRL = 0;
+#define DMA_EN        (1 << 0)
+#define RAMP_FLAGS    (0x3DUL << 16)  // DMA1 stream 6 in HISR/HIFCR
+#define TIM_DBA_CCR1  13              // CCR1 offset / 4, DCR burst base
+#define MOTOR_PORT    PIN_PORT(AIN1)
+
+// One BSRR write sets a whole bridge
+_Static_assert(AIN1_P == AIN2_P && AIN1_P == BIN1_P && AIN1_P == BIN2_P,
+               "TB6612 direction pins must share a port");
+_Static_assert(1000000 / MOTOR_PWM_TOP == MOTOR_PWM_HZ, "TIM4 runs at 1 MHz");
+
+typedef struct {
+    uint16_t target;     // duty the ramp ends at
+    uint16_t len;        // rows to get there, from the start of the table
+    uint16_t limit;      // max duty
+    uint8_t  state;      // MOTOR_COAST/FWD/REV/BRAKE
+    uint8_t  pending;    // direction change waiting for duty 0
+    uint8_t  next_state;
+    uint16_t next_duty, next_len;
+} motor_ch_t;
+
+static const uint8_t ccr_col[MOTOR_CHANNELS] = { 0, 3 };  // CCR1, CCR4
+static const uint32_t in1[MOTOR_CHANNELS] = { PIN_BIT(AIN1), PIN_BIT(BIN1) };
+static const uint32_t in2[MOTOR_CHANNELS] = { PIN_BIT(AIN2), PIN_BIT(BIN2) };
+
+static uint16_t ramp[MOTOR_RAMP_MAX][MOTOR_RAMP_CCR];
+static uint16_t ramp_rows;               // rows in the running table
+static motor_ch_t chs[MOTOR_CHANNELS];
+static motor_fault_fn fault_hook;
+
+uint16_t motor_ramp_build(uint16_t (*tab)[MOTOR_RAMP_CCR], const uint16_t *from,
+                          const uint16_t *to, const uint16_t *len) {
+    uint16_t rows = 1;
+
+    for (int ch = 0; ch < MOTOR_CHANNELS; ch++)
+        if (len[ch] > rows)
+            rows = len[ch];
+    if (rows > MOTOR_RAMP_MAX)
+        rows = MOTOR_RAMP_MAX;
+
+    for (uint16_t r = 0; r < rows; r++)
+        tab[r][1] = tab[r][2] = 0;
+
+    // Q16 accumulator, one divide per channel
+    for (int ch = 0; ch < MOTOR_CHANNELS; ch++) {
+        uint16_t n = len[ch] < rows ? len[ch] : rows;
+        int32_t step = n ? (((int32_t)to[ch] - from[ch]) << 16) / n : 0;
+        int32_t acc = ((int32_t)from[ch] << 16) + 0x8000;
+
+        for (uint16_t r = 0; r < rows; r++) {
+            acc += step;
+            tab[r][ccr_col[ch]] = (r + 1 >= n) ? to[ch] : (uint16_t)(acc >> 16);
+        }
+    }
+    return rows;
 }
 
-void GPIO_Init(void) {
-    // Enable GPIOB and GPIOC
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN;
+static volatile uint32_t *ccr(uint8_t ch) {
+    return ch == MOTOR_A ? &TIM4->CCR1 : &TIM4->CCR4;
+}
 
-    // PC6, PC7, PC8, PC9, PC13 as output
-    GPIOC->MODER |= (1 << (6 * 2)) | (1 << (7 * 2)) |
-                    (1 << (8 * 2)) | (1 << (9 * 2)) |
-                    (1 << (13 * 2));
-    GPIOC->OTYPER &= ~((1 << 6) | (1 << 7) | (1 << 8) | (1 << 9) | (1 << 13));
-    GPIOC->OSPEEDR |= (3 << (6 * 2)) | (3 << (7 * 2)) |
-                      (3 << (8 * 2)) | (3 << (9 * 2)) |
-                      (3 << (13 * 2));
+static void bridge(uint8_t ch, uint8_t state) {
+    uint32_t set = 0, clr = 0;
 
-    // PB6 as Alternate Function for TIM4_CH1
-    GPIOB->MODER &= ~(3 << (6 * 2));
-    GPIOB->MODER |= (2 << (6 * 2));       // Alternate function mode
-    GPIOB->AFR[0] |= (2 << (6 * 4));      // AF2 = TIM4_CH1
+    switch (state) {
+    case MOTOR_FWD:   set = in1[ch]; clr = in2[ch]; break;
+    case MOTOR_REV:   set = in2[ch]; clr = in1[ch]; break;
+    case MOTOR_BRAKE: set = in1[ch] | in2[ch];      break;
+    default:          clr = in1[ch] | in2[ch];      break;
+    }
+    MOTOR_PORT->BSRR = set | (clr << 16);
+    chs[ch].state = state;
 }
 
-void TIM4_PWM_CH1_Init(void) {
-    RCC->APB1ENR |= RCC_APB1ENR_TIM4EN;
+// Stop the DMA and count the rows already sent off every channel's ramp.
+// IRQs off.
+static void ramp_pause(void) {
+    uint16_t left, done;
 
-    TIM4->PSC = 84 - 1;            // 1 MHz (assuming 84 MHz system clock)
-    TIM4->ARR = 1000 - 1;          // PWM frequency = 1 kHz
-    TIM4->CCR1 = 800;              // Duty cycle = 80%
+    DMA1_Stream6->CR &= ~DMA_EN;
+    while (DMA1_Stream6->CR & DMA_EN);
+    DMA1->HIFCR = RAMP_FLAGS;
 
-    TIM4->CCMR1 |= (6 << 4);       // PWM Mode 1
-    TIM4->CCMR1 |= TIM_CCMR1_OC1PE; // Output preload enable
-    TIM4->CCER |= TIM_CCER_CC1E;  // Enable output on CH1
-    TIM4->CR1 |= TIM_CR1_ARPE;    // Auto-reload preload
-    TIM4->CR1 |= TIM_CR1_CEN;     // Enable Timer
+    left = (DMA1_Stream6->NDTR + MOTOR_RAMP_CCR - 1) / MOTOR_RAMP_CCR;
+    done = ramp_rows > left ? ramp_rows - left : 0;
+    for (int ch = 0; ch < MOTOR_CHANNELS; ch++)
+        chs[ch].len = chs[ch].len > done ? chs[ch].len - done : 0;
+    ramp_rows = 0;
+}
+
+// Ramp every channel from where it is to its target. IRQs off, DMA stopped.
+static void ramp_run(void) {
+    uint16_t from[MOTOR_CHANNELS], to[MOTOR_CHANNELS], len[MOTOR_CHANNELS];
+    uint8_t moving = 0;
+
+    for (int ch = 0; ch < MOTOR_CHANNELS; ch++) {
+        motor_ch_t *c = &chs[ch];
+
+        from[ch] = *ccr(ch);
+        if (c->pending && from[ch] == 0) {
+            // Down to zero: flip the bridge and go up the other way
+            bridge(ch, c->next_state);
+            c->target = c->next_duty;
+            c->len = c->next_len;
+            c->pending = 0;
+        }
+        to[ch] = c->target;
+        len[ch] = c->len;
+        moving |= from[ch] != to[ch] || c->pending;
+    }
+    if (!moving)
+        return;
+
+    ramp_rows = motor_ramp_build(ramp, from, to, len);
+    TIM4->DCR = ((MOTOR_RAMP_CCR - 1) << 8) | TIM_DBA_CCR1;  // restarts the burst at CCR1
+    DMA1_Stream6->M0AR = (uint32_t)ramp;
+    DMA1_Stream6->NDTR = ramp_rows * MOTOR_RAMP_CCR;
+    DMA1_Stream6->CR |= DMA_EN;
 }
 
-void Motor_Run(void) {
-    // Enable STBY
-    GPIOC->ODR |= (1 << 13);
+void DMA1_Stream6_IRQHandler(void) {
+    ramp_pause();
+    ramp_run();  // second half of a direction change, if any
+}
 
-    // Motor A forward: AIN1 = 1, AIN2 = 0
-    GPIOC->ODR |= (1 << 6);
-    GPIOC->ODR &= ~(1 << 7);
+static uint16_t ramp_len(uint16_t ms) {
+    uint32_t rows = (uint32_t)ms * MOTOR_PWM_HZ / 1000;
 
-    // Motor B forward: BIN1 = 1, BIN2 = 0
-    GPIOC->ODR |= (1 << 8);
-    GPIOC->ODR &= ~(1 << 9);
+    return rows > MOTOR_RAMP_MAX ? MOTOR_RAMP_MAX : rows;
 }
 
-int main(void) {
-    GPIO_Init();
-    TIM4_PWM_CH1_Init();
-    Motor_Run();
+void motor_set(uint8_t ch, int16_t speed, uint16_t ramp_ms) {
+    uint32_t primask = __get_PRIMASK();
+    uint8_t state = speed < 0 ? MOTOR_REV : MOTOR_FWD;
+    uint16_t duty = speed < 0 ? -speed : speed;
+    uint16_t len = ramp_len(ramp_ms);
+    motor_ch_t *c;
 
-    while (1) {
-        // Motors running at 80% speed
+    if (ch >= MOTOR_CHANNELS)
+        return;
+    c = &chs[ch];
+    if (duty > c->limit)
+        duty = c->limit;
+
+    __disable_irq();
+    ramp_pause();
+    c->pending = 0;
+    if (duty == 0 || c->state == state || *ccr(ch) == 0) {
+        // Speed 0 ramps down and keeps the bridge as it is
+        if (duty)
+            bridge(ch, state);
+        c->target = duty;
+        c->len = len;
+    } else {
+        c->target = 0;
+        c->len = len;
+        c->pending = 1;
+        c->next_state = state;
+        c->next_duty = duty;
+        c->next_len = len;
     }
+    ramp_run();
+    __set_PRIMASK(primask);
+}
+
+// Cancel the channel's ramp and put the bridge in state with PWM at 0
+static void motor_stop(uint8_t ch, uint8_t state) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    ramp_pause();
+    *ccr(ch) = 0;
+    chs[ch].target = 0;
+    chs[ch].len = 0;
+    chs[ch].pending = 0;
+    bridge(ch, state);
+    ramp_run();
+    __set_PRIMASK(primask);
+}
+
+void motor_brake(uint8_t ch) {
+    if (ch < MOTOR_CHANNELS)
+        motor_stop(ch, MOTOR_BRAKE);
+}
+
+void motor_coast(uint8_t ch) {
+    if (ch < MOTOR_CHANNELS)
+        motor_stop(ch, MOTOR_COAST);
+}
+
+void motor_standby(uint8_t on) {
+    if (on) {
+        motor_coast(MOTOR_A);
+        motor_coast(MOTOR_B);
+        PIN_CLR(STBY);
+    } else {
+        PIN_SET(STBY);
+    }
+}
+
+int16_t motor_speed(uint8_t ch) {
+    if (ch >= MOTOR_CHANNELS)
+        return 0;
+    switch (chs[ch].state) {
+    case MOTOR_FWD: return *ccr(ch);
+    case MOTOR_REV: return -(int16_t)*ccr(ch);
+    default:        return 0;
+    }
+}
+
+uint8_t motor_ramping(void) {
+    return (DMA1_Stream6->CR & DMA_EN) != 0;
+}
+
+void motor_set_limit(uint8_t ch, uint16_t max) {
+    uint32_t primask = __get_PRIMASK();
+    motor_ch_t *c;
+
+    if (ch >= MOTOR_CHANNELS)
+        return;
+    c = &chs[ch];
+    if (max > MOTOR_PWM_TOP)
+        max = MOTOR_PWM_TOP;
+
+    __disable_irq();
+    c->limit = max;
+    if (c->target > max || c->next_duty > max || *ccr(ch) > max) {
+        ramp_pause();
+        if (*ccr(ch) > max)
+            *ccr(ch) = max;
+        if (c->target > max)
+            c->target = max;
+        if (c->next_duty > max)
+            c->next_duty = max;
+        ramp_run();
+    }
+    __set_PRIMASK(primask);
+}
+
+void motor_fault_hook(motor_fault_fn fn) {
+    fault_hook = fn;
+}
+
+void motor_overcurrent(uint8_t ch) {
+    if (ch >= MOTOR_CHANNELS)
+        return;
+    motor_coast(ch);
+    if (fault_hook)
+        fault_hook(ch);
+}
+
+// Keep TIM4 counting at 1 MHz on any clock profile
+static void TIM4_Clock_Update(void) {
+    TIM4->PSC = clock_apb1_timer_hz() / 1000000 - 1;
+}
+
+void motor_init(void) {
+    RCC->APB1ENR |= RCC_APB1ENR_TIM4EN;
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+
+    for (int ch = 0; ch < MOTOR_CHANNELS; ch++) {
+        chs[ch].limit = MOTOR_PWM_TOP;
+        bridge(ch, MOTOR_COAST);
+    }
+
+    TIM4_Clock_Update();           // 1 MHz from the APB1 timer clock
+    clock_on_change(TIM4_Clock_Update);
+    TIM4->ARR = MOTOR_PWM_TOP - 1; // PWM frequency = 1 kHz
+    TIM4->CCR1 = 0;
+    TIM4->CCR4 = 0;
+
+    TIM4->CCMR1 |= (6 << 4) | TIM_CCMR1_OC1PE;    // CH1 PWM mode 1, preload
+    TIM4->CCMR2 |= (6 << 12) | TIM_CCMR2_OC4PE;   // CH4 PWM mode 1, preload
+    TIM4->CCER |= TIM_CCER_CC1E | TIM_CCER_CC4E;
+    TIM4->DCR = ((MOTOR_RAMP_CCR - 1) << 8) | TIM_DBA_CCR1;
+    TIM4->DIER |= TIM_DIER_UDE;   // a burst of MOTOR_RAMP_CCR writes per update
+    TIM4->CR1 |= TIM_CR1_ARPE;    // Auto-reload preload
+    TIM4->CR1 |= TIM_CR1_CEN;     // Enable Timer
+
+    // DMA1 Stream6 channel 2 (TIM4_UP): ramp rows -> TIM4->DMAR, 16-bit
+    DMA1_Stream6->CR = 0;
+    while (DMA1_Stream6->CR & DMA_EN);
+    DMA1_Stream6->PAR = (uint32_t)&TIM4->DMAR;
+    DMA1_Stream6->CR = (2 << 25) |                 // CHSEL = 2
+                       (1 << 13) | (1 << 11) |     // MSIZE, PSIZE = 16-bit
+                       (1 << 10) | (1 << 6) |      // MINC, DIR = mem -> periph
+                       (1 << 4);                   // TCIE
+    DMA1->HIFCR = RAMP_FLAGS;
+    NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+
+    motor_standby(1);
+}
+
+#define MOTOR_SOFT_START_MS 250
+
+// Pump on B at 80%, soft-started; A too unless climate control owns it
+void motor_app_init(void) {
+    motor_init();
+    motor_standby(0);
+#if !CONFIG_CLIMATE
+    motor_set(MOTOR_A, MOTOR_PWM_TOP * 8 / 10, MOTOR_SOFT_START_MS);
+#endif
+    motor_set(MOTOR_B, MOTOR_PWM_TOP * 8 / 10, MOTOR_SOFT_START_MS);
 }
@@ -0,0 +1,244 @@
+#include "telemetry.h"
+#include "ring.h"
+
+#define TELEM_HEARTBEAT_MS 10000  // frame with no changes so keyframes keep coming
+
+typedef struct {
+	uint8_t ch;
+	int32_t v;
+} telem_sample_t;
+
+RING_DEFINE(telem_ring, telem_sample_t, TELEM_QUEUE)
+
+static telem_ring_t queue;
+static telem_state_t enc;
+
+// CRC16-CCITT, one nibble per table lookup
+static const uint16_t crc_nib[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+uint16_t telem_crc16(const uint8_t *p, uint32_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	while (len--) {
+		crc = (crc << 4) ^ crc_nib[(crc >> 12) ^ (*p >> 4)];
+		crc = (crc << 4) ^ crc_nib[(crc >> 12) ^ (*p++ & 0x0F)];
+	}
+	return crc;
+}
+
+uint32_t telem_cobs_encode(const uint8_t *in, uint32_t len, uint8_t *out)
+{
+	uint32_t code_at = 0, o = 1;
+	uint8_t code = 1;
+
+	for (uint32_t i = 0; i < len; i++) {
+		if (in[i]) {
+			out[o++] = in[i];
+			code++;
+		}
+		if (!in[i] || code == 0xFF) {
+			out[code_at] = code;
+			code_at = o++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	return o;
+}
+
+int32_t telem_cobs_decode(const uint8_t *in, uint32_t len, uint8_t *out)
+{
+	uint32_t i = 0, o = 0;
+
+	while (i < len) {
+		uint8_t code = in[i++];
+
+		if (!code || i + code - 1 > len)
+			return -1;
+		for (uint8_t j = 1; j < code; j++)
+			out[o++] = in[i++];
+		if (code != 0xFF && i < len)
+			out[o++] = 0;
+	}
+	return o;
+}
+
+static uint32_t put_varint(uint8_t *p, uint32_t v)
+{
+	uint32_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+static int get_varint(const uint8_t *p, uint32_t len, uint32_t *at, uint32_t *v)
+{
+	uint32_t r = 0;
+
+	for (uint8_t shift = 0; shift < 35; shift += 7) {
+		if (*at >= len)
+			return -1;
+		r |= (uint32_t)(p[*at] & 0x7F) << shift;
+		if (!(p[(*at)++] & 0x80)) {
+			*v = r;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+uint32_t telem_encode(telem_state_t *st, uint32_t now_ms, uint32_t mask,
+                      const int32_t *val, uint8_t *frame)
+{
+	uint8_t raw[TELEM_RAW_MAX];
+	uint8_t key = (st->since_key == 0);
+	uint32_t n = 0, send;
+	uint16_t crc;
+
+	// A keyframe carries every level channel, the ones new in this frame too
+	send = key ? st->known | mask : mask;
+
+	raw[n++] = (TELEM_VERSION << 4) | (key ? TM_F_KEY : 0);
+	raw[n++] = st->seq++;
+	n += put_varint(&raw[n], key ? now_ms : now_ms - st->time);
+	n += put_varint(&raw[n], send);
+	for (uint8_t ch = 0; ch < TM_CHANNELS; ch++) {
+		uint32_t bit = 1UL << ch;
+		int32_t v;
+
+		if (!(send & bit))
+			continue;
+		v = (mask & bit) ? val[ch] : st->val[ch];
+		if (bit & TM_EVENTS)
+			n += put_varint(&raw[n], zigzag(v));
+		else
+			n += put_varint(&raw[n], zigzag(key ? v : v - st->val[ch]));
+		st->val[ch] = v;
+	}
+	crc = telem_crc16(raw, n);
+	raw[n++] = crc >> 8;
+	raw[n++] = crc;
+
+	st->known |= mask & ~TM_EVENTS;
+	st->time = now_ms;
+	if (++st->since_key >= TELEM_KEY_EVERY)
+		st->since_key = 0;
+
+	n = telem_cobs_encode(raw, n, frame);
+	frame[n++] = 0;
+	return n;
+}
+
+// raw is one COBS-decoded frame without the delimiter
+int telem_decode(telem_state_t *st, const uint8_t *raw, uint32_t len, uint32_t *mask)
+{
+	uint32_t at = 2, t, m, v;
+	uint8_t key;
+
+	if (len < 6)
+		return TELEM_ERR_FORMAT;
+	if (telem_crc16(raw, len - 2) != ((uint16_t)raw[len - 2] << 8 | raw[len - 1]))
+		return TELEM_ERR_CRC;
+	len -= 2;
+	if ((raw[0] >> 4) != TELEM_VERSION)
+		return TELEM_ERR_FORMAT;
+	key = raw[0] & TM_F_KEY;
+
+	if (raw[1] != st->seq)
+		st->synced = 0;  // frames were lost
+	st->seq = raw[1] + 1;
+	if (!key && !st->synced)
+		return TELEM_ERR_SYNC;
+
+	if (get_varint(raw, len, &at, &t) || get_varint(raw, len, &at, &m))
+		return TELEM_ERR_FORMAT;
+	if (m >> TM_CHANNELS)
+		return TELEM_ERR_FORMAT;
+	st->time = key ? t : st->time + t;
+
+	for (uint8_t ch = 0; ch < TM_CHANNELS; ch++) {
+		uint32_t bit = 1UL << ch;
+
+		if (!(m & bit))
+			continue;
+		if (get_varint(raw, len, &at, &v))
+			return TELEM_ERR_FORMAT;
+		if (key || (bit & TM_EVENTS))
+			st->val[ch] = unzigzag(v);
+		else
+			st->val[ch] += unzigzag(v);
+	}
+	st->known |= m & ~TM_EVENTS;
+	st->synced = 1;
+	*mask = m;
+	return TELEM_OK;
+}
+
+// Main loop only; dropped if telem_poll() falls behind
+void telem_set(uint8_t ch, int32_t v)
+{
+	telem_sample_t s = { ch, v };
+
+	telem_ring_push(&queue, &s);
+}
+
+static void telem_send(uint32_t now_ms, uint32_t mask, const int32_t *val, telem_sink_t sink)
+{
+	uint8_t frame[TELEM_FRAME_MAX];
+	uint32_t n = telem_encode(&enc, now_ms, mask, val, frame);
+
+	sink((const char *)frame, n);
+}
+
+int telem_poll(uint32_t now_ms, telem_sink_t sink)
+{
+	int32_t val[TM_CHANNELS];
+	uint32_t mask = 0;
+	int frames = 0;
+	telem_sample_t s;
+
+	while (telem_ring_peek(&queue, &s)) {
+		uint32_t bit = (s.ch < TM_CHANNELS) ? 1UL << s.ch : 0;
+
+		if ((bit & TM_EVENTS) && (mask & bit)) {
+			// Second event on a channel goes in the next frame; a level
+			// channel just keeps its latest value
+			telem_send(now_ms, mask, val, sink);
+			frames++;
+			mask = 0;
+		}
+		telem_ring_drop(&queue);
+		if (!bit)
+			continue;
+		if (!(bit & TM_EVENTS) && (enc.known & bit) && enc.val[s.ch] == s.v) {
+			mask &= ~bit;  // back to the value last sent
+			continue;
+		}
+		val[s.ch] = s.v;
+		mask |= bit;
+	}
+
+	if (mask || (enc.known && now_ms - enc.time >= TELEM_HEARTBEAT_MS)) {
+		telem_send(now_ms, mask, val, sink);
+		frames++;
+	}
+	return frames;
+}
@@ -0,0 +1,83 @@
+#include "stm32f4xx.h"
+#include "timebase.h"
+
+static uint32_t last_cyc;   // CYCCNT at the previous extension
+static uint64_t ext_cyc;    // extended cycle count
+static uint64_t base_us;    // microseconds at the last clock change
+static uint64_t base_cyc;   // extended cycles at the last clock change
+static uint32_t cyc_per_us = 16;
+
+void timebase_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    last_cyc = 0;
+    ext_cyc = 0;
+    base_us = 0;
+    base_cyc = 0;
+    cyc_per_us = SystemCoreClock / 1000000;
+}
+
+uint64_t time_now_cycles(void) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t now;
+    uint64_t c;
+
+    __disable_irq();
+    now = DWT->CYCCNT;
+    ext_cyc += now - last_cyc;
+    last_cyc = now;
+    c = ext_cyc;
+    __set_PRIMASK(primask);
+    return c;
+}
+
+void timebase_credit(uint32_t cycles) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    ext_cyc += cycles;
+    __set_PRIMASK(primask);
+}
+
+// Close the current segment at the old rate and start one at the new rate.
+// The partial microsecond carries over, or every switch would drop up to 1 us.
+void timebase_clock_changed(void) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t per_us = SystemCoreClock / 1000000;
+    uint64_t c, d;
+
+    __disable_irq();
+    c = time_now_cycles();
+    d = c - base_cyc;
+    base_us += d / cyc_per_us;
+    base_cyc = c - (d % cyc_per_us) * per_us / cyc_per_us;
+    cyc_per_us = per_us;
+    __set_PRIMASK(primask);
+}
+
+uint64_t time_now_us(void) {
+    uint32_t primask = __get_PRIMASK();
+    uint64_t us;
+
+    __disable_irq();
+    if (cyc_per_us != SystemCoreClock / 1000000)
+        timebase_clock_changed();  // caller forgot; rebase now
+    us = base_us + (time_now_cycles() - base_cyc) / cyc_per_us;
+    __set_PRIMASK(primask);
+    return us;
+}
+
+// Rate read on every call, so delays stay exact across clock switches
+void delay_us(uint32_t us) {
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles = us * (SystemCoreClock / 1000000);
+
+    while ((DWT->CYCCNT - start) < cycles);
+}
+
+void delay_ms(uint32_t ms) {
+    while (ms--)
+        delay_us(1000);
+}
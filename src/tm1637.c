@@ -0,0 +1,175 @@
+#include "stm32f4xx.h"
+#include "tm1637.h"
+#include "clock.h"
+#include "board.h"
+#include "fmt.h"
+
+#define CLK_PIN SEG_CLK_N
+#define DIO_PIN SEG_DIO_N
+#define SEG_PORT PIN_PORT(SEG_CLK)
+
+// One BSRR stream drives both lines
+_Static_assert(SEG_CLK_P == SEG_DIO_P, "TM1637 CLK and DIO must share a port");
+
+#define CLK_H (1UL << CLK_PIN)
+#define CLK_L (1UL << (CLK_PIN + 16))
+#define DIO_H (1UL << DIO_PIN)         // released, the pull-up takes it high
+#define DIO_L (1UL << (DIO_PIN + 16))
+
+#define TM1637_CMD_DATA 0x40           // write, auto-increment address
+#define TM1637_CMD_ADDR 0xC0           // start at digit 0
+#define TM1637_CMD_CTRL 0x80           // | 0x08 display on | brightness
+
+#define SEG_MINUS 0x40
+
+
+static const uint8_t digit_seg[10] = {
+    0x3F, 0x06, 0x5B, 0x4F, 0x66,
+    0x6D, 0x7D, 0x07, 0x7F, 0x6F
+};
+
+static uint32_t wave[2][TM1637_WORDS];
+static uint16_t wave_len[2];
+static volatile uint8_t tx_buf = 0xFF;  // buffer being sent, 0xFF = idle
+static volatile uint8_t pending = 0xFF; // buffer waiting for the DMA
+static uint8_t ctrl = TM1637_CMD_CTRL | 0x08; // on, brightness 0 as before
+
+static uint16_t put_start(uint32_t *w, uint16_t n) {
+    w[n++] = CLK_H | DIO_H;
+    w[n++] = DIO_L;                    // DIO falls while CLK is high
+    return n;
+}
+
+static uint16_t put_stop(uint32_t *w, uint16_t n) {
+    w[n++] = CLK_L | DIO_L;
+    w[n++] = CLK_H;
+    w[n++] = DIO_H;                    // DIO rises while CLK is high
+    return n;
+}
+
+// Data changes with the falling CLK edge and is sampled on the rising edge
+static uint16_t put_byte(uint32_t *w, uint16_t n, uint8_t b) {
+    for (int i = 0; i < 8; i++) {
+        w[n++] = CLK_L | ((b & 1) ? DIO_H : DIO_L);
+        w[n++] = CLK_H;
+        b >>= 1;
+    }
+    w[n++] = CLK_L | DIO_H;            // ACK slot: release DIO for the chip
+    w[n++] = CLK_H;
+    return n;
+}
+
+uint16_t tm1637_build(uint32_t *w, const uint8_t seg[4], uint8_t display_ctrl) {
+    uint16_t n = 0;
+
+    n = put_start(w, n);
+    n = put_byte(w, n, TM1637_CMD_DATA);
+    n = put_stop(w, n);
+
+    n = put_start(w, n);
+    n = put_byte(w, n, TM1637_CMD_ADDR);
+    for (int i = 0; i < 4; i++)
+        n = put_byte(w, n, seg[i]);
+    n = put_stop(w, n);
+
+    n = put_start(w, n);
+    n = put_byte(w, n, display_ctrl);
+    n = put_stop(w, n);
+    return n;
+}
+
+static void tm1637_kick(uint8_t b) {
+    tx_buf = b;
+    DMA2_Stream1->CR &= ~1;
+    while (DMA2_Stream1->CR & 1);
+    DMA2->LIFCR = 0x3D << 6;           // clear stream 1 flags
+    DMA2_Stream1->M0AR = (uint32_t)wave[b];
+    DMA2_Stream1->NDTR = wave_len[b];
+    DMA2_Stream1->CR |= 1;
+    TIM8->CNT = 0;
+    TIM8->CR1 |= TIM_CR1_CEN;
+}
+
+void DMA2_Stream1_IRQHandler(void) {
+    DMA2->LIFCR = 0x3D << 6;
+    TIM8->CR1 &= ~TIM_CR1_CEN;
+    tx_buf = 0xFF;
+    if (pending != 0xFF) {
+        uint8_t b = pending;
+        pending = 0xFF;
+        tm1637_kick(b);
+    }
+}
+
+void tm1637_show_segments(const uint8_t seg[4]) {
+    uint32_t primask = __get_PRIMASK();
+    uint8_t b;
+
+    // Fill whichever buffer the DMA is not reading; a queued update is replaced
+    __disable_irq();
+    pending = 0xFF;
+    b = (tx_buf == 0) ? 1 : 0;
+    __set_PRIMASK(primask);
+
+    wave_len[b] = tm1637_build(wave[b], seg, ctrl);
+
+    __disable_irq();
+    if (tx_buf == 0xFF)
+        tm1637_kick(b);
+    else
+        pending = b;
+    __set_PRIMASK(primask);
+}
+
+void tm1637_show_number(int value, uint8_t leading_zeros) {
+    uint8_t seg[4] = { SEG_MINUS, SEG_MINUS, SEG_MINUS, SEG_MINUS };
+    char buf[FMT_MAX];
+
+    // out of range: ----
+    if (value <= 9999 && value >= -999) {
+        // The sign goes in front of the zeros or right before the digits
+        fmt_i32(buf, value, 4, leading_zeros ? FMT_ZERO : 0);
+        for (int i = 0; i < 4; i++)
+            seg[i] = buf[i] == '-' ? SEG_MINUS : buf[i] == ' ' ? 0 : digit_seg[buf[i] - '0'];
+    }
+    tm1637_show_segments(seg);
+}
+
+void tm1637_blank(void) {
+    static const uint8_t off[4] = { 0, 0, 0, 0 };
+    tm1637_show_segments(off);
+}
+
+void tm1637_brightness(uint8_t level) {
+    ctrl = TM1637_CMD_CTRL | 0x08 | (level & 7);
+}
+
+uint8_t tm1637_busy(void) {
+    return tx_buf != 0xFF;
+}
+
+static void tm1637_clock_update(void) {
+    TIM8->PSC = clock_apb2_timer_hz() / 1000000 - 1;
+}
+
+void tm1637_init(void) {
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+    RCC->APB2ENR |= RCC_APB2ENR_TIM8EN;
+
+    // TIM8 at 1 MHz, one update (and one DMA request) per step
+    tm1637_clock_update();
+    clock_on_change(tm1637_clock_update);
+    TIM8->ARR = TM1637_STEP_US - 1;
+    TIM8->DIER |= TIM_DIER_UDE;
+    TIM8->EGR = TIM_EGR_UG;
+
+    // DMA2 Stream1 channel 7 (TIM8_UP): memory -> SEG_PORT->BSRR, 32-bit
+    DMA2_Stream1->CR = 0;
+    while (DMA2_Stream1->CR & 1);
+    DMA2_Stream1->PAR = (uint32_t)&SEG_PORT->BSRR;
+    DMA2_Stream1->CR = (7 << 25) |                 // CHSEL = 7
+                       (2 << 13) | (2 << 11) |     // MSIZE, PSIZE = 32-bit
+                       (1 << 10) | (1 << 6) |      // MINC, DIR = mem -> periph
+                       (1 << 4);                   // TCIE
+    NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+}
@@ -0,0 +1,220 @@
+#include "stm32f4xx.h"
+#include "uart.h"
+#include "clock.h"
+#include "probe.h"
+#include <string.h>
+
+#define DMA_EN   (1 << 0)
+#define TX_FLAGS (0x3DUL << 22)  // DMA1 stream 3 in LISR/LIFCR
+#define RX_FLAGS (0x3DUL << 6)   // DMA1 stream 1
+
+_Static_assert((UART_RX_BUF & (UART_RX_BUF - 1)) == 0, "UART_RX_BUF must be a power of two");
+
+static char tx_buf[2][UART_TX_BUF];
+static volatile uint16_t tx_len[2];  // bytes reserved in each buffer
+static volatile uint8_t fill;        // buffer writers append to
+static volatile uint8_t tx_busy;     // DMA is sending buffer fill ^ 1
+static volatile uint8_t writers;     // reservations not yet committed
+
+static char rx_buf[UART_RX_BUF];
+static volatile uint32_t rx_head;    // bytes received, free-running
+static uint32_t rx_tail;             // bytes consumed
+static uint32_t rx_pos;              // DMA index at the last update
+
+static uart_stats_t stats;
+
+static void uart_clock_update(void) {
+    USART3->BRR = (clock_apb1_hz() + UART_BAUD / 2) / UART_BAUD;
+}
+
+void uart_init(void) {
+    RCC->APB1ENR |= RCC_APB1ENR_USART3EN;
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+
+    USART3->CR1 = 0;
+    uart_clock_update();
+    clock_on_change(uart_clock_update);
+    USART3->CR3 = USART_CR3_DMAT | USART_CR3_DMAR;
+
+    // DMA1 Stream3 channel 4 (USART3_TX): memory -> DR, started per buffer
+    DMA1_Stream3->CR = 0;
+    while (DMA1_Stream3->CR & DMA_EN);
+    DMA1_Stream3->PAR = (uint32_t)&USART3->DR;
+    DMA1_Stream3->CR = (4 << 25) |              // CHSEL = 4
+                       (1 << 10) | (1 << 6) |   // MINC, DIR = mem -> periph
+                       (1 << 4);                // TCIE
+
+    // DMA1 Stream1 channel 4 (USART3_RX): DR -> rx_buf, circular, HT+TC irqs
+    DMA1_Stream1->CR = 0;
+    while (DMA1_Stream1->CR & DMA_EN);
+    DMA1_Stream1->PAR = (uint32_t)&USART3->DR;
+    DMA1_Stream1->M0AR = (uint32_t)rx_buf;
+    DMA1_Stream1->NDTR = UART_RX_BUF;
+    DMA1_Stream1->CR = (4 << 25) |              // CHSEL = 4
+                       (1 << 10) | (1 << 8) |   // MINC, CIRC
+                       (1 << 4) | (1 << 3);     // TCIE, HTIE
+    DMA1->LIFCR = TX_FLAGS | RX_FLAGS;
+    DMA1_Stream1->CR |= DMA_EN;
+
+    USART3->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE;
+
+    NVIC_EnableIRQ(DMA1_Stream3_IRQn);
+    NVIC_EnableIRQ(DMA1_Stream1_IRQn);
+    NVIC_EnableIRQ(USART3_IRQn);
+}
+
+// Hand the fill buffer to the DMA. IRQs off; waits while a writer is copying.
+static void tx_start(void) {
+    uint8_t b = fill;
+
+    if (tx_busy || writers || !tx_len[b])
+        return;
+    DMA1->LIFCR = TX_FLAGS;
+    DMA1_Stream3->M0AR = (uint32_t)tx_buf[b];
+    DMA1_Stream3->NDTR = tx_len[b];
+    stats.tx_bytes += tx_len[b];
+    fill = b ^ 1;
+    tx_len[b ^ 1] = 0;
+    tx_busy = 1;
+    DMA1_Stream3->CR |= DMA_EN;
+}
+
+void DMA1_Stream3_IRQHandler(void) {
+    DMA1->LIFCR = TX_FLAGS;
+    tx_busy = 0;
+    tx_start();
+}
+
+// Claim up to want bytes (all or nothing if !partial)
+static char *tx_claim(uint32_t want, uint32_t *got, int partial) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t room;
+    char *p;
+
+    __disable_irq();
+    room = UART_TX_BUF - tx_len[fill];
+    if (want > room) {
+        stats.tx_overflows++;
+        if (!partial) {
+            stats.tx_dropped += want;
+            __set_PRIMASK(primask);
+            return 0;
+        }
+        stats.tx_dropped += want - room;
+        want = room;
+    }
+    p = tx_buf[fill] + tx_len[fill];
+    tx_len[fill] += want;
+    writers++;
+    __set_PRIMASK(primask);
+    *got = want;
+    return p;
+}
+
+char *uart_tx_reserve(uint32_t n) {
+    uint32_t got;
+
+    return tx_claim(n, &got, 0);
+}
+
+void uart_tx_commit(void) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    writers--;
+    tx_start();
+    __set_PRIMASK(primask);
+}
+
+int uart_write(const char *p, int len) {
+    uint32_t n;
+    char *d = tx_claim(len, &n, 1);
+
+    memcpy(d, p, n);
+    uart_tx_commit();
+    return n;
+}
+
+static void poll_send(const char *p, uint32_t len) {
+    while (len--) {
+        while (!(USART3->SR & USART_SR_TXE));
+        USART3->DR = *p++;
+    }
+}
+
+// Fatal path: let the DMA finish, send what is queued, then p, all polled.
+// An open reservation goes out as it stands.
+void uart_write_blocking(const char *p, int len) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (tx_busy) {
+        while (DMA1_Stream3->CR & DMA_EN);  // the stream stops itself at NDTR = 0
+        DMA1->LIFCR = TX_FLAGS;
+        tx_busy = 0;
+    }
+    poll_send(tx_buf[fill], tx_len[fill]);
+    stats.tx_blocking += tx_len[fill] + len;
+    tx_len[fill] = 0;
+    poll_send(p, len);
+    while (!(USART3->SR & USART_SR_TC));
+    __set_PRIMASK(primask);
+}
+
+// Publish how far the RX DMA has written. HT/TC interrupts bound the gap
+// between updates to half the buffer, so the delta never wraps.
+static void rx_update(void) {
+    uint32_t pos = (UART_RX_BUF - DMA1_Stream1->NDTR) & (UART_RX_BUF - 1);
+    uint32_t n = (pos - rx_pos) & (UART_RX_BUF - 1);
+
+    rx_pos = pos;
+    rx_head += n;
+    stats.rx_bytes += n;
+}
+
+void DMA1_Stream1_IRQHandler(void) {
+    DMA1->LIFCR = RX_FLAGS;
+    rx_update();
+}
+
+void USART3_IRQHandler(void) {
+    probe_begin(PROBE_UART_IRQ);
+    if (USART3->SR & (USART_SR_IDLE | USART_SR_ORE)) {
+        (void)USART3->DR;  // SR then DR read clears IDLE and ORE
+        rx_update();
+    }
+    probe_end(PROBE_UART_IRQ);
+}
+
+int uart_read(char *p, int len) {
+    uint32_t primask = __get_PRIMASK();
+    uint32_t avail;
+    int n;
+
+    __disable_irq();
+    rx_update();
+    __set_PRIMASK(primask);
+
+    // The DMA never stops, so data older than one buffer has been overwritten
+    avail = rx_head - rx_tail;
+    if (avail > UART_RX_BUF) {
+        stats.rx_overruns += avail - UART_RX_BUF;
+        rx_tail = rx_head - UART_RX_BUF;
+        avail = UART_RX_BUF;
+    }
+    n = (int)avail < len ? (int)avail : len;
+    for (int i = 0; i < n; i++)
+        p[i] = rx_buf[(rx_tail + i) & (UART_RX_BUF - 1)];
+    rx_tail += n;
+    return n;
+}
+
+void uart_stats(uart_stats_t *s, uint8_t reset) {
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *s = stats;
+    if (reset)
+        memset(&stats, 0, sizeof(stats));
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,43 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Shared by the host checks and benches in tools/. Each one takes
+//
+//   tool [n] [seed]
+//
+// n cases, default per tool, drawn from an xorshift stream seeded with
+// seed, default 1, so a failure can be run again as it was. A check
+// prints one line, "FAIL <check> ..." if it failed, and the tool exits 1
+// if any did.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint32_t rng = 1;
+
+static inline uint32_t rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+// The FAIL line, fmt takes a and b; returns 1
+static inline int fail(const char *check, const char *fmt, unsigned a, unsigned b)
+{
+	printf("FAIL %-10s ", check);
+	printf(fmt, a, b);
+	printf("\n");
+	return 1;
+}
+
+// n from argv[1] or the default, and rnd() seeded from argv[2]
+static inline uint32_t check_args(int argc, char **argv, uint32_t n)
+{
+	rng = argc > 2 ? strtoul(argv[2], 0, 0) | 1 : 1;
+	return argc > 1 ? strtoul(argv[1], 0, 0) : n;
+}
+
+#endif
@@ -0,0 +1,1071 @@
+// Cycle budget for the driver hot paths.
+//
+//   cyclebench -l O2 [-b tools/cycle_budget.txt] [-s slack%] [-u]
+//
+// Runs each hot path on the host simulator (sim/) with the firmware built
+// at the level named by -l. Every host instruction of a call is stepped
+// and counted, together with its peripheral register accesses and calls.
+// The Cortex-M4 estimate takes one cycle per instruction, plus
+// EST_CALL_CYCLES pipeline refill per call and return, plus
+// EST_BUS_CYCLES of APB wait per register access. Host instruction
+// counts only approximate Thumb-2, but they move with the compiler the
+// same way.
+//
+// The budget file holds one line per path, with a column per level. A
+// path fails when its estimate is more than slack% (default 10) over the
+// budget. -u writes the measured values into this level's column.
+//
+// A typical climate refresh, both lines with the temperature and humidity
+// one step on, is sent once as full lines and once through the LCD
+// framebuffer; the panel writes each one costs are counted in the HD44780
+// model.
+//
+// A DHT11 read through the EXTI/TIM2 driver is costed start to finish,
+// dht11_start() and every handler the read takes, and compared with the
+// polled dht11_read() it replaced, which held the core for the whole read.
+//
+// The EXTI keypad scanner is compared with the polled scan_keypad() it
+// replaced, kept here as it was: the cost of one poll with nothing
+// pressed (the old access loops polled back to back), whether the new
+// one is armed with no timer running, and the virtual time from a key
+// going down to the event for a 20 ms press.
+//
+// A console line through uart_write() is costed in the caller and next to
+// the polled uart_write_blocking(), then lines are offered faster than
+// the wire carries them: it must stay busy, the rest counted as dropped.
+//
+// board_init() is costed next to the per-driver pin setup it replaced.
+//
+// telem_encode() packs one delta frame of four samples, as telem_poll()
+// does after a climate read; snprintf_telem prints the same four as a text
+// line for scale.
+//
+// adc_decimate() is checked against a plain sum over random blocks.
+//
+// Busy-wait delays are checked against virtual time and for scaling with
+// the requested delay, so a loop the optimizer removed is flagged. fmt.c
+// output is compared with snprintf over a sweep of values, widths and
+// flags; the snprintf paths are the host C library, printed for scale and
+// never budgeted.
+// Exits 1 on any failure.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+#include "board.h"
+#include "lcd.h"
+#include "tm1637.h"
+#include "dht11.h"
+#include "keyscan.h"
+#include "timebase.h"
+#include "app.h"
+#include "adc.h"
+#include "sched.h"
+#include "fmt.h"
+#include "uart.h"
+#include "telemetry.h"
+
+#define RUNS            8
+#define EST_CALL_CYCLES 6
+#define EST_BUS_CYCLES  2
+#define MAX_PATHS       32
+#define LEVELS          3
+
+// Not in a header
+void Set_LEDs(uint8_t level);
+char scan_keypad(void);
+void TIM2_IRQHandler(void);
+void EXTI4_IRQHandler(void);
+void display_7_segment_4_digit(int number);
+
+static const char *level_names[LEVELS] = { "O0", "Os", "O2" };
+
+typedef struct {
+	const char *name;
+	void (*run)(void);
+	void (*settle)(void);  // between runs, interrupts on
+	const char *ref;       // reference printed with this label, not budgeted
+} path_t;
+
+typedef struct {
+	char name[32];
+	long budget[LEVELS];
+} budget_t;
+
+static budget_t budgets[MAX_PATHS];
+static int nbudgets;
+static sim_count_t base;  // cost of an empty window
+
+// Paths
+
+static void run_lcd(void)
+{
+	lcd('A', 1);
+}
+
+static void run_lcd_string(void)
+{
+	lcd_string("T:23C H:45% Fan ");
+}
+
+static void run_single_print(void)
+{
+	single_print(1234);
+}
+
+// Pin setup before board.h, as each driver did it in its own init:
+// lcd_gpio_init(), keypad gpio_init(), LDR GPIO_Init() and ADC1_Init(),
+// the DHT11 pull-up and motor_init(), tb6612fng GPIO_Init(). The LCD one
+// assigns AHB1ENR as it did; the simulator does not gate clocks.
+static void old_pin_init(void)
+{
+	RCC->AHB1ENR = (0x07 << 0);
+	GPIOA->MODER |= (5 << 0);
+	GPIOB->MODER |= (5 << 24);
+	GPIOB->MODER |= (5 << 28);
+	GPIOB->MODER |= (5 << 0);
+	GPIOC->MODER |= (5 << 8);
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN | RCC_AHB1ENR_GPIOAEN;
+	for (int pin = 2; pin <= 5; pin++) {
+		GPIOB->MODER &= ~(3 << (pin * 2));
+		GPIOB->MODER |= (1 << (pin * 2));
+		GPIOB->ODR |= (1 << pin);
+	}
+	for (int pin = 9; pin <= 12; pin++) {
+		GPIOA->MODER &= ~(3 << (pin * 2));
+		GPIOA->PUPDR &= ~(3 << (pin * 2));
+		GPIOA->PUPDR |= (1 << (pin * 2));
+	}
+	GPIOC->MODER &= ~(3 << (6 * 2));
+	GPIOC->MODER |= (1 << (6 * 2));
+	GPIOB->MODER &= ~(3 << (13 * 2));
+	GPIOB->MODER |= (1 << (13 * 2));
+	GPIOC->MODER &= ~(3 << (0 * 2));
+	GPIOC->MODER |= (1 << (0 * 2));
+	GPIOC->MODER &= ~(3 << (1 * 2));
+	GPIOC->MODER |= (1 << (1 * 2));
+	GPIOC->ODR |= (1 << 0);
+	GPIOC->ODR |= (1 << 1);
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN;
+	GPIOA->MODER |= (1 << (2 * 2)) | (1 << (3 * 2)) | (1 << (6 * 2)) | (1 << (7 * 2));
+	GPIOB->MODER |= (1 << (8 * 2));
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
+	GPIOA->MODER |= (3 << (5 * 2));
+
+	GPIOA->MODER &= ~(3 << (4 * 2));
+	GPIOA->PUPDR &= ~(3 << (4 * 2));
+	GPIOA->PUPDR |= (1 << (4 * 2));
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
+	GPIOB->MODER &= ~(3 << (0 * 2));
+	GPIOB->MODER |= (1 << (0 * 2));
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN;
+	GPIOC->MODER |= (1 << (6 * 2)) | (1 << (7 * 2)) | (1 << (8 * 2)) | (1 << (9 * 2)) | (1 << (13 * 2));
+	GPIOC->OTYPER &= ~((1 << 6) | (1 << 7) | (1 << 8) | (1 << 9) | (1 << 13));
+	GPIOC->OSPEEDR |= (3 << (6 * 2)) | (3 << (7 * 2)) | (3 << (8 * 2)) | (3 << (9 * 2)) | (3 << (13 * 2));
+	GPIOB->MODER &= ~(3 << (6 * 2));
+	GPIOB->MODER |= (2 << (6 * 2));
+	GPIOB->AFR[0] |= (2 << (6 * 4));
+}
+
+static void run_old_pin_init(void)
+{
+	old_pin_init();
+}
+
+// Runs right after the old one, so it also puts the board pins back
+static void run_board_init(void)
+{
+	board_init();
+}
+
+static void settle_lcd(void)
+{
+	lcd_flush_wait();
+}
+
+// A log line as the console prints them, and everything the wire carried
+static const char log_line[] = "T:+21.5C H:55% fan:40% light:8123 relay:1 key:- up:00012345 ok\r\n";
+#define LOG_LINE (sizeof(log_line) - 1)
+
+static FILE *uart_cap;
+
+// Until the wire has carried every byte handed to the DMA or sent polled,
+// which is also when both TX buffers are empty
+static void uart_drain(void)
+{
+	uart_stats_t st;
+
+	while (uart_stats(&st, 0), (uint64_t)ftell(uart_cap) != (uint64_t)st.tx_bytes + st.tx_blocking)
+		__WFI();
+}
+
+static void run_uart_write(void)
+{
+	uart_write(log_line, LOG_LINE);
+}
+
+// The climate_task lines, alternating between two readings
+static uint8_t refresh_n;
+static char refresh_line[LCD_COLS + 1] = "T:0000C H:0000% ";
+static char refresh_fan[LCD_COLS + 1] = "Fan:0025% Normal";
+
+static void refresh_text(void)
+{
+	fmt_u32(&refresh_line[2], 22 + (refresh_n & 1), 4, FMT_ZERO);
+	fmt_u32(&refresh_line[10], 50 + (refresh_n & 1), 4, FMT_ZERO);
+	refresh_n++;
+}
+
+static void run_lcd_refresh(void)
+{
+	refresh_text();
+	lcd(0x80, 0);
+	lcd_string(refresh_line);
+	lcd(0xC0, 0);
+	lcd_string(refresh_fan);
+}
+
+static void run_lcd_fb_refresh(void)
+{
+	refresh_text();
+	lcd_fb_puts(0, 0, refresh_line);
+	lcd_fb_puts(1, 0, refresh_fan);
+	lcd_fb_flush();
+}
+
+// One frame, 45 %RH 23 C, as the EXTI4 edges stamp it
+static uint32_t frame[42];
+
+static void make_frame(void)
+{
+	uint8_t d[5] = { 45, 0, 23, 0, 68 };
+	uint32_t ts = 1000;
+
+	frame[0] = ts;
+	frame[1] = ts += 160;
+	for (int i = 0; i < 40; i++)
+		frame[i + 2] = ts += 50 + ((d[i >> 3] >> (7 - (i & 7))) & 1 ? 70 : 26);
+}
+
+static void run_dht11_decode(void)
+{
+	dht11_dec_t dec;
+
+	dht11_dec_reset(&dec);
+	for (int i = 0; i < 42; i++)
+		if (dht11_dec_edge(&dec, frame[i]) != DHT11_BUSY)
+			break;
+}
+
+// dth11.c before the EXTI driver: the 18 ms start pulse, then every bit
+// sampled 40 us after it rises, blocking throughout. Its delays were a
+// __NOP() loop and a SysTick spin; sim_spin() holds the core for the same
+// time without stepping a polling loop on the host.
+static void poll_delay_us(uint32_t us)
+{
+	sim_spin(SIM_US(us));
+}
+
+static int poll_dht11_read(uint8_t *t, uint8_t *h)
+{
+	uint8_t d[5] = { 0 };
+
+	GPIOA->MODER &= ~(3 << 8);
+	GPIOA->MODER |= (1 << (4 * 2));
+	GPIOA->BSRR = (1 << (4 + 16));
+	poll_delay_us(18000);
+	GPIOA->BSRR = (1 << 4);
+	poll_delay_us(30);
+	GPIOA->MODER &= ~(3 << (4 * 2));
+	GPIOA->PUPDR &= ~(3 << (4 * 2));
+	GPIOA->PUPDR |= (1 << (4 * 2));
+
+	poll_delay_us(40);
+	if ((GPIOA->IDR >> 4) & 1)
+		return -1;
+	poll_delay_us(80);
+	if (!((GPIOA->IDR >> 4) & 1))
+		return -1;
+	poll_delay_us(80);
+
+	for (int i = 0; i < 5; i++) {
+		for (int j = 0; j < 8; j++) {
+			uint32_t tmo = 1000;
+
+			while (!((GPIOA->IDR >> 4) & 1) && tmo--)
+				poll_delay_us(1);
+			poll_delay_us(40);
+			if ((GPIOA->IDR >> 4) & 1)
+				d[i] |= (1 << (7 - j));
+			tmo = 1000;
+			while (((GPIOA->IDR >> 4) & 1) && tmo--)
+				poll_delay_us(1);
+		}
+	}
+
+	if ((d[0] + d[1] + d[2] + d[3]) != d[4])
+		return -1;
+	*h = d[0];
+	*t = d[2];
+	return 0;
+}
+
+static void run_tm1637_build(void)
+{
+	static const uint8_t seg[4] = { 0x06, 0x5B, 0x4F, 0x66 };
+	static uint32_t buf[TM1637_WORDS];
+
+	tm1637_build(buf, seg, 0x8F);
+}
+
+static void run_display(void)
+{
+	display_7_segment_4_digit(1234);
+}
+
+static void settle_display(void)
+{
+	while (tm1637_busy());
+}
+
+// The climate line: 1234 as the panel shows it, 23.5 C from a Q16 reading
+static char fmt_buf[32];
+static volatile uint32_t fmt_val = 1234;
+static volatile int32_t fmt_temp = 0x00178000;
+
+static void run_fmt_u32(void)
+{
+	fmt_u32(fmt_buf, fmt_val, 4, FMT_ZERO);
+}
+
+static void run_snprintf_u32(void)
+{
+	snprintf(fmt_buf, sizeof(fmt_buf), "%04u", (unsigned)fmt_val);
+}
+
+static void run_fmt_q(void)
+{
+	fmt_q(fmt_buf, fmt_temp, 16, 1, 5, 0);
+}
+
+// What the firmware would write without fmt_q: a float and %f
+static void run_snprintf_q(void)
+{
+	snprintf(fmt_buf, sizeof(fmt_buf), "%5.1f", fmt_temp / 65536.0);
+}
+
+// A frame after a climate read: temperature, humidity, light and duty
+// moved by a step each since the previous frame
+#define TELEM_MASK ((1UL << TM_TEMP) | (1UL << TM_HUM) | (1UL << TM_LIGHT) | (1UL << TM_DUTY))
+
+static const int32_t telem_prev[TM_CHANNELS] = { 22, 56, 8101, 1, 1, 0, 375 };
+static volatile int32_t telem_val[TM_CHANNELS] = { 23, 55, 8123, 1, 1, 0, 400 };
+static telem_state_t telem_st;
+static uint8_t telem_frame[TELEM_FRAME_MAX];
+static char telem_text[64];
+
+static void settle_telem(void)
+{
+	memcpy(telem_st.val, telem_prev, sizeof(telem_st.val));
+	telem_st.known = (1UL << TM_KEY) - 1;
+	telem_st.time = 998000;
+	telem_st.since_key = 1;  // not a keyframe
+}
+
+static void run_telem_encode(void)
+{
+	telem_encode(&telem_st, 1000000, TELEM_MASK, (const int32_t *)telem_val, telem_frame);
+}
+
+static void run_snprintf_telem(void)
+{
+	snprintf(telem_text, sizeof(telem_text), "%u T%d H%d L%d D%d\n", 1000000u, (int)telem_val[TM_TEMP],
+	         (int)telem_val[TM_HUM], (int)telem_val[TM_LIGHT], (int)telem_val[TM_DUTY]);
+}
+
+// One half buffer of full-scale noise, as the DMA ISR gets it
+static volatile uint16_t adc_blk[ADC_OVERSAMPLE][ADC_NUM_CH];
+static volatile uint16_t adc_dec[ADC_NUM_CH];
+static uint32_t adc_rng = 1;
+
+static void adc_fill(void)
+{
+	for (int i = 0; i < ADC_OVERSAMPLE; i++)
+		for (int c = 0; c < ADC_NUM_CH; c++) {
+			adc_rng ^= adc_rng << 13;
+			adc_rng ^= adc_rng >> 17;
+			adc_rng ^= adc_rng << 5;
+			adc_blk[i][c] = adc_rng & 0xFFF;
+		}
+}
+
+static void run_adc_decimate(void)
+{
+	adc_decimate(adc_blk, adc_dec);
+}
+
+static void run_scan_keypad(void)
+{
+	scan_keypad();
+}
+
+// keypad.c before the EXTI scanner: 50 us settle per row, then blocks
+// until the key is released and a 5 ms debounce. Its __NOP() loop delay
+// takes no virtual time on the host, delay_us() waits it out instead.
+static const char poll_keymap[4][4] = {
+	{ '1', '2', '3', 'A' }, { '4', '5', '6', 'B' }, { '7', '8', '9', 'C' }, { '*', '0', '#', 'D' },
+};
+
+static char poll_scan_keypad(void)
+{
+	for (int row = 0; row < 4; row++) {
+		GPIOB->ODR |= (0xF << 2);
+		GPIOB->ODR &= ~(1 << (row + 2));
+		delay_us(50);
+
+		for (int col = 0; col < 4; col++) {
+			if (!(GPIOA->IDR & (1 << (9 + col)))) {
+				while (!(GPIOA->IDR & (1 << (9 + col))));
+				for (int i = 0; i < 5; i++)
+					delay_us(1000);
+				return poll_keymap[row][col];
+			}
+		}
+	}
+	return 0;
+}
+
+static void run_poll_keypad(void)
+{
+	poll_scan_keypad();
+}
+
+static void run_set_leds(void)
+{
+	Set_LEDs(3);
+}
+
+static const path_t paths[] = {
+	{ "old_pin_init",   run_old_pin_init,   0,              "old"  },
+	{ "board_init",     run_board_init,     0,              0      },
+	{ "lcd",            run_lcd,            settle_lcd,     0      },
+	{ "lcd_string",     run_lcd_string,     settle_lcd,     0      },
+	{ "single_print",   run_single_print,   settle_lcd,     0      },
+	{ "lcd_refresh",    run_lcd_refresh,    settle_lcd,     0      },
+	{ "lcd_fb_refresh", run_lcd_fb_refresh, settle_lcd,     0      },
+	{ "dht11_decode",   run_dht11_decode,   0,              0      },
+	{ "tm1637_build",   run_tm1637_build,   0,              0      },
+	{ "display_7seg",   run_display,        settle_display, 0      },
+	{ "adc_decimate",   run_adc_decimate,   0,              0      },
+	{ "scan_keypad",    run_scan_keypad,    0,              0      },
+	{ "poll_keypad",    run_poll_keypad,    0,              "old"  },
+	{ "set_leds",       run_set_leds,       0,              0      },
+	{ "uart_write",     run_uart_write,     uart_drain,     0      },
+	{ "fmt_u32",        run_fmt_u32,        0,              0      },
+	{ "snprintf_u32",   run_snprintf_u32,   0,              "libc" },
+	{ "fmt_q",          run_fmt_q,          0,              0      },
+	{ "snprintf_q",     run_snprintf_q,     0,              "libc" },
+	{ "telem_encode",   run_telem_encode,   settle_telem,   0      },
+	{ "snprintf_telem", run_snprintf_telem, 0,              "libc" },
+};
+#define NPATHS (sizeof(paths) / sizeof(paths[0]))
+
+static uint64_t estimate(const sim_count_t *c)
+{
+	return c->insns + EST_CALL_CYCLES * c->calls + EST_BUS_CYCLES * c->accesses;
+}
+
+// Best of RUNS, after one warm-up call (lazy binding, first-use paths)
+static void measure(void (*run)(void), void (*settle)(void), sim_count_t *best)
+{
+	sim_count_t c;
+
+	memset(best, 0, sizeof(*best));
+	for (int i = 0; i <= RUNS; i++) {
+		if (settle) {
+			__enable_irq();
+			settle();
+		}
+		__disable_irq();
+		sim_count_begin();
+		run();
+		sim_count_end(&c);
+		c.insns -= base.insns;
+		if (i && (!best->insns || c.insns < best->insns))
+			*best = c;
+	}
+	__enable_irq();
+}
+
+static void empty(void)
+{
+}
+
+// Budget file
+
+static int level_index(const char *name)
+{
+	for (int i = 0; i < LEVELS; i++)
+		if (!strcmp(level_names[i], name))
+			return i;
+	return -1;
+}
+
+static void load_budgets(const char *path)
+{
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f) && nbudgets < MAX_PATHS) {
+		budget_t *b = &budgets[nbudgets];
+
+		if (line[0] == '#' || sscanf(line, "%31s %ld %ld %ld", b->name, &b->budget[0],
+		                             &b->budget[1], &b->budget[2]) != 4)
+			continue;
+		nbudgets++;
+	}
+	fclose(f);
+}
+
+static budget_t *find_budget(const char *name)
+{
+	for (int i = 0; i < nbudgets; i++)
+		if (!strcmp(budgets[i].name, name))
+			return &budgets[i];
+	return 0;
+}
+
+// Rewrites only the budget lines, comments stay
+static int save_budgets(const char *path)
+{
+	char line[256], name[32];
+	char out[8192];
+	size_t len = 0;
+	FILE *f = fopen(path, "r");
+
+	while (f && fgets(line, sizeof(line), f)) {
+		budget_t *b;
+
+		if (line[0] != '#' && sscanf(line, "%31s", name) == 1 && (b = find_budget(name)))
+			continue;
+		len += snprintf(out + len, sizeof(out) - len, "%s", line);
+	}
+	if (f)
+		fclose(f);
+	for (int i = 0; i < nbudgets; i++)
+		len += snprintf(out + len, sizeof(out) - len, "%-16s %8ld %8ld %8ld\n", budgets[i].name,
+		                budgets[i].budget[0], budgets[i].budget[1], budgets[i].budget[2]);
+	if (!(f = fopen(path, "w")))
+		return -1;
+	fwrite(out, 1, len, f);
+	fclose(f);
+	return 0;
+}
+
+// Panel writes per refresh; each is three TIM6 ticks of the ISR
+static uint32_t lcd_writes(void (*run)(void))
+{
+	uint32_t w = sim_lcd_writes();
+
+	run();
+	lcd_flush_wait();
+	return sim_lcd_writes() - w;
+}
+
+static int check_lcd_refresh(void)
+{
+	uint32_t lines, redraw, fb;
+
+	lcd_flush_wait();
+	lines = lcd_writes(run_lcd_refresh);
+	lcd_fb_invalidate();  // the lines went around the framebuffer
+	redraw = lcd_writes(run_lcd_fb_refresh);
+	fb = lcd_writes(run_lcd_fb_refresh);
+	printf("%-16s %8u panel writes as lines, %u through the framebuffer\n", "lcd_writes",
+	       (unsigned)lines, (unsigned)fb);
+	if (fb >= lines || redraw < LCD_ROWS * LCD_COLS || strcmp(sim_lcd_line(0), refresh_line) || strcmp(sim_lcd_line(1), refresh_fan)) {
+		printf("FAIL lcd_writes: panel shows |%s|%s|\n", sim_lcd_line(0), sim_lcd_line(1));
+		return 1;
+	}
+	return 0;
+}
+
+static int check_decimate(void)
+{
+	for (int n = 0; n < 1000; n++) {
+		adc_fill();
+		if (n == 1)
+			for (int i = 0; i < ADC_OVERSAMPLE; i++)
+				adc_blk[i][0] = 0xFFF;  // full scale must not overflow
+		adc_decimate(adc_blk, adc_dec);
+		for (int c = 0; c < ADC_NUM_CH; c++) {
+			uint32_t sum = 0;
+
+			for (int i = 0; i < ADC_OVERSAMPLE; i++)
+				sum += adc_blk[i][c];
+			if (adc_dec[c] != sum >> ADC_DECIM_SHIFT || adc_dec[c] >= 1U << ADC_BITS) {
+				printf("FAIL adc_decimate: channel %d gave %u for a sum of %u\n", c,
+				       (unsigned)adc_dec[c], (unsigned)sum);
+				return 1;
+			}
+		}
+	}
+	printf("%-16s %8u blocks of %u scans x %u channels against the sum\n", "adc_decimate", 1000U,
+	       (unsigned)ADC_OVERSAMPLE, (unsigned)ADC_NUM_CH);
+	return 0;
+}
+
+// DHT11: one read through the driver with the interrupts held off and
+// each handler called here when its line is pending, as the NVIC would,
+// so every one of them is counted; then the polled read with the same
+// sensor answer
+
+#define DHT_TEMP 23
+#define DHT_HUM  45
+
+static sim_count_t dht_cost;  // one read, summed
+static uint32_t dht_irqs;
+
+static void dht_count(void (*fn)(void))
+{
+	sim_count_t c;
+
+	sim_count_begin();
+	fn();
+	sim_count_end(&c);
+	dht_cost.insns += c.insns - base.insns;
+	dht_cost.accesses += c.accesses;
+	dht_cost.calls += c.calls;
+}
+
+static void dht_start(void)
+{
+	dht11_start();
+}
+
+static int check_dht11(void)
+{
+	uint32_t pin = PIN_BIT(DHT11), timer = 0, edges = 0;
+	uint64_t t0, poll, est;
+	uint8_t t = 0, h = 0, pt = 0, ph = 0;
+	int st, pst;
+
+	sim_dht11_set(DHT_TEMP, DHT_HUM);
+	dht11_init(0);
+	__disable_irq();
+	dht_count(dht_start);
+	while ((st = dht11_result(&t, &h)) == DHT11_BUSY) {  // a firmware call moves the clock
+		__WFI();
+		if (EXTI->PR & EXTI->IMR & pin) {
+			dht_count(EXTI4_IRQHandler);
+			edges++;
+		} else if (TIM2->SR & TIM2->DIER & TIM_SR_CC1IF) {
+			dht_count(TIM2_IRQHandler);
+			timer++;
+		}
+	}
+	dht_irqs = timer + edges;
+	est = estimate(&dht_cost) + (uint64_t)SIM_IRQ_CYCLES * dht_irqs;
+
+	sim_spin(SIM_MS(1));  // the sensor ends its frame after the last falling edge
+	t0 = sim_now;
+	pst = poll_dht11_read(&pt, &ph);
+	poll = sim_now - t0;
+	__enable_irq();
+
+	printf("%-16s %8llu est cycles per read, start + %u TIM2 + %u EXTI4 interrupts\n", "dht11_read",
+	       (unsigned long long)est, (unsigned)timer, (unsigned)edges);
+	printf("%-16s %8llu cycles polled, the core held %.1f ms\n", "dht11_read",
+	       (unsigned long long)poll, (double)poll * 1000 / SIM_HZ);
+	if (st != DHT11_OK || t != DHT_TEMP || h != DHT_HUM || pst || pt != DHT_TEMP || ph != DHT_HUM ||
+	    est * 10 > poll) {
+		printf("FAIL dht11_read: driver %d %u C %u %%, polled %d %u C %u %%\n", st, t, h, pst, pt, ph);
+		return 1;
+	}
+	return 0;
+}
+
+#define KEY_5      5    // row 1, column 1
+#define KEY_HOLD   20   // ms, the polled scan spins on IDR for all of it
+#define KEY_SETTLE 12   // ms, two 4-row frames and the tick it starts on
+
+static void key_release(void *arg)
+{
+	sim_key(KEY_5, 0);
+}
+
+static int check_keyscan(void)
+{
+	uint32_t cols = PIN_BIT(KEY_COL0) * 0xF, ghosts, wake_max;
+	uint64_t t0, press, poll;
+	key_event_t ev;
+	char key;
+
+	GPIOB->ODR &= ~(0xF << 2);  // the poll_keypad path left a row pattern behind
+	sched_init();               // SysTick runs the scan timer from here on
+	__enable_irq();
+
+	// old_pin_init drops the column pull-ups, which starts a scan; with no
+	// key down it ends and the columns are armed again after two frames
+	t0 = sim_now;
+	while (keyscan_get(&ev) || ((EXTI->IMR & cols) != cols && sim_now < t0 + SIM_MS(KEY_SETTLE)))
+		__WFI();
+	if ((EXTI->IMR & cols) != cols) {
+		printf("FAIL keyscan: not armed on the columns while idle\n");
+		return 1;
+	}
+
+	t0 = sim_now;
+	sim_key(KEY_5, 1);
+	while (!keyscan_get(&ev))
+		__WFI();
+	press = sim_now - t0;
+	while (sim_now < t0 + SIM_MS(KEY_HOLD) && keyscan_state())  // a firmware call takes the IRQs
+		__WFI();
+	sim_key(KEY_5, 0);
+	while (!keyscan_get(&ev) || ev.type != KEY_RELEASE)
+		__WFI();
+	keyscan_stats(&ghosts, &wake_max);
+
+	// The polled scan with the scanner's interrupts held off
+	__disable_irq();
+	t0 = sim_now;
+	sim_key(KEY_5, 1);
+	sim_at(t0 + SIM_MS(KEY_HOLD), key_release, 0);
+	key = poll_scan_keypad();
+	poll = sim_now - t0;
+	__enable_irq();
+	while (keyscan_get(&ev));
+
+	printf("%-16s %8.1f ms press to event, polled %.1f ms (returns on release)\n", "keyscan",
+	       (double)press * 1000 / SIM_HZ, (double)poll * 1000 / SIM_HZ);
+	printf("%-16s %8s idle on EXTI, no timer; scan wake to event %.1f ms\n", "keyscan", "0",
+	       (double)wake_max * 1000 / SIM_HZ);
+	if (ev.code != KEY_5 || key != '5' || press >= poll) {
+		printf("FAIL keyscan: event %u, polled key %c\n", ev.code, key ? key : '-');
+		return 1;
+	}
+	return 0;
+}
+
+// Console logging: the caller's time for one line through the DMA buffers
+// and polled, then lines offered at twice the wire rate. The wire must stay
+// busy, and every byte is either carried or counted as dropped. SysTick
+// runs from check_keyscan() on, so the waits here wake every tick.
+
+#define LOG_EVERY  3    // ms per line, about twice what 115200 baud carries
+#define LOG_RUN    500  // ms
+
+static int check_uart(void)
+{
+	uint64_t t0, dma, polled, caller = 0, next, end, wire0, wire;
+	uint32_t lines = 0, offered = 0, taken = 0, rate = UART_BAUD / 10;
+	uart_stats_t st0, st;
+
+	uart_drain();
+	__disable_irq();
+	t0 = sim_now;
+	uart_write(log_line, LOG_LINE);
+	dma = sim_now - t0;
+	__enable_irq();
+	uart_drain();
+	t0 = sim_now;
+	uart_write_blocking(log_line, LOG_LINE);
+	polled = sim_now - t0;
+
+	uart_stats(&st0, 0);
+	wire0 = ftell(uart_cap);
+	next = t0 = sim_now;
+	end = t0 + SIM_MS(LOG_RUN);
+	while (sim_now < end) {
+		if (sim_now < next) {
+			uart_stats(&st, 0);  // a firmware call takes the IRQs
+			__WFI();
+			continue;
+		}
+		__disable_irq();
+		next += SIM_MS(LOG_EVERY);
+		t0 = sim_now;
+		taken += uart_write(log_line, LOG_LINE);
+		caller += sim_now - t0;
+		__enable_irq();
+		offered += LOG_LINE;
+		lines++;
+	}
+	wire = ftell(uart_cap) - wire0;
+	uart_drain();
+	uart_stats(&st, 0);
+
+	printf("%-16s %8.1f us per %u-byte line in the caller, %.1f us polled\n", "uart_log",
+	       (double)dma * 1e6 / SIM_HZ, (unsigned)LOG_LINE, (double)polled * 1e6 / SIM_HZ);
+	printf("%-16s %8.1f us per line over %u lines, %u of %u B/s carried, %u B dropped\n", "uart_log",
+	       (double)caller * 1e6 / SIM_HZ / lines, lines, (unsigned)(wire * 1000 / LOG_RUN), rate,
+	       st.tx_dropped - st0.tx_dropped);
+	if (dma * 10 > polled || wire * 1000 / LOG_RUN < rate * 95 / 100 ||
+	    st.tx_bytes - st0.tx_bytes != taken || st.tx_dropped - st0.tx_dropped != offered - taken) {
+		printf("FAIL uart_log: %u of %u bytes sent, %u dropped\n", st.tx_bytes - st0.tx_bytes, offered,
+		       st.tx_dropped - st0.tx_dropped);
+		return 1;
+	}
+	return 0;
+}
+
+// Delays: virtual time must cover the request and the work must scale
+
+static int check_delay(void)
+{
+	sim_count_t a, b;
+	uint64_t want = SIM_US(100);
+
+	__disable_irq();
+	sim_count_begin();
+	delay_us(10);
+	sim_count_end(&a);
+	sim_count_begin();
+	delay_us(100);
+	sim_count_end(&b);
+	__enable_irq();
+
+	printf("%-16s %8llu insns  %9.1f us for 100 us\n", "delay_us", (unsigned long long)b.insns,
+	       (double)b.cycles * 1e6 / SIM_HZ);
+	if (b.cycles < want || b.insns <= a.insns) {
+		printf("FAIL delay_us: timing loop removed or short (%llu of %llu cycles)\n",
+		       (unsigned long long)b.cycles, (unsigned long long)want);
+		return 1;
+	}
+	return 0;
+}
+
+// fmt.c against snprintf: every width, flag and decimal count over values
+// around each power of ten and the ends of the range
+
+static uint32_t fmt_rng = 1;
+
+static uint32_t fmt_value(uint32_t i)
+{
+	static const uint32_t edges[] = { 0, 1, 9, 10, 99, 100, 999, 1000, 9999, 10000, 65535, 65536,
+	                                  99999, 100000, 999999999, 1000000000, 0x7FFFFFFF,
+	                                  0x80000000, 0xFFFFFFFF };
+	uint32_t n = sizeof(edges) / sizeof(edges[0]);
+
+	if (i < 3 * n)
+		return edges[i / 3] + i % 3 - 1;
+	fmt_rng ^= fmt_rng << 13;
+	fmt_rng ^= fmt_rng >> 17;
+	fmt_rng ^= fmt_rng << 5;
+	return fmt_rng >> (fmt_rng & 31);
+}
+
+static int fmt_compare(const char *what, uint32_t v, const char *got, uint32_t n, const char *want)
+{
+	if (n == strlen(want) && !memcmp(got, want, n))
+		return 0;
+	printf("FAIL %s(0x%08x): \"%.*s\", snprintf \"%s\"\n", what, (unsigned)v, (int)n, got, want);
+	return 1;
+}
+
+// The printf spec for flags and width, the conversion appended by the caller
+static void fmt_spec(char *spec, uint8_t flags, uint8_t width)
+{
+	spec += sprintf(spec, "%%%s%s%s", flags & FMT_LEFT ? "-" : "", flags & FMT_PLUS ? "+" : "",
+	                flags & FMT_ZERO ? "0" : "");
+	if (width)
+		sprintf(spec, "%u", width);
+}
+
+static int check_fmt(void)
+{
+	static const uint8_t widths[] = { 0, 1, 4, 8, 12 };
+	char got[64], want[64], spec[16], conv[24];
+	uint32_t checks = 0;
+	int fail = 0;
+
+	for (uint32_t i = 0; i < 4000 && fail < 10; i++) {
+		uint32_t v = fmt_value(i);
+
+		for (uint8_t flags = 0; flags < 16; flags++) {
+			for (uint32_t w = 0; w < sizeof(widths); w++) {
+				uint8_t f = flags & ~FMT_UPPER, u = f & ~FMT_PLUS;
+				uint32_t n;
+
+				// %u ignores '+', fmt_u32 does not
+				fmt_spec(spec, u, widths[w]);
+				snprintf(conv, sizeof(conv), "%su", spec);
+				snprintf(want, sizeof(want), conv, (unsigned)v);
+				n = fmt_u32(got, v, widths[w], u);
+				fail += fmt_compare("fmt_u32", v, got, n, want);
+
+				fmt_spec(spec, f, widths[w]);
+				snprintf(conv, sizeof(conv), "%sd", spec);
+				snprintf(want, sizeof(want), conv, (int)v);
+				n = fmt_i32(got, v, widths[w], f);
+				fail += fmt_compare("fmt_i32", v, got, n, want);
+
+				fmt_spec(spec, u, widths[w]);
+				snprintf(conv, sizeof(conv), "%s%c", spec, flags & FMT_UPPER ? 'X' : 'x');
+				snprintf(want, sizeof(want), conv, (unsigned)v);
+				n = fmt_hex(got, v, widths[w], flags);
+				fail += fmt_compare("fmt_hex", v, got, n, want);
+				checks += 3;
+			}
+		}
+
+		// Decimal fixed point against the exact value it stands for
+		for (uint8_t dec = 0; dec <= 9; dec++) {
+			int32_t s = v;
+			uint32_t mag = s < 0 ? 0U - (uint32_t)s : (uint32_t)s;
+			uint64_t p = 1;
+			char digits[24];
+
+			for (uint8_t k = 0; k < dec; k++)
+				p *= 10;
+			if (dec)
+				sprintf(digits, "%s%llu.%0*llu", s < 0 ? "-" : "", (unsigned long long)(mag / p),
+				        dec, (unsigned long long)(mag % p));
+			else
+				sprintf(digits, "%s%u", s < 0 ? "-" : "", mag);
+			snprintf(want, sizeof(want), "%12s", digits);
+			fail += fmt_compare("fmt_fixed", v, got, fmt_fixed(got, s, dec, 12, 0), want);
+			checks++;
+		}
+
+		for (uint8_t bits = 0; bits <= 16; bits += 8) {
+			int32_t s = (int32_t)v >> (v & 7);
+			double x = s / (double)(1 << bits);
+			uint32_t n;
+
+			// %f rounds exact ties to even and prints -0.00, fmt_q rounds
+			// them away from zero and never signs a zero: both skipped
+			snprintf(want, sizeof(want), "%.2f", x);
+			if (fabs(x * 100 - floor(x * 100) - 0.5) < 1e-6 || !strcmp(want, "-0.00") ||
+			    fabs(x) * 100 >= 4294967295.0)
+				continue;
+			n = fmt_q(got, s, bits, 2, 0, 0);
+			fail += fmt_compare("fmt_q", v, got, n, want);
+			checks++;
+		}
+	}
+	printf("%-16s %8u conversions against snprintf\n", "fmt", (unsigned)checks);
+	return fail != 0;
+}
+
+static const char *opt_level = "O2", *budget_path;
+static int slack = 10, update;
+
+static int bench_main(void)
+{
+	int fail = 0, lvl = level_index(opt_level);
+
+	SystemCoreClockUpdate();
+	board_init();
+	timebase_init();
+	lcd_init();
+	access_init();
+	if (!(uart_cap = tmpfile())) {
+		perror("tmpfile");
+		exit(1);
+	}
+	sim_uart_capture(uart_cap);
+	uart_init();
+	__enable_irq();
+	lcd_flush_wait();
+	make_frame();
+	adc_fill();
+
+	__disable_irq();
+	sim_count_begin();
+	empty();
+	sim_count_end(&base);
+	__enable_irq();
+
+	printf("cycle budget at -%s, estimate = insns + %d/call + %d/access\n",
+	       opt_level, EST_CALL_CYCLES, EST_BUS_CYCLES);
+	printf("%-16s %8s %8s %8s %8s %8s\n", "path", "insns", "access", "calls", "est", "budget");
+	for (uint32_t i = 0; i < NPATHS; i++) {
+		sim_count_t c;
+		budget_t *b = find_budget(paths[i].name);
+		uint64_t est;
+
+		measure(paths[i].run, paths[i].settle, &c);
+		est = estimate(&c);
+		printf("%-16s %8llu %8llu %8llu %8llu", paths[i].name, (unsigned long long)c.insns,
+		       (unsigned long long)c.accesses, (unsigned long long)c.calls, (unsigned long long)est);
+		if (paths[i].ref) {
+			printf(" %8s\n", paths[i].ref);
+		} else if (update) {
+			if (!b && nbudgets < MAX_PATHS) {
+				b = &budgets[nbudgets++];
+				memset(b, 0, sizeof(*b));
+				snprintf(b->name, sizeof(b->name), "%s", paths[i].name);
+			}
+			if (b)
+				b->budget[lvl] = est;
+			printf("\n");
+		} else if (!b || !b->budget[lvl]) {
+			printf(" %8s\n", "-");
+		} else if (est * 100 > (uint64_t)b->budget[lvl] * (100 + slack)) {
+			printf(" %8ld  FAIL +%llu%%\n", b->budget[lvl],
+			       (unsigned long long)((est * 100 - b->budget[lvl] * 100) / b->budget[lvl]));
+			fail = 1;
+		} else {
+			printf(" %8ld\n", b->budget[lvl]);
+		}
+	}
+	fail |= check_lcd_refresh();
+	fail |= check_decimate();
+	fail |= check_dht11();
+	fail |= check_keyscan();
+	fail |= check_uart();
+	fail |= check_delay();
+	fail |= check_fmt();
+
+	if (update && budget_path && save_budgets(budget_path)) {
+		perror(budget_path);
+		fail = 1;
+	}
+	fflush(stdout);
+	exit(fail);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:b:s:u")) != -1) {
+		switch (opt) {
+		case 'l':
+			opt_level = optarg;
+			break;
+		case 'b':
+			budget_path = optarg;
+			break;
+		case 's':
+			slack = atoi(optarg);
+			break;
+		case 'u':
+			update = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: cyclebench -l O0|Os|O2 [-b budget.txt] [-s slack%%] [-u]\n");
+			return 2;
+		}
+	}
+	if (level_index(opt_level) < 0) {
+		fprintf(stderr, "cyclebench: unknown level %s\n", opt_level);
+		return 2;
+	}
+	if (budget_path)
+		load_budgets(budget_path);
+
+	sim_init();
+	sim_run(bench_main, SIM_S(3600));
+	return 0;
+}
@@ -0,0 +1,572 @@
+// Greenhouse day replay through the real control code.
+//
+//   dayreplay [-j jobs] [-o dir] [-n days] [-s seed] [-b lo:hi] [-B lo:hi] [trace.csv ...]
+//
+// climate_task() from src/dth11.c and light_task() from src/LDR.C run
+// unchanged against a virtual clock, at the periods main.c schedules
+// them: light every 200 ms, climate every 2 s plus the run the finished
+// read brings in. Only the drivers beneath them are replaced: DHT11 reads
+// and the LDR ADC value come from the trace, motor_set() and telem_set() are recorded, the LCD is dropped.
+// The FAN pin and the LED bar are read back from the GPIO BSRR stores.
+//
+// A trace is CSV, time_s,temp_c,hum_pct,light_mv[,status], one row per
+// sample, held until the next row. status is ok (or empty), drop (no
+// response) or sum (checksum mismatch) and applies to every read started
+// while the row holds. Lines starting with # and a header are skipped.
+// Without trace files -n synthetic days are generated from seeds -s,
+// -s+1, ...: sun-driven temperature, humidity and light with passing
+// clouds, scattered dropouts and checksum failures and one outage.
+//
+// Each trace replays in its own process, -j at a time (default one per
+// core), as the control code keeps its state in statics. One CSV summary
+// row per trace goes to stdout, in argument order:
+//
+//   seconds                   replayed time
+//   reads, ok, drop, sum      DHT11 read results
+//   outages                   DHT11_MISSES failed reads in a row (fan stopped)
+//   fan_starts, fan_on_pct    FAN pin off->on edges and time on
+//   duty_avg, duty_*_pct      fan speed, mean and time in 0, 1-33, 34-66, 67-100 %
+//   led_changes, led*_pct     LED bar changes and time at each level 0..5
+//   temp_in_pct, hum_in_pct   time the trace spent inside -b and -B
+//   hot_idle_pct              time above the -b band with the fan off
+//
+// -o writes <name>.timeline.csv (time_s,fan,duty_pct,leds at each change)
+// for every trace and <name>.trace.csv for generated days, so a day
+// that shows a problem can be replayed on its own.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "stm32f4xx.h"
+#include "app.h"
+#include "adc.h"
+#include "board.h"
+#include "dht11.h"
+#include "lcd.h"
+#include "tb6612.h"
+#include "telemetry.h"
+#include "probe.h"
+#include "sched.h"
+
+#define TICK_MS      200     // light_task period
+#define CLIMATE_MS   2000    // climate_task period
+#define DAY_S        86400
+#define SYNTH_STEP_S 2
+#define MISSES       3       // DHT11_MISSES in src/dth11.c
+#define ADC_MV       3300
+
+enum { ST_OK, ST_DROP, ST_SUM };
+
+typedef struct {
+	double t, temp, hum, mv;
+	uint8_t status;
+} sample_t;
+
+typedef struct {
+	sample_t *s;
+	size_t n, cap;
+} trace_t;
+
+typedef struct {
+	uint32_t reads, ok, drop, sum, outages;
+	uint32_t fan_starts, led_changes;
+	double fan_on, duty_sum, duty_band[4], led[6];
+	double temp_in, hum_in, hot_idle, total;
+	double host_ms;
+} result_t;
+
+static const char *out_dir;
+static int band_lo = 18, band_hi = 24, hum_lo = 50, hum_hi = 80;
+
+// Replay state the stubs read and write
+static const trace_t *cur;
+static size_t cur_row;
+static uint32_t now_ms;
+static int pending = DHT11_BUSY;
+static uint8_t pending_t, pending_h;
+static dht11_cb_t done_cb;
+static int rerun;                       // climate_task re-armed by the read
+static int32_t duty_pm;                 // TM_DUTY, per mille
+
+// Sample holding at now_ms; rows are in time order and time only moves on
+static const sample_t *sample_now(void)
+{
+	double t = now_ms / 1000.0;
+
+	while (cur_row + 1 < cur->n && cur->s[cur_row + 1].t <= t)
+		cur_row++;
+	return &cur->s[cur_row];
+}
+
+// Driver stubs
+
+// The probes in the tasks record here, against a DWT that never counts
+probe_t probes[PROBE_COUNT];
+
+void dht11_init(dht11_cb_t cb)
+{
+	done_cb = cb;
+}
+
+// The read finishes well inside a 200 ms tick, so it is done at the start
+int dht11_start(void)
+{
+	const sample_t *s = sample_now();
+	double t = floor(s->temp), h = floor(s->hum);
+
+	pending = s->status == ST_DROP ? DHT11_ERR : s->status == ST_SUM ? DHT11_ERR_SUM : DHT11_OK;
+	pending_t = t < 0 ? 0 : t > 255 ? 255 : t;
+	pending_h = h < 0 ? 0 : h > 100 ? 100 : h;
+	if (done_cb)
+		done_cb(pending, pending_t, pending_h);
+	return 0;
+}
+
+void sched_once(int id, uint32_t delay)
+{
+	rerun = 1;
+}
+
+int dht11_result(uint8_t *t, uint8_t *h)
+{
+	int st = pending;
+
+	pending = DHT11_BUSY;
+	*t = pending_t;
+	*h = pending_h;
+	return st;
+}
+
+void adc_init(void)
+{
+}
+
+uint16_t adc_value(uint8_t ch)
+{
+	double mv = sample_now()->mv;
+
+	mv = mv < 0 ? 0 : mv > ADC_MV ? ADC_MV : mv;
+	return mv * ((1 << ADC_BITS) - 1) / ADC_MV;
+}
+
+void lcd_fb_puts(uint8_t row, uint8_t col, const char *str)
+{
+}
+
+void lcd_fb_flush(void)
+{
+}
+
+void motor_set(uint8_t ch, int16_t speed, uint16_t ramp_ms)
+{
+}
+
+uint8_t access_busy(void)
+{
+	return 0;
+}
+
+void telem_set(uint8_t ch, int32_t v)
+{
+	if (ch == TM_DUTY)
+		duty_pm = v;
+}
+
+// What the pins settle to after the task's BSRR stores
+static void latch(GPIO_TypeDef *port)
+{
+	uint32_t bsrr = port->BSRR;
+
+	port->ODR = (port->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFF);
+	port->BSRR = 0;
+}
+
+#define ODR_BIT(name) ((PIN_PORT(name)->ODR >> name##_N) & 1)
+
+static int led_level(void)
+{
+	return ODR_BIT(LED_C1) + ODR_BIT(LED_C3) + ODR_BIT(LED_C5) + ODR_BIT(LED_C7) + ODR_BIT(LED_C9);
+}
+
+// One trace, one day or however long it runs
+
+static void replay(const trace_t *tr, const char *name, result_t *r)
+{
+	FILE *tl = 0;
+	struct timespec a, b;
+	uint32_t end_ms = (uint32_t)(tr->s[tr->n - 1].t * 1000) + CLIMATE_MS;
+	int fan = 0, leds = -1, last_fan = -1, last_leds = -1, run = 0;
+	int32_t last_duty = -1;
+
+	if (out_dir) {
+		char path[512];
+
+		snprintf(path, sizeof(path), "%s/%s.timeline.csv", out_dir, name);
+		if ((tl = fopen(path, "w")))
+			fprintf(tl, "time_s,fan,duty_pct,leds\n");
+		else
+			perror(path);
+	}
+
+	memset(r, 0, sizeof(*r));
+	cur = tr;
+	cur_row = 0;
+	now_ms = 0;
+	clock_gettime(CLOCK_MONOTONIC, &a);
+
+	climate_init(0);
+	light_init();
+	for (; now_ms < end_ms; now_ms += TICK_MS) {
+		const sample_t *s;
+		double dt = TICK_MS / 1000.0;
+
+		light_task();
+		if (now_ms && now_ms % CLIMATE_MS == 0)
+			climate_task();
+		if (rerun) {
+			int st = pending;
+
+			rerun = 0;
+			climate_task();
+			if (st != DHT11_BUSY) {
+				r->reads++;
+				r->ok += st == DHT11_OK;
+				r->drop += st == DHT11_ERR;
+				r->sum += st == DHT11_ERR_SUM;
+				run = st == DHT11_OK ? 0 : run + 1;
+				r->outages += run == MISSES;
+			}
+		}
+		latch(GPIOA);
+		latch(GPIOB);
+		latch(GPIOC);
+
+		fan = ODR_BIT(FAN);
+		leds = led_level();
+		if (fan != last_fan || leds != last_leds || duty_pm != last_duty) {
+			if (tl)
+				fprintf(tl, "%.1f,%d,%.1f,%d\n", now_ms / 1000.0, fan, duty_pm / 10.0, leds);
+			r->fan_starts += last_fan == 0 && fan;
+			r->led_changes += last_leds >= 0 && leds != last_leds;
+			last_fan = fan;
+			last_leds = leds;
+			last_duty = duty_pm;
+		}
+
+		s = sample_now();
+		r->total += dt;
+		r->fan_on += fan * dt;
+		r->duty_sum += duty_pm / 10.0 * dt;
+		r->duty_band[duty_pm <= 0 ? 0 : duty_pm <= 330 ? 1 : duty_pm <= 660 ? 2 : 3] += dt;
+		r->led[leds] += dt;
+		r->temp_in += (s->temp >= band_lo && s->temp <= band_hi) * dt;
+		r->hum_in += (s->hum >= hum_lo && s->hum <= hum_hi) * dt;
+		r->hot_idle += (s->temp > band_hi && !duty_pm && !fan) * dt;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	r->host_ms = (b.tv_sec - a.tv_sec) * 1e3 + (b.tv_nsec - a.tv_nsec) / 1e6;
+	if (tl)
+		fclose(tl);
+}
+
+// Traces
+
+static void trace_add(trace_t *tr, const sample_t *s)
+{
+	if (tr->n == tr->cap) {
+		tr->cap = tr->cap ? tr->cap * 2 : 1024;
+		if (!(tr->s = realloc(tr->s, tr->cap * sizeof(*tr->s)))) {
+			perror("dayreplay");
+			exit(1);
+		}
+	}
+	tr->s[tr->n++] = *s;
+}
+
+static int trace_load(const char *path, trace_t *tr)
+{
+	char line[256], status[16];
+	FILE *f = fopen(path, "r");
+	int lineno = 0;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		sample_t s = { 0 };
+		int n;
+
+		lineno++;
+		status[0] = 0;
+		if (line[0] == '#')
+			continue;
+		n = sscanf(line, "%lf,%lf,%lf,%lf,%15[a-z]", &s.t, &s.temp, &s.hum, &s.mv, status);
+		if (n < 4) {
+			if (tr->n)
+				fprintf(stderr, "%s:%d: skipped\n", path, lineno);
+			continue;
+		}
+		if (tr->n && s.t < tr->s[tr->n - 1].t) {
+			fprintf(stderr, "%s:%d: time goes backwards\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+		s.status = !strcmp(status, "drop") ? ST_DROP : !strcmp(status, "sum") ? ST_SUM : ST_OK;
+		trace_add(tr, &s);
+	}
+	fclose(f);
+	if (!tr->n) {
+		fprintf(stderr, "%s: no samples\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int trace_save(const char *path, const trace_t *tr)
+{
+	static const char *names[] = { "ok", "drop", "sum" };
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fprintf(f, "time_s,temp_c,hum_pct,light_mv,status\n");
+	for (size_t i = 0; i < tr->n; i++)
+		fprintf(f, "%.0f,%.2f,%.2f,%.0f,%s\n", tr->s[i].t, tr->s[i].temp, tr->s[i].hum, tr->s[i].mv,
+		        names[tr->s[i].status]);
+	fclose(f);
+	return 0;
+}
+
+static uint32_t rng;
+
+static double rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng / 4294967296.0;
+}
+
+// Outside air and sun as in pidsim, scaled by the day's weather; clouds
+// drift as a random walk and cut both light and solar gain
+static void trace_synth(uint32_t seed, trace_t *tr)
+{
+	double base = 8 + 8 * (rng = seed * 2654435761u | 1, rnd()), sunny = 0.5 + 0.5 * rnd();
+	double cloud = 0, out_len = 180 + 420 * rnd(), out_at = DAY_S * rnd();
+
+	for (int i = 0; i < 8; i++)
+		rnd();
+	for (double t = 0; t < DAY_S; t += SYNTH_STEP_S) {
+		double s = sin(2 * M_PI * (t - 3600 * 6) / DAY_S), r = rnd();
+		sample_t x = { .t = t };
+
+		cloud += (rnd() - 0.5) * 0.1;
+		cloud = cloud < 0 ? 0 : cloud > 1 ? 1 : cloud;
+		s = s > 0 ? s * sunny * (1 - 0.7 * cloud) : 0;
+		x.temp = base - 4 * cos(2 * M_PI * (t - 3600 * 4) / DAY_S) + 16 * s + (rnd() - 0.5) * 0.6;
+		x.hum = 78 - 2.2 * (x.temp - base) + (rnd() - 0.5) * 3;
+		x.hum = x.hum < 20 ? 20 : x.hum > 99 ? 99 : x.hum;
+		x.mv = 60 + 3000 * s + (rnd() - 0.5) * 40;
+		// Stored as trace_save() writes them, so a saved day replays the same
+		x.temp = round(x.temp * 100) / 100;
+		x.hum = round(x.hum * 100) / 100;
+		x.mv = round(x.mv);
+		x.status = (t >= out_at && t < out_at + out_len) || r < 0.005 ? ST_DROP :
+		           r < 0.008 ? ST_SUM : ST_OK;
+		trace_add(tr, &x);
+	}
+}
+
+// Batch
+
+typedef struct {
+	const char *path;      // 0 for a generated day
+	uint32_t seed;
+	char name[128];
+	pid_t pid;
+	int fd;
+	result_t r;
+	int done;
+} job_t;
+
+static int run_job(job_t *j)
+{
+	trace_t tr = { 0 };
+	result_t r;
+
+	if (j->path) {
+		if (trace_load(j->path, &tr))
+			return 1;
+	} else {
+		trace_synth(j->seed, &tr);
+		if (out_dir) {
+			char path[512];
+
+			snprintf(path, sizeof(path), "%s/%s.trace.csv", out_dir, j->name);
+			trace_save(path, &tr);
+		}
+	}
+	replay(&tr, j->name, &r);
+	if (write(j->fd, &r, sizeof(r)) != sizeof(r))
+		return 1;
+	return 0;
+}
+
+// Collects one finished child; results are small enough for one pipe write
+static void reap(job_t *jobs, int njobs)
+{
+	int status;
+	pid_t pid = wait(&status);
+
+	for (int i = 0; i < njobs; i++) {
+		if (jobs[i].pid != pid)
+			continue;
+		jobs[i].done = WIFEXITED(status) && !WEXITSTATUS(status) &&
+		               read(jobs[i].fd, &jobs[i].r, sizeof(result_t)) == sizeof(result_t);
+		close(jobs[i].fd);
+		jobs[i].pid = 0;
+	}
+}
+
+static void print_result(const job_t *j)
+{
+	const result_t *r = &j->r;
+	double pct = 100 / (r->total > 0 ? r->total : 1);
+
+	if (!j->done) {
+		printf("%s,failed\n", j->name);
+		return;
+	}
+	printf("%s,%.0f,%u,%u,%u,%u,%u,%u,%.1f,%.1f", j->name, r->total, r->reads, r->ok, r->drop, r->sum,
+	       r->outages, r->fan_starts, r->fan_on * pct, r->duty_sum / (r->total > 0 ? r->total : 1));
+	for (int i = 0; i < 4; i++)
+		printf(",%.1f", r->duty_band[i] * pct);
+	printf(",%u", r->led_changes);
+	for (int i = 0; i < 6; i++)
+		printf(",%.1f", r->led[i] * pct);
+	printf(",%.1f,%.1f,%.1f,%.1f\n", r->temp_in * pct, r->hum_in * pct, r->hot_idle * pct, r->host_ms);
+}
+
+static int parse_band(const char *arg, int *lo, int *hi)
+{
+	return sscanf(arg, "%d:%d", lo, hi) == 2 && *lo <= *hi ? 0 : -1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dayreplay [-j jobs] [-o dir] [-n days] [-s seed] [-b lo:hi] [-B lo:hi] "
+	                "[trace.csv ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, jobs = sysconf(_SC_NPROCESSORS_ONLN), days = 1, njobs, running = 0, fail = 0;
+	uint32_t seed = 1;
+	job_t *job;
+	struct timespec a, b;
+	double host, virt = 0;
+
+	while ((opt = getopt(argc, argv, "j:o:n:s:b:B:")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'o':
+			out_dir = optarg;
+			break;
+		case 'n':
+			days = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, 0, 0);
+			break;
+		case 'b':
+			if (parse_band(optarg, &band_lo, &band_hi))
+				usage();
+			break;
+		case 'B':
+			if (parse_band(optarg, &hum_lo, &hum_hi))
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (jobs < 1)
+		jobs = 1;
+	njobs = optind < argc ? argc - optind : days;
+	if (njobs < 1 || !(job = calloc(njobs, sizeof(*job))))
+		usage();
+
+	for (int i = 0; i < njobs; i++) {
+		if (optind < argc) {
+			const char *base = strrchr(argv[optind + i], '/');
+			size_t len;
+
+			job[i].path = argv[optind + i];
+			snprintf(job[i].name, sizeof(job[i].name), "%s", base ? base + 1 : job[i].path);
+			len = strlen(job[i].name);
+			if (len > 4 && !strcmp(job[i].name + len - 4, ".csv"))
+				job[i].name[len - 4] = 0;
+		} else {
+			job[i].seed = seed + i;
+			snprintf(job[i].name, sizeof(job[i].name), "synth-%u", job[i].seed);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	fflush(stdout);
+	for (int i = 0; i < njobs; i++) {
+		int fd[2];
+
+		if (running == jobs) {
+			reap(job, njobs);
+			running--;
+		}
+		if (pipe(fd)) {
+			perror("pipe");
+			return 1;
+		}
+		job[i].fd = fd[1];
+		job[i].pid = fork();
+		if (job[i].pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!job[i].pid) {
+			close(fd[0]);
+			_exit(run_job(&job[i]));
+		}
+		close(fd[1]);
+		job[i].fd = fd[0];
+		running++;
+	}
+	while (running--)
+		reap(job, njobs);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+
+	printf("trace,seconds,reads,ok,drop,sum,outages,fan_starts,fan_on_pct,duty_avg,"
+	       "duty_0_pct,duty_1_33_pct,duty_34_66_pct,duty_67_100_pct,led_changes,"
+	       "led0_pct,led1_pct,led2_pct,led3_pct,led4_pct,led5_pct,"
+	       "temp_in_pct,hum_in_pct,hot_idle_pct,host_ms\n");
+	for (int i = 0; i < njobs; i++) {
+		print_result(&job[i]);
+		fail |= !job[i].done;
+		virt += job[i].r.total;
+	}
+
+	host = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+	fprintf(stderr, "replayed %d trace%s, %.1f h virtual in %.3f s host on %d job%s (%.0fx real time)\n",
+	        njobs, njobs == 1 ? "" : "s", virt / 3600, host, jobs, jobs == 1 ? "" : "s",
+	        host > 0 ? virt / host : 0.0);
+	return fail;
+}
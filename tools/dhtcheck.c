@@ -0,0 +1,240 @@
+// DHT11 decoder and driver against synthetic edge traces.
+//
+//   dhtcheck [frames] [seed]
+//
+// Traces are the falling-edge timestamps EXTI4 stamps from TIM2 (1 us),
+// built from the widths between edges: the 80+80 us response, then per
+// bit 50 us low and 26 us (0) or 70 us (1) high.
+//
+//   frames    random readings with jittered widths, some across the TIM2
+//             wrap, decode to their bytes
+//   windows   widths on each side of the response and bit limits and of
+//             the 0/1 threshold
+//   checksum  every single flipped bit of a frame is caught
+//   driver    dht11_start() through the TIM2 and EXTI4 handlers: callback,
+//             queue order, and the frame timeout
+//
+// Prints one line per check, exits 1 on any failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "dht11.h"
+#include "check.h"
+
+#define DEFAULT_FRAMES 100000
+#define EDGES          42
+
+void TIM2_IRQHandler(void);
+void EXTI4_IRQHandler(void);
+
+static void frame_bytes(uint8_t *d, uint8_t h, uint8_t t)
+{
+	d[0] = h;
+	d[1] = 0;
+	d[2] = t;
+	d[3] = 0;
+	d[4] = d[0] + d[1] + d[2] + d[3];
+}
+
+static int bit(const uint8_t *d, int i)
+{
+	return d[i >> 3] >> (7 - (i & 7)) & 1;
+}
+
+// Widths between edges: w[0] the response, w[1 + i] bit i
+static void frame_widths(uint32_t *w, const uint8_t *d, int jitter)
+{
+	w[0] = 160 + (jitter ? (int)(rnd() % 21) - 10 : 0);
+	for (int i = 0; i < 40; i++) {
+		uint32_t lo = 50 + (jitter ? rnd() % 5 : 0);
+		uint32_t hi = bit(d, i) ? 70 : 26;
+
+		w[1 + i] = lo + hi + (jitter ? (int)(rnd() % 9) - 4 : 0);
+	}
+}
+
+// Decodes the trace starting at ts; the result of the last edge fed
+static int decode(const uint32_t *w, uint32_t ts, dht11_dec_t *dec)
+{
+	int st = DHT11_BUSY;
+
+	dht11_dec_reset(dec);
+	st = dht11_dec_edge(dec, ts);
+	for (int i = 0; i < EDGES - 1 && st == DHT11_BUSY; i++)
+		st = dht11_dec_edge(dec, ts += w[i]);
+	return st;
+}
+
+static int check_frames(uint32_t n)
+{
+	uint32_t w[EDGES - 1], wraps = 0;
+	dht11_dec_t dec;
+	uint8_t d[5];
+
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t ts = i & 1 ? rnd() : 0u - rnd() % 6000, end = ts;
+		int st;
+
+		frame_bytes(d, rnd() % 101, rnd() % 61);
+		frame_widths(w, d, 1);
+		for (int e = 0; e < EDGES - 1; e++)
+			end += w[e];
+		wraps += end < ts;
+		st = decode(w, ts, &dec);
+		if (st != DHT11_OK)
+			return fail("frames", "frame %u: status %d", i, st);
+		if (memcmp(dec.d, d, 5))
+			return fail("frames", "frame %u: %u %%RH decoded wrong", i, d[0]);
+	}
+	printf("%-10s %8u frames, %u across the TIM2 wrap\n", "frames", (unsigned)n, (unsigned)wraps);
+	return 0;
+}
+
+// First bit of the frame with value v
+static int find_bit(const uint8_t *d, int v)
+{
+	for (int i = 0; i < 40; i++)
+		if (bit(d, i) == v)
+			return i;
+	return -1;
+}
+
+static int check_windows(void)
+{
+	static const struct {
+		uint8_t edge;   // 0 = the response, else a bit of this value
+		uint8_t value;
+		uint32_t width;
+		int8_t st;
+	} cases[] = {
+		{ 0, 0, 119, DHT11_ERR }, { 0, 0, 120, DHT11_OK }, { 0, 0, 200, DHT11_OK },
+		{ 0, 0, 201, DHT11_ERR },
+		{ 1, 0, 59, DHT11_ERR },  { 1, 0, 60, DHT11_OK },  { 1, 0, 99, DHT11_OK },
+		{ 1, 0, 100, DHT11_ERR_SUM },
+		{ 1, 1, 99, DHT11_ERR_SUM }, { 1, 1, 100, DHT11_OK }, { 1, 1, 145, DHT11_OK },
+		{ 1, 1, 146, DHT11_ERR },
+	};
+	uint32_t w[EDGES - 1];
+	dht11_dec_t dec;
+	uint8_t d[5];
+	int bad = 0;
+
+	frame_bytes(d, 45, 23);
+	for (uint32_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		int at = cases[c].edge ? 1 + find_bit(d, cases[c].value) : 0;
+		int st;
+
+		frame_widths(w, d, 0);
+		w[at] = cases[c].width;
+		st = decode(w, 1000, &dec);
+		if (st != cases[c].st)
+			bad |= fail("windows", "width %u us: status %d", cases[c].width, st);
+	}
+	if (!bad)
+		printf("%-10s ok\n", "windows");
+	return bad;
+}
+
+static int check_checksum(void)
+{
+	uint32_t w[EDGES - 1];
+	dht11_dec_t dec;
+	uint8_t d[5];
+
+	frame_bytes(d, 45, 23);
+	for (int i = 0; i < 40; i++) {
+		d[i >> 3] ^= 0x80 >> (i & 7);
+		frame_widths(w, d, 0);
+		if (decode(w, 1000, &dec) != DHT11_ERR_SUM)
+			return fail("checksum", "bit %u flipped, frame accepted (%u)", i, 0);
+		d[i >> 3] ^= 0x80 >> (i & 7);
+	}
+	printf("%-10s ok, 40 bit flips\n", "checksum");
+	return 0;
+}
+
+// Driver side: what the completion callback saw
+static int cb_calls, cb_status;
+static uint8_t cb_t, cb_h;
+
+static void done(int status, uint8_t t, uint8_t h)
+{
+	cb_calls++;
+	cb_status = status;
+	cb_t = t;
+	cb_h = h;
+}
+
+// The start pulse ends, TIM2 CC1 releases the line
+static void start_read(uint32_t ts)
+{
+	dht11_start();
+	TIM2->CNT = ts;
+	TIM2->SR = TIM_SR_CC1IF;
+	TIM2_IRQHandler();
+}
+
+static void feed(const uint32_t *w, uint32_t ts)
+{
+	TIM2->CNT = ts;
+	EXTI4_IRQHandler();
+	for (int i = 0; i < EDGES - 1; i++) {
+		TIM2->CNT = ts += w[i];
+		EXTI4_IRQHandler();
+	}
+}
+
+static int check_driver(void)
+{
+	uint32_t w[EDGES - 1];
+	dht11_sample_t smp;
+	uint8_t d[5], t, h;
+
+	dht11_init(done);
+	frame_bytes(d, 45, 23);
+	frame_widths(w, d, 1);
+	start_read(0u - 3000);
+	feed(w, 0u - 2900);
+	if (cb_calls != 1 || cb_status != DHT11_OK || cb_t != 23 || cb_h != 45)
+		return fail("driver", "callback %u times, status %d", cb_calls, cb_status);
+	if (dht11_result(&t, &h) != DHT11_OK || t != 23 || h != 45)
+		return fail("driver", "result %u C %u %%RH", t, h);
+
+	// Frame timeout: the line released, no edges, CC1 fires again
+	start_read(100);
+	TIM2->SR = TIM_SR_CC1IF;
+	TIM2_IRQHandler();
+	if (cb_calls != 2 || cb_status != DHT11_ERR)
+		return fail("driver", "timeout: callback %u times, status %d", cb_calls, cb_status);
+
+	// Reads nobody collected come out oldest first
+	for (int i = 0; i < DHT11_QUEUE - 1; i++) {
+		frame_bytes(d, 50 + i, 20 + i);
+		frame_widths(w, d, 1);
+		start_read(i * 100000);
+		feed(w, i * 100000 + 100);
+	}
+	if (!dht11_get(&smp) || smp.status != DHT11_ERR)
+		return fail("driver", "queue: timeout not first (%d)", smp.status, 0);
+	for (int i = 0; i < DHT11_QUEUE - 1; i++)
+		if (!dht11_get(&smp) || smp.status != DHT11_OK || smp.h != 50 + i)
+			return fail("driver", "queue: read %u came back as %u %%RH", i, smp.h);
+	if (dht11_get(&smp))
+		return fail("driver", "queue: extra read (%u %%RH)", smp.h, 0);
+	printf("%-10s ok\n", "driver");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t frames = check_args(argc, argv, DEFAULT_FRAMES);
+	int bad = 0;
+
+	bad |= check_frames(frames);
+	bad |= check_windows();
+	bad |= check_checksum();
+	bad |= check_driver();
+	return bad;
+}
@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+# Flash/RAM/stack report for the greenhouse image.
+#
+# Totals come from the linker map. Per-module sizes are found by matching the
+# symbols of the final ELF against the symbols each module's objects define,
+# since with LTO the map only names ltrans partitions. Worst-case stack depth
+# is computed from the -fcallgraph-info=su output. Exits 1 if a module is over
+# its budget or the stack estimate does not fit the reserved stack.
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+
+SUFFIX = re.compile(r'\.(lto_priv|constprop|isra|part|cold|localalias)(\.\d+)?$')
+
+# Cortex-M4F exception entry with the FPU context stacked
+EXC_FRAME = 104
+
+
+def parse_map(path):
+    regions = {}
+    sections = []
+    symbols = {}
+    in_mem = False
+    pending = None
+
+    with open(path) as f:
+        for line in f:
+            if line.startswith('Memory Configuration'):
+                in_mem = True
+                continue
+            if in_mem:
+                if line.startswith('Linker script and memory map'):
+                    in_mem = False
+                    continue
+                m = re.match(r'(\w+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)', line)
+                if m and m.group(1) != '*default*':
+                    regions[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+                continue
+
+            m = re.match(r'\s+0x([0-9a-f]+)\s+(_Min_\w+|_estack)\s*=', line)
+            if m:
+                symbols[m.group(2)] = int(m.group(1), 16)
+                continue
+
+            # Output sections start in column 0; long names wrap to the next line
+            if pending:
+                m = re.match(r'\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(.*)', line)
+                if m:
+                    sections.append((pending, int(m.group(1), 16), int(m.group(2), 16), m.group(3)))
+                pending = None
+                continue
+            m = re.match(r'(\.\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(.*)', line)
+            if m:
+                sections.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4)))
+            elif re.match(r'\.\S+\s*$', line):
+                pending = line.strip()
+
+    return regions, sections, symbols
+
+
+def region_of(regions, addr):
+    for name, (origin, length) in regions.items():
+        if origin <= addr < origin + length:
+            return name
+    return None
+
+
+def nm(tool, path, defined=True):
+    args = [tool, '-S', '--defined-only' if defined else '', path]
+    out = subprocess.run([a for a in args if a], capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 4:
+            syms.append((int(parts[1], 16), parts[2], parts[3]))
+    return syms
+
+
+def base_name(sym):
+    while True:
+        s = SUFFIX.sub('', sym)
+        if s == sym:
+            return s
+        sym = s
+
+
+def obj_path(objdir, src):
+    return os.path.join(objdir, os.path.splitext(src)[0] + '.o')
+
+
+def module_sizes(args, modules):
+    owner = {}
+    for mod, srcs in modules.items():
+        for src in srcs:
+            for _, _, name in nm(args.nm, obj_path(args.objdir, src)):
+                # Same static name in two modules cannot be told apart after LTO
+                owner[name] = mod if owner.get(name, mod) == mod else None
+
+    sizes = {mod: [0, 0] for mod in modules}
+    sizes['(other)'] = [0, 0]
+    for size, kind, name in nm(args.nm, args.elf):
+        mod = owner.get(base_name(name)) or '(other)'
+        k = kind.upper()
+        if k in 'TR':
+            sizes[mod][0] += size
+        elif k == 'D':
+            sizes[mod][0] += size
+            sizes[mod][1] += size
+        elif k == 'B':
+            sizes[mod][1] += size
+    return sizes
+
+
+def read_budget(path):
+    budget = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split('#')[0].split()
+            if len(line) == 3:
+                budget[line[0]] = (int(line[1], 0), int(line[2], 0))
+    return budget
+
+
+def parse_ci(paths):
+    frame = {}
+    edges = {}
+    for path in paths:
+        with open(path) as f:
+            text = f.read()
+        for m in re.finditer(r'node: \{ title: "([^"]+)" label: "([^"]*)"', text):
+            s = re.search(r'(\d+) bytes', m.group(2))
+            if s:
+                frame[base_name(m.group(1))] = int(s.group(1))
+        for m in re.finditer(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"', text):
+            edges.setdefault(base_name(m.group(1)), set()).add(base_name(m.group(2)))
+    return frame, edges
+
+
+def depth(fn, frame, edges, memo, stack, notes):
+    if fn in memo:
+        return memo[fn]
+    if fn in stack:
+        notes.add('recursion through ' + fn)
+        return 0
+    stack.add(fn)
+    deepest = 0
+    for callee in edges.get(fn, ()):
+        if callee not in frame and callee not in edges:
+            notes.add('unknown frame: ' + callee)
+        deepest = max(deepest, depth(callee, frame, edges, memo, stack, notes))
+    stack.discard(fn)
+    memo[fn] = frame.get(fn, 0) + deepest
+    return memo[fn]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--map', required=True)
+    ap.add_argument('--elf', required=True)
+    ap.add_argument('--nm', default='arm-none-eabi-nm')
+    ap.add_argument('--budget')
+    ap.add_argument('--objdir', default='build')
+    ap.add_argument('--module', action='append', default=[], help='name=src1,src2')
+    args = ap.parse_args()
+
+    failed = False
+    regions, sections, symbols = parse_map(args.map)
+
+    used = {name: 0 for name in regions}
+    for name, addr, size, rest in sections:
+        if size == 0:
+            continue
+        r = region_of(regions, addr)
+        if r:
+            used[r] += size
+        m = re.search(r'load address 0x([0-9a-f]+)', rest)
+        if m:
+            lr = region_of(regions, int(m.group(1), 16))
+            if lr and lr != r:
+                used[lr] += size
+
+    print('Memory')
+    for name, (origin, length) in regions.items():
+        print('  %-8s %8d / %8d bytes  %5.1f%%' % (name, used[name], length, 100.0 * used[name] / length))
+
+    print('Sections')
+    for name, addr, size, _ in sections:
+        if size:
+            print('  %-20s 0x%08x %8d' % (name, addr, size))
+
+    modules = {}
+    for spec in args.module:
+        name, _, srcs = spec.partition('=')
+        modules[name] = [s for s in srcs.split(',') if s]
+
+    budget = read_budget(args.budget) if args.budget else {}
+    print('Modules                  flash      ram   budget flash/ram')
+    for mod, (flash, ram) in module_sizes(args, modules).items():
+        b = budget.get(mod)
+        mark = ''
+        if b and (flash > b[0] or ram > b[1]):
+            mark = '  OVER'
+            failed = True
+        print('  %-18s %8d %8d   %s%s' % (mod, flash, ram, '%d/%d' % b if b else '-', mark))
+
+    # Prefer post-LTO call graphs, they reflect the final inlining
+    ci = glob.glob(os.path.join(args.objdir, '*.ltrans*.ci'))
+    if not ci:
+        ci = glob.glob(os.path.join(args.objdir, '**', '*.ci'), recursive=True)
+    if ci:
+        frame, edges = parse_ci(ci)
+        memo, notes = {}, set()
+        main_depth = depth('main', frame, edges, memo, set(), notes)
+        handlers = sorted(fn for fn in set(frame) | set(edges) if fn.endswith('Handler'))
+        isr = {fn: depth(fn, frame, edges, memo, set(), notes) + EXC_FRAME for fn in handlers}
+
+        print('Stack')
+        print('  %-24s %6d' % ('main', main_depth))
+        for fn in handlers:
+            print('  %-24s %6d' % (fn, isr[fn]))
+        one = main_depth + max(isr.values(), default=0)
+        nested = main_depth + sum(isr.values())
+        reserved = symbols.get('_Min_Stack_Size')
+        print('  worst, one ISR          %6d' % one)
+        print('  worst, all ISRs nested  %6d' % nested)
+        if reserved is not None:
+            print('  reserved                %6d' % reserved)
+            if one > reserved:
+                failed = True
+                print('  stack estimate exceeds _Min_Stack_Size')
+        for n in sorted(notes):
+            print('  note: ' + n)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,112 @@
+// Greenhouse fan loop against a simulated plant.
+//
+//   pidsim [auto|hyst|bang] > out.csv
+//
+// Runs the climate controller from src/dth11.c (same gains, 2 s step) for a
+// day against a first-order thermal model: sun heats the house, the fan
+// pulls it toward the outside air. The sensor is read as DHT11 does, whole
+// degrees. Prints time_s,temp,reading,duty per step, and on stderr the
+// fan switch count, time and error stats, and the cost of one pid_step().
+//
+//   auto  PID driving the PWM duty (default)
+//   hyst  the same object in PID_HYST, what a build without the motor runs
+//   bang  the old on/off at the setpoint, for comparison
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "pid.h"
+
+#define STEP_S    2
+#define DAY_S     86400
+#define SETPOINT  20
+
+static pid_ctrl_t pid = {
+	.kp = PID_Q16(0.1),
+	.ki = PID_Q16(0.01),
+	.kd = PID_Q16(0.1),
+	.d_alpha = PID_Q16(0.25),
+	.out_min = 0, .out_max = PID_ONE,
+	.rate = PID_Q16(0.1),
+	.hyst = PID_Q16(1),
+	.reverse = 1,
+};
+
+// Outside air 8..18 C, sun adds up to 18 C of heating from 6:00 to 18:00
+static double outside(double t)
+{
+	return 13 - 5 * cos(2 * M_PI * (t - 3600 * 4) / DAY_S);
+}
+
+static double sun(double t)
+{
+	double s = sin(2 * M_PI * (t - 3600 * 6) / DAY_S);
+
+	return s > 0 ? 18 * s : 0;
+}
+
+static double bench(void)
+{
+	struct timespec a, b;
+	volatile int32_t sink = 0;
+	const int n = 10000000;
+
+	pid_reset(&pid, 0);
+	pid_set_mode(&pid, PID_AUTO);
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (int i = 0; i < n; i++)
+		sink += pid_step(&pid, SETPOINT << PID_Q, (18 + (i & 7)) << PID_Q);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	(void)sink;
+	return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / n;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mode = argc > 1 ? argv[1] : "auto";
+	double temp = 12, err2 = 0, worst = 0;
+	int32_t out = 0;
+	unsigned switches = 0, on_s = 0, steps = 0;
+
+	if (strcmp(mode, "auto") && strcmp(mode, "hyst") && strcmp(mode, "bang")) {
+		fprintf(stderr, "usage: pidsim [auto|hyst|bang]\n");
+		return 1;
+	}
+	pid_reset(&pid, 0);
+	if (!strcmp(mode, "hyst"))
+		pid_set_mode(&pid, PID_HYST);
+
+	printf("time_s,temp,reading,duty\n");
+	for (int t = 0; t < DAY_S; t += STEP_S) {
+		int reading = (int)floor(temp);
+		int32_t prev = out;
+		double duty;
+
+		if (!strcmp(mode, "bang"))
+			out = reading >= SETPOINT ? PID_ONE : 0;
+		else
+			out = pid_step(&pid, SETPOINT << PID_Q, reading << PID_Q);
+		duty = (double)out / PID_ONE;
+
+		// 20 min passive time constant, the fan at full speed makes it 4 min
+		temp += STEP_S * ((outside(t) + sun(t) - temp) / 1200.0 +
+		                  duty * (outside(t) - temp) / 300.0);
+
+		switches += (prev == 0) != (out == 0);
+		on_s += out ? STEP_S : 0;
+		if (t >= 3600 * 10 && t < 3600 * 16) {  // around noon the fan can hold the setpoint
+			double e = temp - (SETPOINT + 0.5);  // middle of what reads as SETPOINT
+
+			err2 += e * e;
+			worst = fabs(e) > worst ? fabs(e) : worst;
+			steps++;
+		}
+		printf("%d,%.2f,%d,%.3f\n", t, temp, reading, duty);
+	}
+
+	fprintf(stderr, "%s: %u fan starts/stops, on %u s, 10:00-16:00 rms error %.2f C, worst %.2f C\n",
+	        mode, switches, on_s, sqrt(err2 / steps), worst);
+	fprintf(stderr, "pid_step: %.1f ns on this host\n", bench());
+	return 0;
+}
@@ -0,0 +1,215 @@
+// Pool allocator against the C library malloc.
+//
+//   poolbench [ops] [seed]
+//
+// Replays one random alloc/free sequence through pool_alloc()/pool_free(),
+// their _isr variants and malloc()/free(). Sizes are drawn so each pool
+// class sees traffic in proportion to its blocks, and the live set swings
+// between half and all of the pool capacity. Every call is timed on its
+// own, less the cost of an empty timing; prints the mean, p99, p99.9
+// and worst ns per call, the failed allocations, and how far the malloc
+// heap grew beyond the bytes it had live at the end.
+//
+// The host malloc is glibc's, not newlib-nano's, so only the shape
+// carries over: a pool call is a list pop or push whatever came before,
+// a general heap searches, splits and merges, and its tail shows it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pool.h"
+#include "check.h"
+
+#define DEFAULT_OPS 1000000
+
+typedef struct {
+	uint32_t size;   // 0 frees slot
+	uint32_t slot;
+} op_t;
+
+typedef struct {
+	const char *name;
+	void *(*alloc)(uint32_t size);
+	void (*free)(void *p);
+} alloc_t;
+
+static void *libc_alloc(uint32_t size)
+{
+	return malloc(size);
+}
+
+static const alloc_t allocs[] = {
+	{ "pool",     pool_alloc,     pool_free },
+	{ "pool_isr", pool_alloc_isr, pool_free_isr },
+	{ "malloc",   libc_alloc,     free },
+};
+#define NALLOCS (sizeof(allocs) / sizeof(allocs[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// Allocations pick a class weighted by its block count, then a size in it
+static uint32_t capacity, weights[POOL_NUM_CLASSES], sizes[POOL_NUM_CLASSES];
+
+static void classes(void)
+{
+	pool_stats_t s;
+
+	for (int c = 0; pool_stats(c, &s); c++) {
+		weights[c] = s.blocks;
+		sizes[c] = s.size;
+		capacity += s.blocks;
+	}
+}
+
+static int pick_class(void)
+{
+	uint32_t r = rnd() % capacity;
+	int c = 0;
+
+	while (r >= weights[c])
+		r -= weights[c++];
+	return c;
+}
+
+static uint32_t pick_size(int c)
+{
+	uint32_t lo = c ? sizes[c - 1] + 1 : 1;
+
+	return lo + rnd() % (sizes[c] - lo + 1);
+}
+
+// A class that is full turns the step into a free, so the pools never
+// have to spill and every allocator sees the same live set
+static op_t *make_ops(uint32_t n)
+{
+	op_t *ops = malloc(n * sizeof(*ops));
+	uint32_t *free_slots = malloc(capacity * sizeof(uint32_t)), nfree = capacity;
+	uint32_t *used = malloc(capacity * sizeof(uint32_t)), nused = 0, target = capacity;
+	uint8_t *slot_class = malloc(capacity);
+	uint32_t live[POOL_NUM_CLASSES] = { 0 };
+
+	for (uint32_t i = 0; i < capacity; i++)
+		free_slots[i] = capacity - 1 - i;
+	for (uint32_t i = 0; i < n; i++) {
+		int c = pick_class();
+
+		if ((rnd() & 1023) == 0)
+			target = capacity / 2 + rnd() % (capacity / 2 + 1);
+		if (nused < target && live[c] < weights[c]) {
+			uint32_t slot = free_slots[--nfree];
+
+			ops[i] = (op_t){ pick_size(c), slot };
+			slot_class[slot] = c;
+			live[c]++;
+			used[nused++] = slot;
+		} else if (nused) {
+			uint32_t k = rnd() % nused;
+
+			ops[i] = (op_t){ 0, used[k] };
+			live[slot_class[used[k]]]--;
+			free_slots[nfree++] = used[k];
+			used[k] = used[--nused];
+		} else {
+			i--;
+		}
+	}
+	free(free_slots);
+	free(used);
+	free(slot_class);
+	return ops;
+}
+
+static uint32_t timer_cost(void)
+{
+	uint32_t best = ~0U;
+
+	for (int i = 0; i < 10000; i++) {
+		uint64_t a = now_ns(), b = now_ns();
+
+		if (b - a < best)
+			best = b - a;
+	}
+	return best;
+}
+
+static void run(const alloc_t *al, const op_t *ops, uint32_t n, uint32_t *ns, uint32_t base)
+{
+	void **slot = calloc(capacity, sizeof(void *));
+	uint32_t fails = 0, live_bytes = 0, *slot_size = calloc(capacity, sizeof(uint32_t));
+	char *heap0 = sbrk(0);
+	uint64_t sum = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		const op_t *o = &ops[i];
+		uint64_t a, b;
+
+		if (o->size) {
+			a = now_ns();
+			slot[o->slot] = al->alloc(o->size);
+			b = now_ns();
+			if (!slot[o->slot])
+				fails++;
+			else
+				live_bytes += slot_size[o->slot] = o->size;
+		} else {
+			a = now_ns();
+			al->free(slot[o->slot]);
+			b = now_ns();
+			live_bytes -= slot_size[o->slot];
+			slot[o->slot] = 0;
+			slot_size[o->slot] = 0;
+		}
+		ns[i] = b - a > base ? b - a - base : 0;
+		sum += ns[i];
+	}
+
+	qsort(ns, n, sizeof(*ns), cmp_u32);
+	printf("%-10s %8.1f %8u %8u %8u %8u", al->name, (double)sum / n, ns[n - n / 100 - 1],
+	       ns[n - n / 1000 - 1], ns[n - 1], fails);
+	if (al->alloc == libc_alloc)
+		printf("  heap +%ld for %u live", (long)((char *)sbrk(0) - heap0), live_bytes);
+	printf("\n");
+
+	for (uint32_t i = 0; i < capacity; i++)
+		al->free(slot[i]);
+	free(slot);
+	free(slot_size);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t n = check_args(argc, argv, DEFAULT_OPS), base, *ns;
+	op_t *ops;
+
+	if (!n) {
+		fprintf(stderr, "usage: poolbench [ops] [seed]\n");
+		return 2;
+	}
+	classes();
+	ops = make_ops(n);
+	ns = malloc(n * sizeof(*ns));
+	base = timer_cost();
+
+	printf("%u ops, up to %u blocks live, timer %u ns subtracted\n", n, capacity, base);
+	printf("%-10s %8s %8s %8s %8s %8s\n", "allocator", "mean ns", "p99", "p99.9", "max", "fails");
+	for (uint32_t i = 0; i < NALLOCS; i++)
+		run(&allocs[i], ops, n, ns, base);
+	free(ops);
+	free(ns);
+	return 0;
+}
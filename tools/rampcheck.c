@@ -0,0 +1,222 @@
+// TB6612 ramp tables and the driver around them.
+//
+//   rampcheck [ramps] [seed]
+//
+//   tables     random from/to/len per channel through motor_ramp_build():
+//              the row count, every row within one duty step of the
+//              straight line, never past the target, the target held from
+//              row len on, CCR2/CCR3 left at 0
+//   driver     motor_set() through the table it hands to DMA1 Stream6, with
+//              the stream and TIM4 CCRs stepped here as the DMA would: a
+//              ramp, a new speed in the middle of one, a direction change
+//              through zero, the current limit and an overcurrent fault
+//
+// Prints one line per check, exits 1 on any failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "tb6612.h"
+#include "check.h"
+
+#define DEFAULT_RAMPS 100000
+
+void DMA1_Stream6_IRQHandler(void);
+
+static const uint8_t col[MOTOR_CHANNELS] = { 0, 3 };  // CCR1, CCR4
+
+// 0 if the channel's column is the ramp from -> to over len rows
+static const char *ramp_ok(uint16_t (*tab)[MOTOR_RAMP_CCR], uint16_t rows, int ch, uint16_t from,
+                           uint16_t to, uint16_t len, uint16_t *at)
+{
+	uint16_t n = len < rows ? len : rows;
+	int32_t d = (int32_t)to - from;
+
+	for (*at = 0; *at < rows; (*at)++) {
+		int32_t v = tab[*at][col[ch]];
+		int32_t prev = *at ? tab[*at - 1][col[ch]] : from;
+
+		if (tab[*at][1] || tab[*at][2])
+			return "CCR2/CCR3 not 0";
+		if (*at + 1 >= n) {
+			if (v != to)
+				return "target not held";
+			continue;
+		}
+		// Within a step of from + d * (row + 1) / n
+		if (llabs((int64_t)(v - from) * n - (int64_t)d * (*at + 1)) > n)
+			return "off the line";
+		if ((d > 0 && (v < prev || v > to)) || (d < 0 && (v > prev || v < to)))
+			return "not monotonic";
+	}
+	return 0;
+}
+
+static int check_tables(uint32_t ramps)
+{
+	static uint16_t tab[MOTOR_RAMP_MAX][MOTOR_RAMP_CCR];
+	uint32_t longest = 0;
+
+	for (uint32_t i = 0; i < ramps; i++) {
+		uint16_t from[MOTOR_CHANNELS], to[MOTOR_CHANNELS], len[MOTOR_CHANNELS], rows, want = 1, at;
+
+		for (int ch = 0; ch < MOTOR_CHANNELS; ch++) {
+			uint32_t r = rnd();
+
+			from[ch] = r % (MOTOR_PWM_TOP + 1);
+			to[ch] = (r >> 10) % (MOTOR_PWM_TOP + 1);
+			len[ch] = r >> 30 ? (r >> 20) % (MOTOR_RAMP_MAX + 1) : (r >> 20) % (2 * MOTOR_RAMP_MAX);
+			if (len[ch] > want)
+				want = len[ch];
+		}
+		if (want > MOTOR_RAMP_MAX)
+			want = MOTOR_RAMP_MAX;
+		memset(tab, 0xAA, sizeof(tab));
+		rows = motor_ramp_build(tab, from, to, len);
+		if (rows != want)
+			return fail("tables", "ramp %u: %u rows", i, rows);
+		for (int ch = 0; ch < MOTOR_CHANNELS; ch++) {
+			const char *err = ramp_ok(tab, rows, ch, from[ch], to[ch], len[ch], &at);
+
+			if (err) {
+				printf("FAIL %-10s ramp %u channel %d, %u -> %u over %u: %s at row %u\n", "tables",
+				       (unsigned)i, ch, from[ch], to[ch], len[ch], err, at);
+				return 1;
+			}
+		}
+		if (rows > longest)
+			longest = rows;
+	}
+	printf("%-10s %8u ramps, up to %u rows\n", "tables", (unsigned)ramps, (unsigned)longest);
+	return 0;
+}
+
+// The running table, read back through the stream's 32-bit memory address
+static uint16_t (*table(void))[MOTOR_RAMP_CCR]
+{
+	return (uint16_t (*)[MOTOR_RAMP_CCR])(uintptr_t)DMA1_Stream6->M0AR;
+}
+
+static uint16_t rows_left(void)
+{
+	return DMA1_Stream6->CR & 1 ? DMA1_Stream6->NDTR / MOTOR_RAMP_CCR : 0;
+}
+
+static uint16_t rows_total;  // of the table the driver last started
+
+static void started(void)
+{
+	rows_total = rows_left();
+}
+
+// PWM periods pass: the DMA loads a row into the CCRs per period, and
+// stops and interrupts after the last one
+static void run_rows(uint16_t periods)
+{
+	while (periods-- && rows_left()) {
+		uint16_t *row = table()[rows_total - rows_left()];
+
+		TIM4->CCR1 = row[0];
+		TIM4->CCR2 = row[1];
+		TIM4->CCR3 = row[2];
+		TIM4->CCR4 = row[3];
+		DMA1_Stream6->NDTR -= MOTOR_RAMP_CCR;
+		if (!DMA1_Stream6->NDTR) {
+			DMA1_Stream6->CR &= ~1;
+			DMA1_Stream6_IRQHandler();
+			started();
+		}
+	}
+}
+
+static int faults;
+static uint8_t fault_ch;
+
+static void fault(uint8_t ch)
+{
+	faults++;
+	fault_ch = ch;
+}
+
+static int check_driver(void)
+{
+	uint16_t last;
+
+	motor_init();
+	motor_fault_hook(fault);
+	motor_standby(0);
+	if (motor_ramping() || motor_speed(MOTOR_A) || motor_speed(MOTOR_B))
+		return fail("driver", "not idle after init (A %u, B %u)", motor_speed(MOTOR_A), motor_speed(MOTOR_B));
+
+	// Soft start: 250 rows at 1 kHz, halfway after 125
+	motor_set(MOTOR_A, 800, 250);
+	started();
+	if (rows_total != 250 || TIM4->CCR1)
+		return fail("driver", "start: %u rows, CCR1 %u before the first period", rows_total, TIM4->CCR1);
+	run_rows(125);
+	if (motor_speed(MOTOR_A) < 399 || motor_speed(MOTOR_A) > 401)
+		return fail("driver", "start: %u after 125 of 250 periods, want 400 (%u)", motor_speed(MOTOR_A), 0);
+
+	// A new speed mid-ramp starts from the duty being output, B joins in
+	motor_set(MOTOR_A, 600, 100);
+	started();
+	last = TIM4->CCR1;
+	motor_set(MOTOR_B, 500, 50);
+	started();
+	if (table()[0][0] < last || table()[0][0] > last + 3)
+		return fail("driver", "retarget: first row %u after %u", table()[0][0], last);
+	run_rows(1000);
+	if (motor_speed(MOTOR_A) != 600 || motor_speed(MOTOR_B) != 500 || motor_ramping())
+		return fail("driver", "retarget: ended at A %u, B %u", motor_speed(MOTOR_A), motor_speed(MOTOR_B));
+
+	// Reverse: down to 0 with the bridge still forward, then up the other way
+	motor_set(MOTOR_A, -300, 40);
+	started();
+	run_rows(39);
+	if (motor_speed(MOTOR_A) <= 0)
+		return fail("driver", "reverse: bridge flipped at %u (%u)", -motor_speed(MOTOR_A), 0);
+	run_rows(1);
+	if (motor_speed(MOTOR_A) || !motor_ramping() || rows_total != 40)
+		return fail("driver", "reverse: %u at zero, %u rows up", motor_speed(MOTOR_A), rows_total);
+	run_rows(1000);
+	if (motor_speed(MOTOR_A) != -300 || motor_speed(MOTOR_B) != 500)
+		return fail("driver", "reverse: ended at A %d, B %u", motor_speed(MOTOR_A), motor_speed(MOTOR_B));
+
+	// Current limit: the running duty and the next target are clamped
+	motor_set_limit(MOTOR_B, 400);
+	started();
+	motor_set(MOTOR_B, 900, 20);
+	started();
+	run_rows(1000);
+	if (motor_speed(MOTOR_B) != 400)
+		return fail("driver", "limit: B at %u, limit %u", motor_speed(MOTOR_B), 400);
+
+	// Overcurrent coasts the channel at once; the other one keeps its ramp
+	motor_set(MOTOR_A, -700, 100);
+	started();
+	run_rows(10);
+	motor_overcurrent(MOTOR_B);
+	started();
+	if (faults != 1 || fault_ch != MOTOR_B || TIM4->CCR4 || motor_speed(MOTOR_B))
+		return fail("driver", "fault: hook %u times, B at %u", faults, TIM4->CCR4);
+	run_rows(1000);
+	if (motor_speed(MOTOR_A) != -700 || motor_speed(MOTOR_B))
+		return fail("driver", "fault: ended at A %d, B %u", motor_speed(MOTOR_A), motor_speed(MOTOR_B));
+
+	motor_standby(1);
+	if (motor_speed(MOTOR_A) || motor_ramping())
+		return fail("driver", "standby: A at %d, ramping %u", motor_speed(MOTOR_A), motor_ramping());
+	printf("%-10s ok\n", "driver");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t ramps = check_args(argc, argv, DEFAULT_RAMPS);
+	int bad = 0;
+
+	bad |= check_tables(ramps);
+	bad |= check_driver();
+	return bad;
+}
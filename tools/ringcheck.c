@@ -0,0 +1,211 @@
+// SPSC ring under two threads.
+//
+//   ringcheck [items] [seed]
+//
+// The ring from Inc/ring.h, as the drivers define it, with a four-word
+// item whose words are all derived from a sequence number, so a slot read
+// before the producer finished writing it shows up as torn:
+//
+//   edges     one thread: full and empty, partial push_n/pop_n, peek and
+//             drop, indices running across the 32-bit wrap
+//   single    a producer and a consumer thread, push and pop one at a time;
+//             every item arrives once, in order and whole
+//   batch     the same with random push_n/pop_n sizes and peek/drop
+//
+// The threaded checks print the items per second they moved; a side that
+// finds the ring full or empty yields, so they also run on one core. Prints one
+// line per check, exits 1 on any failure.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ring.h"
+#include "check.h"
+
+#define DEFAULT_ITEMS 10000000
+#define RING_SIZE     64
+#define BATCH_MAX     24
+
+int sched_yield(void);  // <sched.h> is shadowed by the scheduler's Inc/sched.h
+
+typedef struct {
+	uint32_t seq, a, b, c;
+} item_t;
+
+RING_DEFINE(test_ring, item_t, RING_SIZE)
+
+static test_ring_t q;
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static item_t make(uint32_t seq)
+{
+	return (item_t){ seq, seq * 2654435761u, ~seq, seq ^ 0xA5A5A5A5u };
+}
+
+static int whole(const item_t *v, uint32_t seq)
+{
+	item_t w = make(seq);
+
+	return !memcmp(v, &w, sizeof(w));
+}
+
+// Both indices just short of the wrap, as after a long uptime
+static void reset(uint32_t start)
+{
+	memset(&q, 0, sizeof(q));
+	q.head = q.tail = start;
+}
+
+static int check_edges(void)
+{
+	item_t v[RING_SIZE + 8], w;
+	uint32_t n;
+
+	reset(0u - RING_SIZE / 2);
+	if (test_ring_pop(&q, &w) || test_ring_peek(&q, &w) || test_ring_count(&q))
+		return fail("edges", "empty ring gave an item (count %u)", test_ring_count(&q), 0);
+	for (uint32_t i = 0; i < RING_SIZE; i++) {
+		w = make(i);
+		if (!test_ring_push(&q, &w))
+			return fail("edges", "push %u of %u refused", i, RING_SIZE);
+	}
+	w = make(RING_SIZE);
+	if (test_ring_push(&q, &w) || test_ring_space(&q))
+		return fail("edges", "full ring took an item (space %u)", test_ring_space(&q), 0);
+	for (uint32_t i = 0; i < RING_SIZE / 2; i++)
+		if (!test_ring_pop(&q, &w) || !whole(&w, i))
+			return fail("edges", "pop %u across the wrap gave %u", i, w.seq);
+
+	// push_n stops at the space left, pop_n at what is there
+	for (uint32_t i = 0; i < RING_SIZE; i++)
+		v[i] = make(RING_SIZE + i);
+	if ((n = test_ring_push_n(&q, v, RING_SIZE)) != RING_SIZE / 2)
+		return fail("edges", "push_n into %u free took %u", RING_SIZE / 2, n);
+	if ((n = test_ring_pop_n(&q, v, RING_SIZE + 8)) != RING_SIZE)
+		return fail("edges", "pop_n from %u gave %u", RING_SIZE, n);
+	for (uint32_t i = 0; i < n; i++)
+		if (!whole(&v[i], RING_SIZE / 2 + i))
+			return fail("edges", "pop_n item %u is %u", i, v[i].seq);
+	if (test_ring_push_n(&q, v, 0) || test_ring_pop_n(&q, v, 4))
+		return fail("edges", "empty batch moved items (%u)", test_ring_count(&q), 0);
+
+	// peek leaves the item until drop
+	w = make(7);
+	test_ring_push(&q, &w);
+	if (!test_ring_peek(&q, &w) || !test_ring_peek(&q, &w) || test_ring_count(&q) != 1)
+		return fail("edges", "peek removed the item (count %u)", test_ring_count(&q), 0);
+	test_ring_drop(&q);
+	if (test_ring_count(&q) || q.tail != q.head)
+		return fail("edges", "drop left %u items", test_ring_count(&q), 0);
+	printf("%-10s ok\n", "edges");
+	return 0;
+}
+
+typedef struct {
+	uint32_t items;
+	uint32_t seed;
+	int batch;
+	uint32_t bad, at, got;  // consumer: first wrong item
+} side_t;
+
+static void *producer(void *arg)
+{
+	side_t *s = arg;
+	uint32_t seed = s->seed, seq = 0;
+	item_t v[BATCH_MAX];
+
+	while (seq < s->items) {
+		uint32_t n;
+
+		if (s->batch) {
+			n = 1 + (seed = seed * 1103515245 + 12345) % BATCH_MAX;
+
+			if (n > s->items - seq)
+				n = s->items - seq;
+			for (uint32_t i = 0; i < n; i++)
+				v[i] = make(seq + i);
+			n = test_ring_push_n(&q, v, n);
+		} else {
+			v[0] = make(seq);
+			n = test_ring_push(&q, &v[0]);
+		}
+		if (!n)
+			sched_yield();  // full: let the consumer run on a single core
+		seq += n;
+	}
+	return 0;
+}
+
+static void *consumer(void *arg)
+{
+	side_t *s = arg;
+	uint32_t seed = s->seed ^ 0x5EED, seq = 0;
+	item_t v[BATCH_MAX];
+
+	while (seq < s->items) {
+		uint32_t n;
+
+		if (!s->batch) {
+			n = test_ring_pop(&q, v);
+		} else if (((seed = seed * 1103515245 + 12345) >> 16 & 7) == 0) {
+			n = test_ring_peek(&q, v);
+			if (n)
+				test_ring_drop(&q);
+		} else {
+			n = test_ring_pop_n(&q, v, 1 + (seed >> 20) % BATCH_MAX);
+		}
+		if (!n)
+			sched_yield();
+		for (uint32_t i = 0; i < n; i++, seq++)
+			if (!whole(&v[i], seq)) {
+				s->bad = 1;
+				s->at = seq;
+				s->got = v[i].seq;
+				return 0;
+			}
+	}
+	return 0;
+}
+
+static int check_threads(const char *check, uint32_t items, int batch)
+{
+	side_t s = { items, rnd(), batch, 0, 0, 0 };
+	pthread_t p, c;
+	uint64_t t0, t1;
+
+	reset(0u - items / 2);
+	t0 = now_ns();
+	if (pthread_create(&c, 0, consumer, &s) || pthread_create(&p, 0, producer, &s))
+		return fail(check, "no threads (%u items, %u)", items, 0);
+	pthread_join(c, 0);
+	t1 = now_ns();
+	if (s.bad) {
+		pthread_cancel(p);  // spins on a full ring
+		return fail(check, "item %u arrived as %u", s.at, s.got);
+	}
+	pthread_join(p, 0);
+	if (test_ring_count(&q))
+		return fail(check, "%u items left over", test_ring_count(&q), 0);
+	printf("%-10s %8u items, %.1f M/s\n", check, (unsigned)items, items * 1e3 / (t1 - t0));
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t items = check_args(argc, argv, DEFAULT_ITEMS);
+	int bad = 0;
+
+	bad |= check_edges();
+	bad |= check_threads("single", items, 0);
+	bad |= check_threads("batch", items, 1);
+	return bad;
+}
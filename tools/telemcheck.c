@@ -0,0 +1,320 @@
+// Telemetry codec round trips.
+//
+//   telemcheck [polls] [seed]
+//
+// Feeds telem_set()/telem_poll() as the firmware does and decodes every
+// frame with telem_decode(), as tools/telemdec.c does, against a model of
+// what the channels last held:
+//
+//   first_key  the first frame is a keyframe with every level channel set
+//              before it, including ones set in the same poll
+//   stream     random level and event updates over many polls, keyframes
+//              and heartbeats included; the decoder tracks the model
+//   size       a day of the firmware's samples: light every 200 ms, climate
+//              every 2 s, a relay toggle an hour and a key every 10 min;
+//              bytes per sample on the wire against a printf text line per
+//              second with the same samples
+//   loss       a dropped frame stops delta decoding until the next keyframe
+//   crc        a flipped bit in any byte is caught
+//   cobs       runs of 0, 1, 253..256 nonzero bytes and zeros at the ends
+//
+// Prints one line per check, exits 1 on any failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry.h"
+#include "check.h"
+
+#define DEFAULT_POLLS 20000
+#define CAPTURE_MAX   4096
+
+static uint8_t capture[CAPTURE_MAX];
+static uint32_t captured;
+static uint64_t sent;
+static int sink(const char *p, int len)
+{
+	if (captured + len <= sizeof(capture)) {
+		memcpy(&capture[captured], p, len);
+		captured += len;
+	}
+	sent += len;
+	return len;
+}
+
+// Next framed chunk of the capture, COBS-decoded into raw; -1 at the end
+static int32_t next_frame(uint32_t *at, uint8_t *raw)
+{
+	uint32_t start = *at;
+
+	while (*at < captured && capture[*at])
+		(*at)++;
+	if (*at >= captured)
+		return -1;
+	(*at)++;
+	return telem_cobs_decode(&capture[start], *at - start - 1, raw);
+}
+
+// What a decoder should hold after the frames so far
+typedef struct {
+	int32_t val[TM_CHANNELS];
+	uint32_t known;
+} model_t;
+
+// Decodes everything captured since the last call and compares each frame
+static int decode_all(const char *check, telem_state_t *dec, const model_t *m, uint32_t *frames,
+                      uint32_t *keys)
+{
+	uint8_t raw[TELEM_FRAME_MAX];
+	uint32_t at = 0, mask;
+	int32_t len;
+	int bad = 0;
+
+	while ((len = next_frame(&at, raw)) >= 0) {
+		int r = telem_decode(dec, raw, len, &mask);
+
+		if (r != TELEM_OK)
+			return fail(check, "frame %u: decode error %u", *frames, -r);
+		(*frames)++;
+		if (raw[0] & TM_F_KEY)
+			(*keys)++;
+	}
+	captured = 0;
+	if ((dec->known & ~TM_EVENTS) != m->known)
+		return fail(check, "known channels %#x, expected %#x", dec->known, m->known);
+	for (int ch = 0; ch < TM_CHANNELS; ch++)
+		if (!((1UL << ch) & TM_EVENTS) && (m->known >> ch & 1) && dec->val[ch] != m->val[ch])
+			bad |= fail(check, "channel %u: %u", ch, dec->val[ch]);
+	return bad;
+}
+
+static void set(model_t *m, uint8_t ch, int32_t v)
+{
+	telem_set(ch, v);
+	if (!((1UL << ch) & TM_EVENTS)) {
+		m->val[ch] = v;
+		m->known |= 1UL << ch;
+	}
+}
+
+// telem_poll() keeps one encoder, so first_key must run before stream
+static int check_first_key(telem_state_t *dec, model_t *m)
+{
+	uint8_t raw[TELEM_FRAME_MAX];
+	uint32_t at = 0, mask, frames = 0, keys = 0;
+	int32_t len;
+
+	// As at boot: light at 0, 200 and 400 ms, climate still waiting
+	set(m, TM_LIGHT, 9000);
+	set(m, TM_LIGHT, 9100);
+	set(m, TM_LIGHT, 9050);
+	set(m, TM_RELAY, 0);
+	telem_poll(500, sink);
+
+	len = next_frame(&at, raw);
+	if (len < 0 || !(raw[0] & TM_F_KEY))
+		return fail("first_key", "no keyframe first (%u bytes captured, %u)", captured, 0);
+	if (telem_decode(dec, raw, len, &mask) != TELEM_OK)
+		return fail("first_key", "decode error", 0, 0);
+	if (mask != ((1UL << TM_LIGHT) | (1UL << TM_RELAY)))
+		return fail("first_key", "mask %#x, expected %#x", mask, (1UL << TM_LIGHT) | (1UL << TM_RELAY));
+	if (dec->val[TM_LIGHT] != 9050 || dec->time != 500)
+		return fail("first_key", "light %u at %u ms", dec->val[TM_LIGHT], dec->time);
+	captured = 0;
+	return decode_all("first_key", dec, m, &frames, &keys);
+}
+
+static int check_stream(telem_state_t *dec, model_t *m, uint32_t polls)
+{
+	uint32_t now = 500, frames = 0, keys = 0;
+
+	for (uint32_t i = 0; i < polls; i++) {
+		uint32_t r = rnd(), n = r & 7;
+
+		// Mostly small steps, some jumps, and quiet stretches for heartbeats
+		now += (r >> 8 & 63) == 0 ? 11000 : 1000;
+		if ((r >> 16 & 15) == 0)
+			n = 0;
+		while (n--) {
+			uint32_t s = rnd();
+			uint8_t ch = s % TM_CHANNELS;
+			int32_t v;
+
+			if ((1UL << ch) & TM_EVENTS)
+				v = "0123456789*#ABCD"[s >> 8 & 15];
+			else if (s >> 8 & 1)
+				v = (m->known >> ch & 1 ? m->val[ch] : 0) + (int32_t)(s >> 9 & 15) - 8;
+			else
+				v = (int32_t)(s >> 9) - (1 << 22);
+			set(m, ch, v);
+		}
+		telem_poll(now, sink);
+		if (decode_all("stream", dec, m, &frames, &keys))
+			return 1;
+	}
+	printf("%-10s %8u frames, %u keyframes over %u polls\n", "stream", (unsigned)frames,
+	       (unsigned)keys, (unsigned)polls);
+	return keys ? 0 : fail("stream", "no keyframe after the first (%u frames)", frames, 0);
+}
+
+#define DAY_S 86400
+
+static const char tag[TM_CHANNELS] = { 'T', 'H', 'L', 'R', 'F', 'K', 'D' };
+
+static int check_size(telem_state_t *dec, model_t *m)
+{
+	uint32_t frames = 0, keys = 0, samples = 0, start_ms = dec->time;
+	uint64_t text = 0, start = sent;
+	int32_t relay = 0, key = 0;
+
+	for (uint32_t t = 0; t < DAY_S; t++) {
+		uint32_t now = start_ms + (t + 1) * 1000, in = 0;
+		// Daylight from 6:00 to 18:00, with sensor noise on top
+		int32_t day = t > 21600 && t < 64800 ? (int32_t)(t - 21600) * (64800 - t) / 60000 : 0;
+		char line[128];
+		int n = snprintf(line, sizeof(line), "%u", (unsigned)now);
+
+		for (int i = 0; i < 5; i++) {
+			set(m, TM_LIGHT, 200 + day + (int32_t)(rnd() % 64));
+			samples++;
+		}
+		in |= 1UL << TM_LIGHT;
+		if (t % 2 == 0) {
+			int32_t temp = 18 + (int32_t)(t / 3600 % 24 < 12 ? t / 3600 % 24 : 24 - t / 3600 % 24);
+			int32_t hum = 85 - 2 * temp + (int32_t)(rnd() % 3);
+			int32_t duty = temp > 20 ? (temp - 20) * 80 + (int32_t)(rnd() % 16) : 0;
+
+			set(m, TM_TEMP, temp);
+			set(m, TM_HUM, hum);
+			set(m, TM_DUTY, duty);
+			set(m, TM_FAN, duty != 0);
+			samples += 4;
+			in |= (1UL << TM_TEMP) | (1UL << TM_HUM) | (1UL << TM_DUTY) | (1UL << TM_FAN);
+		}
+		if (t % 3600 == 1800) {
+			set(m, TM_RELAY, relay = !relay);
+			samples++;
+			in |= 1UL << TM_RELAY;
+		}
+		if (t % 600 == 300) {
+			set(m, TM_KEY, key = "0123456789*#ABCD"[rnd() % 16]);
+			samples++;
+			in |= 1UL << TM_KEY;
+		}
+		for (int ch = 0; ch < TM_CHANNELS; ch++)
+			if (in >> ch & 1)
+				n += snprintf(&line[n], sizeof(line) - n, ch == TM_KEY ? " %c%c" : " %c%d", tag[ch],
+				              ch == TM_KEY ? (int)key : (int)m->val[ch]);
+		text += n + 1;  // and the newline
+		telem_poll(now, sink);
+		if (decode_all("size", dec, m, &frames, &keys))
+			return 1;
+	}
+	printf("%-10s %8u samples, %.2f B/sample binary, %.2f B/sample text\n", "size",
+	       (unsigned)samples, (double)(sent - start) / samples, (double)text / samples);
+	return sent - start < text ? 0 : fail("size", "%u bytes binary, %u text", sent - start, text);
+}
+
+static int check_loss(void)
+{
+	telem_state_t enc, dec;
+	uint8_t frame[TELEM_FRAME_MAX], raw[TELEM_FRAME_MAX];
+	int32_t val[TM_CHANNELS] = { 0 };
+	uint32_t mask;
+	int r;
+
+	memset(&enc, 0, sizeof(enc));
+	memset(&dec, 0, sizeof(dec));
+	for (uint32_t i = 0; i < 3 * TELEM_KEY_EVERY; i++) {
+		uint32_t n;
+		int32_t len;
+
+		val[TM_TEMP] = 20 + i % 5;
+		n = telem_encode(&enc, i * 1000, 1UL << TM_TEMP, val, frame);
+		if (i == TELEM_KEY_EVERY + 3)
+			continue;  // lost on the wire
+		len = telem_cobs_decode(frame, n - 1, raw);
+		r = telem_decode(&dec, raw, len, &mask);
+		if (i > TELEM_KEY_EVERY + 3 && i < 2 * TELEM_KEY_EVERY) {
+			if (r != TELEM_ERR_SYNC)
+				return fail("loss", "frame %u decoded after a gap (%u)", i, -r);
+		} else if (r != TELEM_OK || dec.val[TM_TEMP] != val[TM_TEMP]) {
+			return fail("loss", "frame %u: error %u", i, -r);
+		}
+	}
+	printf("%-10s ok\n", "loss");
+	return 0;
+}
+
+static int check_crc(void)
+{
+	telem_state_t enc, dec;
+	uint8_t frame[TELEM_FRAME_MAX], raw[TELEM_FRAME_MAX];
+	int32_t val[TM_CHANNELS] = { 21, 55, 8123, 1, 1, '#', 640 };
+	uint32_t mask, n;
+	int32_t len;
+
+	memset(&enc, 0, sizeof(enc));
+	n = telem_encode(&enc, 123456, (1UL << TM_CHANNELS) - 1, val, frame);
+	len = telem_cobs_decode(frame, n - 1, raw);
+	for (int32_t i = 0; i < len; i++)
+		for (int b = 0; b < 8; b++) {
+			memset(&dec, 0, sizeof(dec));
+			raw[i] ^= 1 << b;
+			if (telem_decode(&dec, raw, len, &mask) == TELEM_OK)
+				return fail("crc", "byte %u bit %u flipped, frame accepted", i, b);
+			raw[i] ^= 1 << b;
+		}
+	printf("%-10s ok, %u bit flips\n", "crc", (unsigned)len * 8);
+	return 0;
+}
+
+static int check_cobs(void)
+{
+	static const uint32_t lens[] = { 0, 1, 2, 253, 254, 255, 256, 600 };
+	uint8_t in[600], enc[620], out[620];
+
+	for (uint32_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+		for (int zeros = 0; zeros < 4; zeros++) {
+			uint32_t len = lens[l], n;
+			int32_t back;
+
+			for (uint32_t i = 0; i < len; i++)
+				in[i] = 1 + rnd() % 255;
+			if (len && zeros & 1)
+				in[0] = 0;
+			if (len && zeros & 2)
+				in[len - 1] = 0;
+			n = telem_cobs_encode(in, len, enc);
+			if (memchr(enc, 0, n))
+				return fail("cobs", "zero in the encoding of %u bytes (%u)", len, zeros);
+			back = telem_cobs_decode(enc, n, out);
+			if (back != (int32_t)len || memcmp(in, out, len))
+				return fail("cobs", "%u bytes came back as %u", len, back);
+		}
+	printf("%-10s ok\n", "cobs");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t polls = check_args(argc, argv, DEFAULT_POLLS);
+	telem_state_t dec;
+	model_t m;
+	int bad = 0;
+
+	memset(&dec, 0, sizeof(dec));
+	memset(&m, 0, sizeof(m));
+
+	if (check_first_key(&dec, &m)) {
+		bad = 1;
+	} else {
+		printf("%-10s ok\n", "first_key");
+		bad |= check_stream(&dec, &m, polls);
+		bad |= check_size(&dec, &m);
+	}
+	bad |= check_loss();
+	bad |= check_crc();
+	bad |= check_cobs();
+	return bad;
+}
@@ -0,0 +1,109 @@
+// Telemetry capture to CSV.
+//
+//   telemdec [capture.bin] > out.csv
+//
+// Reads a raw serial capture (stdin if no file), splits it on 0x00, checks
+// each frame and prints one CSV row per frame with the last known value of
+// every channel. Frame errors are counted on stderr.
+//
+// Text lines starting with "# " (the probe report, see probe.h) share the
+// link; they go to stderr as they are. A version 1 frame can never start
+// with those two bytes after COBS.
+
+#include <stdio.h>
+#include <string.h>
+#include "telemetry.h"
+
+#define CHUNK_MAX 512  // a probe report line, frames are far shorter
+
+static const char *names[TM_CHANNELS] = { "temp", "hum", "light", "relay", "fan", "key", "duty" };
+
+static void row(const telem_state_t *st, uint32_t mask)
+{
+	printf("%u", (unsigned)st->time);
+	for (int ch = 0; ch < TM_CHANNELS; ch++) {
+		uint32_t bit = 1UL << ch;
+
+		if (bit & TM_EVENTS) {
+			if (mask & bit)
+				printf(",%c", (char)st->val[ch]);
+			else
+				printf(",");
+		} else if (st->known & bit) {
+			printf(",%d", (int)st->val[ch]);
+		} else {
+			printf(",");
+		}
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	uint8_t buf[CHUNK_MAX], raw[CHUNK_MAX];
+	uint32_t n = 0, frames = 0, bad_crc = 0, bad_fmt = 0, unsynced = 0, oversize = 0;
+	telem_state_t st;
+	int c;
+
+	if (argc > 1 && !(in = fopen(argv[1], "rb"))) {
+		perror(argv[1]);
+		return 1;
+	}
+	memset(&st, 0, sizeof(st));
+
+	printf("time_ms");
+	for (int ch = 0; ch < TM_CHANNELS; ch++)
+		printf(",%s", names[ch]);
+	printf("\n");
+
+	while ((c = fgetc(in)) != EOF) {
+		uint32_t mask;
+		int32_t len;
+
+		if (c) {
+			if (n < sizeof(buf))
+				buf[n] = c;
+			n++;
+			continue;
+		}
+		if (n == 0)
+			continue;
+		if (n > sizeof(buf)) {
+			oversize++;
+			n = 0;
+			continue;
+		}
+		if (n >= 2 && buf[0] == '#' && buf[1] == ' ') {
+			fwrite(buf, 1, n, stderr);
+			n = 0;
+			continue;
+		}
+
+		len = telem_cobs_decode(buf, n, raw);
+		n = 0;
+		if (len < 0) {
+			bad_fmt++;
+			continue;
+		}
+		switch (telem_decode(&st, raw, len, &mask)) {
+		case TELEM_OK:
+			frames++;
+			row(&st, mask);
+			break;
+		case TELEM_ERR_CRC:
+			bad_crc++;
+			break;
+		case TELEM_ERR_SYNC:
+			unsynced++;
+			break;
+		default:
+			bad_fmt++;
+			break;
+		}
+	}
+
+	fprintf(stderr, "%u frames, %u crc errors, %u malformed, %u waiting for keyframe, %u oversize\n",
+	        (unsigned)frames, (unsigned)bad_crc, (unsigned)bad_fmt, (unsigned)unsynced, (unsigned)oversize);
+	return (bad_crc || bad_fmt) ? 2 : 0;
+}
@@ -0,0 +1,177 @@
+// Timebase accuracy across clock settings.
+//
+//   timecheck [steps] [seed]
+//
+// Drives the host DWT->CYCCNT and SystemCoreClock the way the core would
+// and compares time_now_us() with the true elapsed time, kept apart as
+// cycles over the rate they ran at:
+//
+//   rates     each clock profile (168, 84, 16 MHz) on its own, random
+//             steps up to just under a CYCCNT wrap
+//   switches  random profile switches through timebase_clock_changed(),
+//             at odd cycle counts so every segment leaves a remainder
+//   sleep     CYCCNT stopped in WFI, the slept cycles credited back
+//   forgot    a switch nobody reported is picked up by time_now_us()
+//
+// time_now_us() must be the true time rounded down to the microsecond, so
+// it never runs ahead, drifts or goes backwards. Prints one line per
+// check, exits 1 on a failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "stm32f4xx.h"
+#include "timebase.h"
+#include "check.h"
+
+#define DEFAULT_STEPS 100000
+
+static const uint32_t rates[] = { 168000000, 84000000, 16000000 };
+#define NRATES (sizeof(rates) / sizeof(rates[0]))
+
+// True time: whole microseconds plus cycles of the current rate
+static uint64_t true_us;
+static uint64_t true_frac;  // cycles, below one microsecond of SystemCoreClock
+
+static void restart(uint32_t hz)
+{
+	SystemCoreClock = hz;
+	timebase_init();
+	true_us = 0;
+	true_frac = 0;
+}
+
+// The core runs n cycles at the current rate
+static void run(uint64_t n, int counting)
+{
+	uint32_t per_us = SystemCoreClock / 1000000;
+
+	if (counting)
+		DWT->CYCCNT += (uint32_t)n;
+	true_frac += n;
+	true_us += true_frac / per_us;
+	true_frac %= per_us;
+}
+
+// The rate changes between two cycles; the partial microsecond carries over
+static void switch_to(uint32_t hz, int report)
+{
+	uint32_t old = SystemCoreClock / 1000000;
+
+	true_frac = true_frac * (hz / 1000000) / old;
+	SystemCoreClock = hz;
+	if (report)
+		timebase_clock_changed();
+}
+
+static uint64_t last_us;
+
+// 0 if time_now_us() is the true time rounded down and has not gone back
+static int compare(const char *check, uint32_t step)
+{
+	uint64_t us = time_now_us();
+
+	if (us < last_us) {
+		printf("FAIL %-10s step %u: %llu us after %llu us\n", check, step,
+		       (unsigned long long)us, (unsigned long long)last_us);
+		return 1;
+	}
+	last_us = us;
+	if (us != true_us) {
+		printf("FAIL %-10s step %u: %llu us, true %llu us + %llu cycles at %u MHz\n", check,
+		       step, (unsigned long long)us, (unsigned long long)true_us,
+		       (unsigned long long)true_frac, (unsigned)(SystemCoreClock / 1000000));
+		return 1;
+	}
+	return 0;
+}
+
+static void begin(uint32_t hz)
+{
+	restart(hz);
+	last_us = 0;
+}
+
+static int check_rates(uint32_t steps)
+{
+	uint64_t s = 0;
+
+	for (uint32_t r = 0; r < NRATES; r++) {
+		begin(rates[r]);
+		for (uint32_t i = 0; i < steps / NRATES; i++) {
+			run(rnd() % 0xFFFFFF00U, 1);
+			if (compare("rates", i))
+				return 1;
+		}
+		s += true_us / 1000000;
+	}
+	printf("%-10s ok, %llu s over %u profiles\n", "rates", (unsigned long long)s, (unsigned)NRATES);
+	return 0;
+}
+
+static int check_switches(uint32_t steps)
+{
+	uint32_t switches = 0;
+
+	begin(rates[0]);
+	for (uint32_t i = 0; i < steps; i++) {
+		run(rnd() % 100000000, 1);
+		if (compare("switches", i))
+			return 1;
+		if (rnd() & 1) {
+			switch_to(rates[rnd() % NRATES], 1);
+			switches++;
+			if (compare("switches", i))
+				return 1;
+		}
+	}
+	printf("%-10s ok, %u switches over %llu s\n", "switches", switches,
+	       (unsigned long long)(true_us / 1000000));
+	return 0;
+}
+
+// WFI stops CYCCNT, the scheduler credits what SysTick counted meanwhile
+static int check_sleep(uint32_t steps)
+{
+	begin(rates[0]);
+	for (uint32_t i = 0; i < steps; i++) {
+		uint32_t awake = rnd() % 1000000, asleep = rnd() % 0x00FFFFFF;
+
+		run(awake, 1);
+		run(asleep, 0);
+		timebase_credit(asleep);
+		if (compare("sleep", i))
+			return 1;
+	}
+	printf("%-10s ok\n", "sleep");
+	return 0;
+}
+
+// Only the time since the last rebase is at the wrong rate, and it is
+// exact again from the first call after the switch
+static int check_forgot(void)
+{
+	begin(rates[0]);
+	run(168000000ULL * 3 + 77, 1);
+	if (compare("forgot", 0))
+		return 1;
+	switch_to(rates[2], 0);
+	if (compare("forgot", 1))
+		return 1;
+	run(16000000ULL * 5 + 11, 1);
+	if (compare("forgot", 2))
+		return 1;
+	printf("%-10s ok\n", "forgot");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t steps = check_args(argc, argv, DEFAULT_STEPS);
+	int bad = 0;
+
+	bad |= check_rates(steps);
+	bad |= check_switches(steps);
+	bad |= check_sleep(steps);
+	bad |= check_forgot();
+	return bad;
+}
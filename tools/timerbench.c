@@ -0,0 +1,226 @@
+// Software timer wheel under load.
+//
+//   timerbench [ticks] [seed]
+//
+// Starts every one of the SWTIMER_MAX timers the bench build of
+// swtimer.c is given (Makefile TIMERBENCH_TIMERS): a quarter periodic,
+// the rest one-shots that restart from their callback, with timeouts
+// spread over all four wheel levels. Between ticks the main loop
+// restarts or stops a random timer now and then, as the firmware does.
+// Every swtimer_tick() is timed on its own, less the cost of an empty
+// timing; prints the mean, p99, p99.9 and worst ns per tick, with and
+// without a cascade, and the same for swtimer_start(). For scale, the
+// same timers kept as down-counters scanned every tick.
+//
+// Each callback checks it fired on the tick it was due; exits 1 if one
+// was early, late, or fired after it was stopped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "swtimer.h"
+#include "check.h"
+
+#define DEFAULT_TICKS 1000000
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t timer_cost(void)
+{
+	uint32_t best = ~0U;
+
+	for (int i = 0; i < 10000; i++) {
+		uint64_t a = now_ns(), b = now_ns();
+
+		if (b - a < best)
+			best = b - a;
+	}
+	return best;
+}
+
+// Mostly short timeouts, some on each higher level of the wheel
+static uint32_t pick_ms(void)
+{
+	uint32_t r = rnd();
+
+	switch (r & 3) {
+	case 0:
+	case 1:
+		return 1 + (r >> 2) % 64;
+	case 2:
+		return 1 + (r >> 2) % 4096;
+	default:
+		return 1 + (r >> 2) % (r >> 30 ? SWTIMER_MAX_MS : 1UL << 18);
+	}
+}
+
+static uint32_t now;  // ticks, as the wheel counts them
+static uint32_t due[SWTIMER_MAX], period[SWTIMER_MAX];
+static uint8_t running[SWTIMER_MAX];
+static uint64_t fired, wrong;
+
+static void start(int id, uint32_t ms, uint32_t per)
+{
+	swtimer_start(id, ms, per);
+	due[id] = now + ms;
+	period[id] = per;
+	running[id] = 1;
+}
+
+static void expired(void *arg)
+{
+	int id = (int)(intptr_t)arg;
+
+	fired++;
+	if (!running[id] || due[id] != now)
+		wrong++;
+	if (period[id]) {
+		due[id] += period[id];
+	} else {
+		running[id] = 0;
+		start(id, pick_ms(), 0);
+	}
+}
+
+typedef struct {
+	uint32_t *ns;
+	uint32_t n;
+	uint64_t sum;
+} stat_t;
+
+static void add(stat_t *s, uint32_t ns)
+{
+	s->ns[s->n++] = ns;
+	s->sum += ns;
+}
+
+static void report(const char *name, stat_t *s)
+{
+	uint32_t n = s->n;
+
+	if (!n) {
+		printf("%-10s %8s\n", name, "-");
+		return;
+	}
+	qsort(s->ns, n, sizeof(*s->ns), cmp_u32);
+	printf("%-10s %8.1f %8u %8u %8u %10u\n", name, (double)s->sum / n, s->ns[n - n / 100 - 1],
+	       s->ns[n - n / 1000 - 1], s->ns[n - 1], n);
+}
+
+// The alternative: every timer a down-counter, all of them looked at each tick
+static uint32_t left[SWTIMER_MAX];
+
+static void scan_tick(void)
+{
+	for (int i = 0; i < SWTIMER_MAX; i++)
+		if (left[i] && !--left[i]) {
+			fired++;
+			left[i] = period[i] ? period[i] : pick_ms();
+		}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t ticks = check_args(argc, argv, DEFAULT_TICKS), base;
+	stat_t tick = { 0 }, cascade = { 0 }, starts = { 0 }, scan = { 0 };
+	uint64_t scan_fired;
+
+	if (!ticks) {
+		fprintf(stderr, "usage: timerbench [ticks] [seed]\n");
+		return 2;
+	}
+	tick.ns = malloc(ticks * sizeof(uint32_t));
+	cascade.ns = malloc(ticks * sizeof(uint32_t));
+	starts.ns = malloc(ticks * sizeof(uint32_t));
+	scan.ns = malloc(ticks * sizeof(uint32_t));
+	base = timer_cost();
+
+	for (int i = 0; i < SWTIMER_MAX; i++) {
+		if (swtimer_create(expired, (void *)(intptr_t)i) != i) {
+			fprintf(stderr, "timerbench: swtimer_create failed at %d\n", i);
+			return 1;
+		}
+		if (i % 4 == 0)
+			start(i, 1 + rnd() % 1000, 1 + rnd() % 10000);
+		else
+			start(i, pick_ms(), 0);
+	}
+
+	for (uint32_t i = 0; i < ticks; i++) {
+		uint64_t a, b;
+		uint32_t r = rnd();
+
+		if ((r & 15) == 0) {
+			int id = (r >> 4) % SWTIMER_MAX;
+			uint32_t ms = pick_ms();
+
+			if (r >> 31) {
+				swtimer_stop(id);
+				running[id] = 0;
+			} else {
+				a = now_ns();
+				swtimer_start(id, ms, period[id]);
+				b = now_ns();
+				add(&starts, b - a > base ? b - a - base : 0);
+				due[id] = now + ms;
+				running[id] = 1;
+			}
+		}
+
+		// Stopped timers come back, so the wheel stays full
+		if ((r & 0x3F0) == 0x3F0) {
+			int id = (r >> 10) % SWTIMER_MAX;
+
+			if (!running[id])
+				start(id, pick_ms(), period[id]);
+		}
+
+		now++;
+		a = now_ns();
+		swtimer_tick();
+		b = now_ns();
+		add(now & 63 ? &tick : &cascade, b - a > base ? b - a - base : 0);
+	}
+
+	printf("%u timers, %u ticks, %llu expiries, timer %u ns subtracted\n", SWTIMER_MAX, ticks,
+	       (unsigned long long)fired, base);
+	printf("%-10s %8s %8s %8s %8s %10s\n", "ns per", "mean", "p99", "p99.9", "max", "calls");
+	report("tick", &tick);
+	report("cascade", &cascade);
+	report("start", &starts);
+
+	// The same load as down-counters
+	for (int i = 0; i < SWTIMER_MAX; i++)
+		left[i] = 1 + rnd() % 4096;
+	scan_fired = fired;
+	for (uint32_t i = 0; i < ticks / 10; i++) {
+		uint64_t a = now_ns(), b;
+
+		scan_tick();
+		b = now_ns();
+		add(&scan, b - a > base ? b - a - base : 0);
+	}
+	report("scan", &scan);
+	printf("scan: %llu expiries over %u ticks\n", (unsigned long long)(fired - scan_fired), ticks / 10);
+
+	if (wrong) {
+		printf("FAIL %llu of %llu callbacks off their tick\n", (unsigned long long)wrong,
+		       (unsigned long long)fired);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,222 @@
+// TM1637 waveform against the two-wire protocol.
+//
+//   tm1637check [frames] [seed]
+//
+// Replays the GPIOC->BSRR words tm1637_build() makes on a model of the
+// CLK and DIO lines and decodes them as the chip would: a start is DIO
+// falling with CLK high, a stop DIO rising with CLK high, a data bit is
+// DIO at a rising CLK edge, LSB first, with DIO released for the ninth
+// (ACK) clock. DIO may only move while CLK is low or in the word that
+// takes CLK low, which lands both at once after the chip's hold time.
+//
+//   frames      random digits and brightness come out as the three
+//               transactions: data command, address and 4 digits, control
+//   numbers     tm1637_show_number() through the DMA buffer it hands to
+//               the stream: sign, leading zeros, blanking, out of range
+//   brightness  every level and an out-of-range one in the control byte
+//
+// Prints one line per check, exits 1 on any failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "board.h"
+#include "tm1637.h"
+#include "check.h"
+
+#define DEFAULT_FRAMES 100000
+#define MAX_TX         4
+#define MAX_BYTES      8
+
+#define CLK_BIT PIN_BIT(SEG_CLK)
+#define DIO_BIT PIN_BIT(SEG_DIO)
+
+void DMA2_Stream1_IRQHandler(void);
+
+static const uint8_t digit_seg[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+
+// What the chip received
+typedef struct {
+	uint8_t n;
+	uint8_t len[MAX_TX];
+	uint8_t b[MAX_TX][MAX_BYTES];
+} bus_t;
+
+// 0 if the words are a valid transfer that leaves the bus idle; the first
+// violation otherwise, with the word it happened at in *at
+static const char *decode(const uint32_t *w, uint16_t n, bus_t *bus, unsigned *at)
+{
+	uint32_t lines = CLK_BIT | DIO_BIT;  // idle: both high
+	int open = 0, bits = 0;
+
+	memset(bus, 0, sizeof(*bus));
+	for (*at = 0; *at < n; (*at)++) {
+		uint32_t next = (lines & ~(w[*at] >> 16)) | (w[*at] & 0xFFFF);
+		uint32_t moved = lines ^ next;
+
+		if (w[*at] & ~((CLK_BIT | DIO_BIT) * 0x10001))
+			return "word touches another pin";
+		if ((moved & DIO_BIT) && (lines & CLK_BIT) && (next & CLK_BIT)) {
+			if (next & DIO_BIT) {  // stop, after a byte or the clock that sets it up
+				if (!open)
+					return "stop with no start";
+				if (bits % 9 > 1)
+					return "stop inside a byte";
+				open = 0;
+				bus->len[bus->n++] = bits / 9;
+			} else {               // start
+				if (open)
+					return "start inside a transaction";
+				if (bus->n == MAX_TX)
+					return "too many transactions";
+				open = 1;
+				bits = 0;
+			}
+		} else if ((moved & CLK_BIT) && (next & CLK_BIT)) {
+			if (!open)
+				return "clock outside a transaction";
+			if (bits % 9 == 8) {
+				if (!(next & DIO_BIT))
+					return "DIO held low for the ACK";
+			} else {
+				if (bits / 9 >= MAX_BYTES)
+					return "too many bytes";
+				bus->b[bus->n][bits / 9] |= (next & DIO_BIT ? 1 : 0) << (bits % 9);
+			}
+			bits++;
+		}
+		lines = next;
+	}
+	if (open)
+		return "transaction not stopped";
+	if (lines != (CLK_BIT | DIO_BIT))
+		return "bus not left idle";
+	return 0;
+}
+
+// 0 if bus holds the update for seg at the control byte ctrl
+static const char *expect(const bus_t *bus, const uint8_t seg[4], uint8_t ctrl)
+{
+	if (bus->n != 3 || bus->len[0] != 1 || bus->len[1] != 5 || bus->len[2] != 1)
+		return "not 1, 5 and 1 bytes";
+	if (bus->b[0][0] != 0x40)
+		return "data command";
+	if (bus->b[1][0] != 0xC0)
+		return "address command";
+	if (memcmp(&bus->b[1][1], seg, 4))
+		return "digit segments";
+	if (bus->b[2][0] != ctrl)
+		return "control byte";
+	return 0;
+}
+
+static int check_frames(uint32_t frames)
+{
+	uint32_t w[TM1637_WORDS];
+	bus_t bus;
+
+	for (uint32_t i = 0; i < frames; i++) {
+		uint32_t r = rnd();
+		uint8_t seg[4] = { r, r >> 8, r >> 16, r >> 24 }, ctrl = 0x80 | (rnd() & 0xF);
+		uint16_t n = tm1637_build(w, seg, ctrl);
+		const char *err;
+		unsigned at;
+
+		if (n != TM1637_WORDS)
+			return fail("frames", "frame %u: %u words", i, n);
+		if ((err = decode(w, n, &bus, &at)) || (err = expect(&bus, seg, ctrl))) {
+			printf("FAIL %-10s frame %u: %s (word %u)\n", "frames", (unsigned)i, err, at);
+			return 1;
+		}
+	}
+	printf("%-10s %8u frames, %u words, %u us each\n", "frames", (unsigned)frames,
+	       (unsigned)TM1637_WORDS, (unsigned)(TM1637_WORDS * TM1637_STEP_US));
+	return 0;
+}
+
+// The update the driver handed to DMA2 Stream1, decoded; then the stream
+// completes so the next update starts at once
+static const char *sent(bus_t *bus)
+{
+	const uint32_t *w = (const uint32_t *)(uintptr_t)DMA2_Stream1->M0AR;
+	uint16_t n = DMA2_Stream1->NDTR;
+	const char *err;
+	unsigned at;
+
+	if (!(DMA2_Stream1->CR & 1))
+		return "stream not enabled";
+	err = n == TM1637_WORDS ? decode(w, n, bus, &at) : "length";
+	DMA2_Stream1_IRQHandler();
+	return err;
+}
+
+static void text_seg(uint8_t seg[4], const char *text)
+{
+	for (int i = 0; i < 4; i++)
+		seg[i] = text[i] == '-' ? 0x40 : text[i] == ' ' ? 0 : digit_seg[text[i] - '0'];
+}
+
+static int check_numbers(void)
+{
+	static const int values[] = { 0, 7, 42, 305, 9999, -1, -5, -42, -999, 10000, -1000, 123456 };
+	uint8_t ctrl = 0x88 | 2, seg[4];
+	char text[16];
+	int cases = 0;
+	bus_t bus;
+
+	tm1637_brightness(2);
+	for (uint32_t v = 0; v < sizeof(values) / sizeof(values[0]); v++)
+		for (int zeros = 0; zeros < 2; zeros++) {
+			int x = values[v];
+			const char *err;
+
+			if (x > 9999 || x < -999)
+				snprintf(text, sizeof(text), "----");
+			else
+				snprintf(text, sizeof(text), zeros ? "%04d" : "%4d", x);
+			text_seg(seg, text);
+			tm1637_show_number(x, zeros);
+			if ((err = sent(&bus)) || (err = expect(&bus, seg, ctrl))) {
+				printf("FAIL %-10s %d%s: %s, want \"%s\"\n", "numbers", x,
+				       zeros ? " zero-filled" : "", err, text);
+				return 1;
+			}
+			cases++;
+		}
+	tm1637_blank();
+	memset(seg, 0, sizeof(seg));
+	if (sent(&bus) || expect(&bus, seg, ctrl))
+		return fail("numbers", "blank: %u transactions (%u)", bus.n, 0);
+	printf("%-10s ok, %u values\n", "numbers", (unsigned)cases);
+	return 0;
+}
+
+static int check_brightness(void)
+{
+	static const uint8_t seg[4] = { 0x3F, 0x06, 0x5B, 0x4F };
+	bus_t bus;
+
+	for (uint8_t level = 0; level <= 8; level++) {
+		uint8_t want = 0x88 | (level & 7);
+
+		tm1637_brightness(level);
+		tm1637_show_segments(seg);
+		if (sent(&bus) || bus.n != 3 || bus.b[2][0] != want)
+			return fail("brightness", "level %u: control byte %#x", level, bus.b[2][0]);
+	}
+	printf("%-10s ok\n", "brightness");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t frames = check_args(argc, argv, DEFAULT_FRAMES);
+	int bad = 0;
+
+	tm1637_init();
+	bad |= check_frames(frames);
+	bad |= check_numbers();
+	bad |= check_brightness();
+	return bad;
+}